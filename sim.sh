@@ -15,6 +15,24 @@ if [ "$#" -gt 2 ]; then
     output="$3"
 fi
 
+# with a psnr confidence interval target, r is the maximum repeat counter
+ci_args=""
+if [ "$#" -gt 3 ]; then
+    ci_args="--psnr-ci $4"
+fi
+
+# uwmf, ibinr or both
+algorithm_args=""
+if [ "$#" -gt 4 ]; then
+    algorithm_args="--algorithm $5"
+fi
+
+# completed cells go to a results store, a killed run resumes from it
+results_args=""
+if [ "$#" -gt 5 ]; then
+    results_args="--results $6"
+fi
+
 echo "" > $output
 
 corr_dens=(0.1 0.3 0.5 0.7 0.9)
@@ -23,7 +41,7 @@ wsizes=(1 2 3 4 6)
 for file_name in $imgs_folder/*.png; do
     echo "processing $file_name" | tee -a $output
     for i in ${!corr_dens[@]}; do
-        ./uwmf -i $file_name -m s -w ${wsizes[i]} -d ${corr_dens[i]} -r $r 2>>$output
+        ./uwmf -i $file_name -m s -w ${wsizes[i]} -d ${corr_dens[i]} -r $r $ci_args $algorithm_args $results_args 2>>$output
         echo "--------------------" >> $output
     done
     echo "" >> $output
@@ -0,0 +1,76 @@
+#include "async_restore.h"
+
+#include "image.h"
+#include "noise_detectors.h"
+#include "trace.h"
+#include "utils.h"
+#include "uwmf.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace uwmf
+{
+
+bool restore_cancellable(uwmf_filter& filter,
+        const monochrome_image& corrupted_image, const noise_mask& mask,
+        const restore_control& control, monochrome_image& restored_image)
+{
+    ASSERT(control.band_rows > 0, "bands must have rows");
+
+    const std::size_t width = corrupted_image.width();
+    const std::size_t height = corrupted_image.height();
+    restored_image.resize(width, height);
+    for(std::size_t y = 0; y < height; y += control.band_rows) {
+        if(control.token.cancelled()) {
+            return false;
+        }
+
+        const std::size_t rows = std::min(control.band_rows, height - y);
+        TRACE_SCOPE("restore band", y / control.band_rows);
+        filter.restore_region(corrupted_image, mask, {0, y, width, rows},
+                restored_image);
+        if(control.progress) {
+            control.progress(y + rows, height);
+        }
+    }
+
+    return !control.token.cancelled();
+}
+
+restore_task restore_async(monochrome_image corrupted_image,
+        const uwmf_parameters& parameters,
+        const async_restore_options& options)
+{
+    auto result = std::async(std::launch::async,
+            [corrupted = std::move(corrupted_image), parameters, options] ()
+                    mutable -> restore_task::result_type
+            {
+                // the shared state keeps the function object until the task
+                // is destroyed, the image must not stay with it
+                const monochrome_image image = std::move(corrupted);
+                const auto& control = options.control;
+                if(control.token.cancelled()) {
+                    return std::nullopt;
+                }
+
+                uwmf_filter filter(parameters, options.engine,
+                        options.threads);
+                noise_mask mask;
+                visit_detector(options.detector, [&] (const auto& detector)
+                {
+                    detect_noise(image, detector, mask);
+                });
+
+                monochrome_image restored_image;
+                if(!restore_cancellable(filter, image, mask, control,
+                        restored_image)) {
+                    return std::nullopt;
+                }
+                return restored_image;
+            });
+
+    return restore_task(options.control.token, std::move(result));
+}
+
+} // uwmf
@@ -0,0 +1,116 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+
+#include "image.h"
+#include "noise_detectors.h"
+#include "uwmf.h"
+
+namespace uwmf
+{
+
+// copies share the flag, so that one of them can be handed to the
+// restoration and another one kept to cancel it
+class cancellation_token
+{
+public:
+    cancellation_token()
+        : cancelled_(std::make_shared<std::atomic<bool>>(false))
+    {
+    }
+
+    void cancel()
+    {
+        *cancelled_ = true;
+    }
+
+    bool cancelled() const
+    {
+        return *cancelled_;
+    }
+
+private:
+    std::shared_ptr<std::atomic<bool>> cancelled_;
+};
+
+// called from the restoring thread after every band
+using progress_callback =
+        std::function<void(std::size_t rows_done, std::size_t rows)>;
+
+struct restore_control
+{
+    cancellation_token token;
+    progress_callback progress; // may be empty
+    std::size_t band_rows = 16;
+};
+
+// restores the image band by band of full rows (see
+// uwmf_filter::restore_region()), so the result is the same as that of
+// restore_with_mask(). cancellation is checked between bands, returns false
+// if the restoration was cancelled, restored_image is incomplete then
+bool restore_cancellable(uwmf_filter& filter,
+        const monochrome_image& corrupted_image, const noise_mask& mask,
+        const restore_control& control, monochrome_image& restored_image);
+
+// handle of a restoration running in a thread of its own
+class restore_task
+{
+public:
+    using result_type = std::optional<monochrome_image>;
+
+    restore_task(cancellation_token token, std::future<result_type> result)
+        : token_(std::move(token))
+        , result_(std::move(result))
+    {
+    }
+
+    // the restoration stops at the next band and releases its buffers
+    void cancel()
+    {
+        token_.cancel();
+    }
+
+    template<typename Rep, typename Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& timeout) const
+    {
+        return result_.wait_for(timeout) == std::future_status::ready;
+    }
+
+    // blocks until the restoration is done, std::nullopt if it was
+    // cancelled. may only be called once
+    result_type get()
+    {
+        return result_.get();
+    }
+
+private:
+    cancellation_token token_;
+    std::future<result_type> result_;
+};
+
+struct async_restore_options
+{
+    engine_type engine = engine_type::AUTO;
+    detector_options detector = {detector_type::NAIVE,
+            road_noise_detector::default_threshold};
+    std::size_t threads = 1; // of the filter, see uwmf_filter
+    restore_control control;
+};
+
+// the restoration owns corrupted_image and everything else it needs, all of
+// which is released as soon as it finishes or notices the cancellation.
+// the destructor of the task waits for the restoration, cancel it first to
+// abandon it
+restore_task restore_async(monochrome_image corrupted_image,
+        const uwmf_parameters& parameters,
+        const async_restore_options& options);
+
+} // uwmf
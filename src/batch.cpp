@@ -0,0 +1,58 @@
+#include "batch.h"
+
+#include "image.h"
+#include "noise_detectors.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "uwmf.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace uwmf
+{
+
+batch_restorer::batch_restorer(const uwmf_parameters& parameters,
+        const engine_type engine, const detector_options& detector,
+        const std::size_t threads)
+    : detector_(detector)
+{
+    const std::size_t count = std::max<std::size_t>(threads, 1);
+    filters_.reserve(count);
+    for(std::size_t i = 0; i < count; i++) {
+        filters_.emplace_back(parameters, engine);
+    }
+}
+
+void batch_restorer::restore(const std::vector<monochrome_image>& images,
+        std::vector<monochrome_image>& restored_images)
+{
+    restored_images.resize(images.size());
+
+    // images are handed out one at a time, so slow ones balance out
+    std::atomic<std::size_t> next{0};
+    const auto run = [&] (uwmf_filter& filter)
+    {
+        visit_detector(detector_, [&] (const auto& detector)
+        {
+            for(std::size_t i = next++; i < images.size(); i = next++) {
+                TRACE_SCOPE("batch image", i);
+                filter.restore(images[i], detector, restored_images[i]);
+            }
+        });
+    };
+
+    const std::size_t threads = std::min(filters_.size(), images.size());
+    if(threads <= 1) {
+        run(filters_.front());
+        return;
+    }
+
+    // the destructor of the pool waits for all tasks
+    thread_pool pool(threads, threads);
+    for(std::size_t t = 0; t < threads; t++) {
+        pool.submit([&run, &filter = filters_[t]] { run(filter); });
+    }
+}
+
+} // uwmf
@@ -0,0 +1,45 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "image.h"
+#include "noise_detectors.h"
+#include "utils.h"
+#include "uwmf.h"
+
+namespace uwmf
+{
+
+// restores many small images, e.g. thumbnails, whose restoration takes
+// little longer than setting up a filter (weight table, lookup table, fft
+// plans and scratch) and that have too few corrupted pixels to be split
+// across threads. every thread keeps a filter for the lifetime of the
+// batch_restorer and restores whole images with it, so the setup is paid
+// once per thread and the threads never wait for each other within an image
+class batch_restorer
+{
+public:
+    batch_restorer(const uwmf_parameters& parameters, const engine_type engine,
+            const detector_options& detector, const std::size_t threads);
+
+    DELETE_COPY_AND_ASSIGN(batch_restorer);
+
+    // the images may differ in size. restored_images ends up with one
+    // image per input, their buffers are reused from batch to batch
+    void restore(const std::vector<monochrome_image>& images,
+            std::vector<monochrome_image>& restored_images);
+
+    std::size_t threads() const
+    {
+        return filters_.size();
+    }
+
+private:
+    detector_options detector_;
+    std::vector<uwmf_filter> filters_; // one per thread
+};
+
+} // uwmf
@@ -0,0 +1,123 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+#include "utils.h"
+
+namespace uwmf
+{
+
+// multi-producer multi-consumer fifo that blocks producers while full
+template<typename ValueType>
+class bounded_queue
+{
+public:
+    explicit bounded_queue(std::size_t capacity)
+        : capacity_(capacity)
+        , closed_(false)
+    {
+        ASSERT(capacity_ > 0, "queue capacity must be positive");
+    }
+
+    DELETE_COPY_AND_ASSIGN(bounded_queue);
+
+    // returns false if the queue got closed before value could be queued
+    bool push(ValueType value)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock,
+                [this] { return closed_ || queue_.size() < capacity_; });
+        if(closed_) {
+            return false;
+        }
+
+        queue_.push_back(std::move(value));
+        lock.unlock();
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // returns false right away if the queue is full or closed
+    bool try_push(ValueType value)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if(closed_ || queue_.size() >= capacity_) {
+            return false;
+        }
+
+        queue_.push_back(std::move(value));
+        lock.unlock();
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // returns std::nullopt once the queue is closed and drained
+    std::optional<ValueType> pop()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+        if(queue_.empty()) {
+            return std::nullopt;
+        }
+
+        ValueType value = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+        not_full_.notify_one();
+        return value;
+    }
+
+    // returns std::nullopt right away if the queue is empty
+    std::optional<ValueType> try_pop()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if(queue_.empty()) {
+            return std::nullopt;
+        }
+
+        ValueType value = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+        not_full_.notify_one();
+        return value;
+    }
+
+    // pending values are still handed out to consumers
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return queue_.size();
+    }
+
+    std::size_t capacity() const
+    {
+        return capacity_;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<ValueType> queue_;
+    const std::size_t capacity_;
+    bool closed_;
+};
+
+} // uwmf
@@ -0,0 +1,113 @@
+#include "client.h"
+
+#include "logger.h"
+
+#include <cstring>
+#include <utility>
+
+namespace uwmf
+{
+
+restoration_client::restoration_client(unix_socket socket)
+    : socket_(std::move(socket))
+    , next_id_(0)
+{
+}
+
+std::optional<restoration_client> restoration_client::connect(
+        const std::string& socket_path)
+{
+    auto socket = unix_socket::connect(socket_path);
+    if(!socket) {
+        return std::nullopt;
+    }
+
+    return restoration_client(std::move(*socket));
+}
+
+std::optional<response_message> restoration_client::transact(
+        request_message request, const int fd)
+{
+    request.id = next_id_++;
+    if(!socket_.send(&request, sizeof(request), fd)) {
+        LOGE() << "failed to send request";
+        return std::nullopt;
+    }
+
+    response_message response{};
+    if(!socket_.receive(&response, sizeof(response))) {
+        LOGE() << "failed to receive response";
+        return std::nullopt;
+    }
+
+    if(response.id != request.id) {
+        LOGE() << "protocol error: response " << response.id
+                << " to request " << request.id;
+        return std::nullopt;
+    }
+    else if(response.status == response_status::BUSY) {
+        LOGE() << "server busy, its queue is full";
+        return std::nullopt;
+    }
+    else if(response.status != response_status::OK) {
+        LOGE() << "server failed to process request";
+        return std::nullopt;
+    }
+
+    return response;
+}
+
+std::optional<monochrome_image> restoration_client::restore(
+        const monochrome_image& corrupted_image,
+        const uwmf_parameters parameters)
+{
+    const std::size_t width = corrupted_image.width();
+    const std::size_t height = corrupted_image.height();
+    const std::size_t size = width * height;
+
+    if(!buffer_ || buffer_->size() < shared_buffer_size(width, height)) {
+        buffer_ = shared_buffer::create(shared_buffer_size(width, height));
+        if(!buffer_) {
+            return std::nullopt;
+        }
+    }
+
+    std::memcpy(buffer_->data(), corrupted_image.data().data(), size);
+
+    request_message request{};
+    request.type = request_type::RESTORE;
+    request.width = width;
+    request.height = height;
+    request.w = parameters.w;
+    request.p = parameters.p;
+    request.k = parameters.k;
+    request.algorithm = static_cast<std::uint32_t>(parameters.algorithm);
+    if(!transact(request, buffer_->fd())) {
+        return std::nullopt;
+    }
+
+    monochrome_image restored_image(width, height);
+    std::memcpy(restored_image.data().data(), buffer_->data() + size, size);
+    return restored_image;
+}
+
+std::optional<server_stats> restoration_client::stats()
+{
+    request_message request{};
+    request.type = request_type::STATS;
+    auto response = transact(request);
+    if(!response) {
+        return std::nullopt;
+    }
+
+    return response->stats;
+}
+
+bool restoration_client::shutdown()
+{
+    request_message request{};
+    request.type = request_type::SHUTDOWN;
+    return transact(request).has_value();
+}
+
+} // uwmf
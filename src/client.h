@@ -0,0 +1,42 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "image.h"
+#include "ipc.h"
+#include "server_protocol.h"
+#include "uwmf.h"
+
+namespace uwmf
+{
+
+// talks to a server started with serve(). the shared buffer is kept
+// between requests and only reallocated when a larger image comes along
+class restoration_client
+{
+public:
+    static std::optional<restoration_client> connect(
+            const std::string& socket_path);
+
+    std::optional<monochrome_image> restore(
+            const monochrome_image& corrupted_image,
+            const uwmf_parameters parameters);
+    std::optional<server_stats> stats();
+    bool shutdown();
+
+private:
+    explicit restoration_client(unix_socket socket);
+
+    std::optional<response_message> transact(request_message request,
+            const int fd = -1);
+
+    unix_socket socket_;
+    std::optional<shared_buffer> buffer_;
+    std::uint64_t next_id_;
+};
+
+} // uwmf
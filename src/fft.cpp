@@ -0,0 +1,108 @@
+#include "fft.h"
+
+#include "utils.h"
+
+#include <cmath>
+#include <utility>
+
+namespace
+{
+
+using complex = uwmf::fft2d::complex;
+
+// plain complex product, operator* goes through the slow path that takes
+// care of infinities
+complex multiply(const complex& a, const complex& b)
+{
+    return {a.real() * b.real() - a.imag() * b.imag(),
+            a.real() * b.imag() + a.imag() * b.real()};
+}
+
+} // anonymous
+
+namespace uwmf
+{
+
+fft2d::fft2d(const std::size_t size)
+    : size_(size)
+    , twiddles_(size / 2)
+    , reversed_(size)
+    , column_(size)
+{
+    ASSERT(size > 0 && (size & (size - 1)) == 0,
+            "fft size must be a power of two");
+
+    const double pi = std::acos(-1.0);
+    for(std::size_t k = 0; k < size / 2; k++) {
+        const double angle = -2 * pi * k / size;
+        twiddles_[k] = {std::cos(angle), std::sin(angle)};
+    }
+
+    std::size_t bits = 0;
+    while((std::size_t{1} << bits) < size) {
+        bits++;
+    }
+    for(std::size_t i = 0; i < size; i++) {
+        std::size_t r = 0;
+        for(std::size_t b = 0; b < bits; b++) {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        reversed_[i] = r;
+    }
+}
+
+void fft2d::forward(std::vector<complex>& data)
+{
+    transform(data, false);
+}
+
+void fft2d::inverse(std::vector<complex>& data)
+{
+    transform(data, true);
+}
+
+void fft2d::transform(std::vector<complex>& data, const bool inverse)
+{
+    ASSERT(data.size() == size_ * size_, "fft data has the wrong size");
+
+    for(std::size_t y = 0; y < size_; y++) {
+        transform_1d(data.data() + y * size_, inverse);
+    }
+
+    for(std::size_t x = 0; x < size_; x++) {
+        for(std::size_t y = 0; y < size_; y++) {
+            column_[y] = data[y * size_ + x];
+        }
+        transform_1d(column_.data(), inverse);
+        for(std::size_t y = 0; y < size_; y++) {
+            data[y * size_ + x] = column_[y];
+        }
+    }
+}
+
+void fft2d::transform_1d(complex* data, const bool inverse) const
+{
+    for(std::size_t i = 0; i < size_; i++) {
+        if(i < reversed_[i]) {
+            std::swap(data[i], data[reversed_[i]]);
+        }
+    }
+
+    for(std::size_t length = 2; length <= size_; length <<= 1) {
+        const std::size_t half = length / 2;
+        const std::size_t step = size_ / length;
+        for(std::size_t i = 0; i < size_; i += length) {
+            for(std::size_t k = 0; k < half; k++) {
+                const complex twiddle = inverse
+                        ? std::conj(twiddles_[k * step])
+                        : twiddles_[k * step];
+                const complex t = multiply(twiddle, data[i + k + half]);
+                const complex u = data[i + k];
+                data[i + k] = u + t;
+                data[i + k + half] = u - t;
+            }
+        }
+    }
+}
+
+} // uwmf
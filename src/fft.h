@@ -0,0 +1,39 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+namespace uwmf
+{
+
+// radix-2 fast Fourier transform of square size x size arrays (row-major),
+// size must be a power of two. the inverse transform is not normalized
+class fft2d
+{
+public:
+    using complex = std::complex<double>;
+
+    explicit fft2d(const std::size_t size);
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    void forward(std::vector<complex>& data);
+    void inverse(std::vector<complex>& data);
+
+private:
+    std::size_t size_;
+    std::vector<complex> twiddles_;
+    std::vector<std::size_t> reversed_;
+    std::vector<complex> column_;
+
+    void transform(std::vector<complex>& data, const bool inverse);
+    void transform_1d(complex* data, const bool inverse) const;
+};
+
+} // uwmf
@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include <iterator>
 #include <ostream>
@@ -104,11 +105,25 @@ public:
     {
     }
 
+    std::vector<PixelValueType>& data()
+    {
+        return buffer_;
+    }
+
     const std::vector<PixelValueType>& data() const
     {
         return buffer_;
     }
 
+    // keeps the allocated storage when shrinking, pixel values are not
+    // preserved in a meaningful layout
+    void resize(std::size_t width, std::size_t height)
+    {
+        width_ = width;
+        height_ = height;
+        buffer_.resize(width * height);
+    }
+
     PixelValueType& operator()(std::size_t x, std::size_t y)
     {
         ASSERT(x + (width_ * y) < buffer_.size(), "indices out ouf bounds");
@@ -173,6 +188,53 @@ std::ostream& operator<<(std::ostream& out,
 
 using monochrome_image = basic_image<unsigned char>;
 
+// cropped is resized as necessary, its buffer is reused otherwise
+template<typename PixelValueType>
+void crop(const basic_image<PixelValueType>& image, const rect& region,
+        basic_image<PixelValueType>& cropped)
+{
+    ASSERT(region.x + region.width <= image.width()
+            && region.y + region.height <= image.height(),
+            "region out of bounds");
+
+    cropped.resize(region.width, region.height);
+    for(std::size_t y = 0; y < region.height; y++) {
+        const auto row = image.data().begin()
+                + (region.y + y) * image.width() + region.x;
+        std::copy(row, row + region.width,
+                cropped.data().begin() + y * region.width);
+    }
+}
+
+template<typename PixelValueType>
+basic_image<PixelValueType> crop(const basic_image<PixelValueType>& image,
+        const rect& region)
+{
+    basic_image<PixelValueType> cropped;
+    crop(image, region, cropped);
+    return cropped;
+}
+
+// copies region of source to (x, y) of target
+template<typename PixelValueType>
+void paste(const basic_image<PixelValueType>& source, const rect& region,
+        basic_image<PixelValueType>& target, const std::size_t x,
+        const std::size_t y)
+{
+    ASSERT(region.x + region.width <= source.width()
+            && region.y + region.height <= source.height()
+            && x + region.width <= target.width()
+            && y + region.height <= target.height(),
+            "region out of bounds");
+
+    for(std::size_t yy = 0; yy < region.height; yy++) {
+        const auto row = source.data().begin()
+                + (region.y + yy) * source.width() + region.x;
+        std::copy(row, row + region.width,
+                target.data().begin() + (y + yy) * target.width() + x);
+    }
+}
+
 template<typename... ImageTypes>
 class image_zip_iterator
 {
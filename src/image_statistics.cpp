@@ -0,0 +1,242 @@
+#include "image_statistics.h"
+
+#include "image.h"
+#include "reduction.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+using uwmf::image_moments;
+using uwmf::image_pair_moments;
+
+#if defined(__SSE2__)
+
+// the 32 bit lanes summing squares and products of up to 255 * 255 take
+// at most this many pixels before they could overflow
+constexpr std::size_t block_size = 65536;
+
+std::uint64_t sum_lanes64(const __m128i v)
+{
+    alignas(16) std::uint64_t lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), v);
+    return lanes[0] + lanes[1];
+}
+
+std::uint64_t sum_lanes32(const __m128i v)
+{
+    alignas(16) std::uint32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), v);
+    return std::uint64_t{lanes[0]} + lanes[1] + lanes[2] + lanes[3];
+}
+
+// sum of the products of the 16 pixel pairs of a and b in 32 bit lanes
+__m128i products(const __m128i a, const __m128i b)
+{
+    const __m128i zero = _mm_setzero_si128();
+    return _mm_add_epi32(
+            _mm_madd_epi16(_mm_unpacklo_epi8(a, zero),
+                    _mm_unpacklo_epi8(b, zero)),
+            _mm_madd_epi16(_mm_unpackhi_epi8(a, zero),
+                    _mm_unpackhi_epi8(b, zero)));
+}
+
+#endif
+
+void accumulate(const unsigned char* pixels, const std::size_t count,
+        image_moments& m)
+{
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    // sums of absolute differences add up 8 pixels into a 64 bit lane,
+    // matches count as 255 each
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi8(-1);
+    __m128i sum = zero;
+    __m128i salt = zero;
+    __m128i pepper = zero;
+    while(count - i >= 16) {
+        const std::size_t end = i + std::min(block_size, (count - i) & ~15);
+        __m128i squares = zero;
+        for(; i < end; i += 16) {
+            const __m128i v = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(pixels + i));
+            sum = _mm_add_epi64(sum, _mm_sad_epu8(v, zero));
+            squares = _mm_add_epi32(squares, products(v, v));
+            salt = _mm_add_epi64(salt,
+                    _mm_sad_epu8(_mm_cmpeq_epi8(v, zero), zero));
+            pepper = _mm_add_epi64(pepper,
+                    _mm_sad_epu8(_mm_cmpeq_epi8(v, max), zero));
+        }
+        m.sum_squares += sum_lanes32(squares);
+    }
+    m.sum += sum_lanes64(sum);
+    m.salt += sum_lanes64(salt) / 255;
+    m.pepper += sum_lanes64(pepper) / 255;
+#endif
+
+    for(; i < count; i++) {
+        const std::uint64_t value = pixels[i];
+        m.sum += value;
+        m.sum_squares += value * value;
+        m.salt += value == 0;
+        m.pepper += value == 255;
+    }
+    m.count += count;
+}
+
+void accumulate(const unsigned char* pixels1, const unsigned char* pixels2,
+        const std::size_t count, image_pair_moments& m)
+{
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum1 = zero;
+    __m128i sum2 = zero;
+    while(count - i >= 16) {
+        const std::size_t end = i + std::min(block_size, (count - i) & ~15);
+        __m128i squares1 = zero;
+        __m128i squares2 = zero;
+        __m128i cross = zero;
+        for(; i < end; i += 16) {
+            const __m128i v1 = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(pixels1 + i));
+            const __m128i v2 = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(pixels2 + i));
+            sum1 = _mm_add_epi64(sum1, _mm_sad_epu8(v1, zero));
+            sum2 = _mm_add_epi64(sum2, _mm_sad_epu8(v2, zero));
+            squares1 = _mm_add_epi32(squares1, products(v1, v1));
+            squares2 = _mm_add_epi32(squares2, products(v2, v2));
+            cross = _mm_add_epi32(cross, products(v1, v2));
+        }
+        m.sum_squares1 += sum_lanes32(squares1);
+        m.sum_squares2 += sum_lanes32(squares2);
+        m.sum_products += sum_lanes32(cross);
+    }
+    m.sum1 += sum_lanes64(sum1);
+    m.sum2 += sum_lanes64(sum2);
+#endif
+
+    for(; i < count; i++) {
+        const std::uint64_t value1 = pixels1[i];
+        const std::uint64_t value2 = pixels2[i];
+        m.sum1 += value1;
+        m.sum2 += value2;
+        m.sum_squares1 += value1 * value1;
+        m.sum_squares2 += value2 * value2;
+        m.sum_products += value1 * value2;
+    }
+    m.count += count;
+}
+
+} // anonymous
+
+namespace uwmf
+{
+
+image_moments& image_moments::operator+=(const image_moments& other)
+{
+    count += other.count;
+    sum += other.sum;
+    sum_squares += other.sum_squares;
+    salt += other.salt;
+    pepper += other.pepper;
+    return *this;
+}
+
+double image_moments::mean() const
+{
+    return static_cast<double>(sum) / count;
+}
+
+double image_moments::variance(const double center) const
+{
+    // sum of (x - center)^2, expanded around the exact sums
+    return (static_cast<double>(sum_squares) - 2 * center * sum) / count
+            + center * center;
+}
+
+image_pair_moments& image_pair_moments::operator+=(
+        const image_pair_moments& other)
+{
+    count += other.count;
+    sum1 += other.sum1;
+    sum2 += other.sum2;
+    sum_squares1 += other.sum_squares1;
+    sum_squares2 += other.sum_squares2;
+    sum_products += other.sum_products;
+    return *this;
+}
+
+double image_pair_moments::covariance(const double center1,
+        const double center2) const
+{
+    return (static_cast<double>(sum_products) - center2 * sum1
+            - center1 * sum2) / count + center1 * center2;
+}
+
+image_moments compute_moments(const monochrome_image& image,
+        const std::size_t threads)
+{
+    TRACE_SCOPE("moments");
+    const std::size_t width = image.width();
+    const auto* pixels = image.data().data();
+    return reduce_rows<image_moments>(image.height(), threads,
+            [&] (const std::size_t y_begin, const std::size_t y_end)
+            {
+                image_moments m;
+                accumulate(pixels + y_begin * width,
+                        (y_end - y_begin) * width, m);
+                return m;
+            },
+            [] (image_moments& result, const image_moments& partial)
+            {
+                result += partial;
+            });
+}
+
+image_pair_moments compute_moments(const monochrome_image& image1,
+        const monochrome_image& image2, const std::size_t threads)
+{
+    TRACE_SCOPE("moments");
+    ASSERT(image1.width() == image2.width()
+            && image1.height() == image2.height(),
+            "image dimensions differ");
+
+    const std::size_t width = image1.width();
+    const auto* pixels1 = image1.data().data();
+    const auto* pixels2 = image2.data().data();
+    return reduce_rows<image_pair_moments>(image1.height(), threads,
+            [&] (const std::size_t y_begin, const std::size_t y_end)
+            {
+                image_pair_moments m;
+                accumulate(pixels1 + y_begin * width,
+                        pixels2 + y_begin * width,
+                        (y_end - y_begin) * width, m);
+                return m;
+            },
+            [] (image_pair_moments& result, const image_pair_moments& partial)
+            {
+                result += partial;
+            });
+}
+
+noise_estimate estimate_noise(const image_moments& moments)
+{
+    const std::uint64_t impulses = moments.salt + moments.pepper;
+    return {moments.count > 0
+                    ? static_cast<double>(impulses) / moments.count
+                    : 0,
+            impulses > 0
+                    ? static_cast<double>(moments.salt) / impulses
+                    : 0};
+}
+
+} // uwmf
@@ -0,0 +1,89 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "image.h"
+
+namespace uwmf
+{
+
+// exact sums over the pixels of an image, 8 bit pixels don't need floating
+// point accumulators
+struct image_moments
+{
+    std::uint64_t count = 0;
+    std::uint64_t sum = 0;
+    std::uint64_t sum_squares = 0;
+    std::uint64_t salt = 0;   // pixels at the minimum (corruption::SALT)
+    std::uint64_t pepper = 0; // pixels at the maximum
+
+    image_moments& operator+=(const image_moments& other);
+
+    double mean() const;
+
+    // mean of the squared distances from center, the variance if center is
+    // the mean
+    double variance(const double center) const;
+
+    double variance() const
+    {
+        return variance(mean());
+    }
+};
+
+// exact sums over the pixels two images of the same dimensions share
+struct image_pair_moments
+{
+    std::uint64_t count = 0;
+    std::uint64_t sum1 = 0;
+    std::uint64_t sum2 = 0;
+    std::uint64_t sum_squares1 = 0;
+    std::uint64_t sum_squares2 = 0;
+    std::uint64_t sum_products = 0;
+
+    image_pair_moments& operator+=(const image_pair_moments& other);
+
+    // the moments of one of the images, without the impulse counts
+    image_moments first() const
+    {
+        return {count, sum1, sum_squares1, 0, 0};
+    }
+
+    image_moments second() const
+    {
+        return {count, sum2, sum_squares2, 0, 0};
+    }
+
+    // mean of the products of the distances from the centers
+    double covariance(const double center1, const double center2) const;
+
+    // sum of the squared differences
+    std::uint64_t se() const
+    {
+        return sum_squares1 + sum_squares2 - 2 * sum_products;
+    }
+};
+
+// a single pass over the pixels, split into bands of rows across the
+// threads (see reduction.h) and evaluated 16 pixels at a time where SSE2 is
+// available. the results don't depend on the number of threads
+image_moments compute_moments(const monochrome_image& image,
+        const std::size_t threads = 1);
+image_pair_moments compute_moments(const monochrome_image& image1,
+        const monochrome_image& image2, const std::size_t threads = 1);
+
+struct noise_estimate
+{
+    double density;       // of fixed-valued impulses
+    double salt_fraction; // of the impulses, 0 without any
+};
+
+// fixed-valued impulses take the extreme values, which clean pixels of
+// natural images rarely do. this is what the naive detector flags, without
+// building its mask
+noise_estimate estimate_noise(const image_moments& moments);
+
+} // uwmf
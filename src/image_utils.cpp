@@ -1,16 +1,67 @@
 #include "image_utils.h"
 
 #include "image.h"
+#include "image_statistics.h"
 #include "math_utils.h"
+#include "trace.h"
 #include "utils.h"
 
 #include <cmath>
+#include <random>
+#include <utility>
+
+namespace
+{
+
+using uwmf::monochrome_image;
+
+// noise() draws from [0, 1), type() picks salt (0) or pepper (1)
+template<typename Noise, typename Type>
+monochrome_image fixed_valued_impulses(monochrome_image original,
+        const double density, Noise&& noise, Type&& type)
+{
+    TRACE_SCOPE("corrupt");
+    for(const auto& [x, y, pixel] : original) {
+        if(noise() < density) {
+            *pixel = type() == 0
+                    ? std::numeric_limits<monochrome_image::value_type>::max()
+                    : std::numeric_limits<monochrome_image::value_type>::min();
+        }
+    }
+
+    return original;
+}
+
+// noise() draws from [0, 1), value() any pixel value
+template<typename Noise, typename Value>
+monochrome_image random_valued_impulses(monochrome_image original,
+        const double density, Noise&& noise, Value&& value)
+{
+    TRACE_SCOPE("corrupt");
+    for(const auto& [x, y, pixel] : original) {
+        if(noise() < density) {
+            *pixel = value();
+        }
+    }
+
+    return original;
+}
+
+std::mt19937_64 seeded_generator(const std::uint64_t seed)
+{
+    std::seed_seq sequence{static_cast<std::uint32_t>(seed),
+            static_cast<std::uint32_t>(seed >> 32)};
+    return std::mt19937_64(sequence);
+}
+
+} // anonymous
 
 namespace uwmf
 {
 
 double psnr(const monochrome_image& original, const monochrome_image& restored)
 {
+    TRACE_SCOPE("psnr");
     constexpr auto max =
             std::numeric_limits<monochrome_image::value_type>::max();
     return 10 * std::log10((max * max) / mse(original, restored));
@@ -19,22 +70,26 @@ double psnr(const monochrome_image& original, const monochrome_image& restored)
 double ief(const monochrome_image& original, const monochrome_image& restored,
         const monochrome_image& corrupted)
 {
+    TRACE_SCOPE("ief");
     return se(corrupted, original) / se(restored, original);
 }
 
 double ssim(const monochrome_image& original, const monochrome_image& restored)
 {
+    TRACE_SCOPE("ssim");
     // stabilization constants
     constexpr auto max =
             std::numeric_limits<monochrome_image::value_type>::max();
     constexpr double c1 = (0.01 * max) * (0.01 * max);
     constexpr double c2 = (0.03 * max) * (0.03 * max);
 
-    const double mo = mean(original);
-    const double mr = mean(restored);
-    const double vo = variance(original, mo);
-    const double vr = variance(restored, mr);
-    const double covar = covariance(original, mo, restored, mr);
+    // a single pass over both images
+    const auto moments = compute_moments(original, restored);
+    const double mo = moments.first().mean();
+    const double mr = moments.second().mean();
+    const double vo = moments.first().variance(mo);
+    const double vr = moments.second().variance(mr);
+    const double covar = moments.covariance(mo, mr);
 
     return ((2 * mo * mr + c1) * (2 * covar + c2))
             / ((mo * mo + mr * mr + c1) * (vo + vr + c2));
@@ -44,16 +99,43 @@ monochrome_image fvin(monochrome_image original, const double density)
 {
     random<double> noise(0, 1);
     random<int> type(0, 1);
+    return fixed_valued_impulses(std::move(original), density,
+            [&noise] { return noise.generate(); },
+            [&type] { return type.generate(); });
+}
 
-    for(const auto& [x, y, pixel] : original) {
-        if(noise.generate() < density) {
-            *pixel = type.generate() == 0
-                    ? std::numeric_limits<monochrome_image::value_type>::max()
-                    : std::numeric_limits<monochrome_image::value_type>::min();
-        }
-    }
+monochrome_image rvin(monochrome_image original, const double density)
+{
+    random<double> noise(0, 1);
+    random<int> value(std::numeric_limits<monochrome_image::value_type>::min(),
+            std::numeric_limits<monochrome_image::value_type>::max());
+    return random_valued_impulses(std::move(original), density,
+            [&noise] { return noise.generate(); },
+            [&value] { return value.generate(); });
+}
 
-    return original;
+monochrome_image fvin(monochrome_image original, const double density,
+        const std::uint64_t seed)
+{
+    auto generator = seeded_generator(seed);
+    std::uniform_real_distribution<double> noise(0, 1);
+    std::uniform_int_distribution<int> type(0, 1);
+    return fixed_valued_impulses(std::move(original), density,
+            [&] { return noise(generator); },
+            [&] { return type(generator); });
+}
+
+monochrome_image rvin(monochrome_image original, const double density,
+        const std::uint64_t seed)
+{
+    auto generator = seeded_generator(seed);
+    std::uniform_real_distribution<double> noise(0, 1);
+    std::uniform_int_distribution<int> value(
+            std::numeric_limits<monochrome_image::value_type>::min(),
+            std::numeric_limits<monochrome_image::value_type>::max());
+    return random_valued_impulses(std::move(original), density,
+            [&] { return noise(generator); },
+            [&] { return value(generator); });
 }
 
 } // uwmf
@@ -3,10 +3,11 @@
 #pragma once
 
 #include "image.h"
+#include "noise_detectors.h"
 #include "utils.h"
 
+#include <cstdint>
 #include <limits>
-#include <utility>
 
 namespace uwmf
 {
@@ -16,32 +17,12 @@ double ief(const monochrome_image& original, const monochrome_image& restored,
         const monochrome_image& corrupted);
 double ssim(const monochrome_image& original, const monochrome_image& restored);
 monochrome_image fvin(monochrome_image original, const double density);
+monochrome_image rvin(monochrome_image original, const double density);
 
-
-// Naive Noise Detection
-// pixel with extreme values are considered corrupted
-
-enum corruption
-{
-    SALT = 0,
-    PEPPER = 1,
-    NONE
-};
-
-inline std::pair<bool, corruption> naive_noise_detector(
-        monochrome_image::value_type pixel)
-{
-    using value_type = monochrome_image::value_type;
-    constexpr auto min = std::numeric_limits<value_type>::min();
-    constexpr auto max = std::numeric_limits<value_type>::max();
-    const bool salt = pixel == min;
-    const bool pepper = pixel == max;
-    const corruption type = salt
-            ? corruption::SALT
-            : pepper ? corruption::PEPPER : corruption::NONE;
-    return {salt || pepper, type};
-}
-
-using noise_detector = decltype(naive_noise_detector);
+// the same corruption for the same seed
+monochrome_image fvin(monochrome_image original, const double density,
+        const std::uint64_t seed);
+monochrome_image rvin(monochrome_image original, const double density,
+        const std::uint64_t seed);
 
 } // uwmf
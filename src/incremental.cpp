@@ -0,0 +1,11 @@
+#include "incremental.h"
+
+#include "noise_detectors.h"
+
+namespace uwmf
+{
+
+template class incremental_restorer<naive_noise_detector>;
+template class incremental_restorer<road_noise_detector>;
+
+} // uwmf
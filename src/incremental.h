@@ -0,0 +1,89 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "image.h"
+#include "noise_detectors.h"
+#include "utils.h"
+#include "uwmf.h"
+
+namespace uwmf
+{
+
+// keeps a corrupted image together with its noise mask and restoration,
+// so that after editing parts of the corrupted image only the edited areas
+// and the pixels depending on them have to be detected and restored again
+template<typename Detector>
+class incremental_restorer
+{
+public:
+    incremental_restorer(monochrome_image corrupted_image,
+            const Detector& detector, const uwmf_parameters parameters)
+        : corrupted_image_(std::move(corrupted_image))
+        , detector_(detector)
+        , filter_(parameters)
+    {
+        detect_noise(corrupted_image_, detector_, mask_);
+        filter_.restore_with_mask(corrupted_image_, mask_, restored_image_);
+    }
+
+    DELETE_COPY_AND_ASSIGN(incremental_restorer);
+
+    const monochrome_image& corrupted_image() const
+    {
+        return corrupted_image_;
+    }
+
+    // edits made through here have to be announced through update()
+    monochrome_image& corrupted_image()
+    {
+        return corrupted_image_;
+    }
+
+    const noise_mask& mask() const
+    {
+        return mask_;
+    }
+
+    const monochrome_image& restored_image() const
+    {
+        return restored_image_;
+    }
+
+    void update(const std::vector<rect>& changed)
+    {
+        const std::size_t width = corrupted_image_.width();
+        const std::size_t height = corrupted_image_.height();
+
+        // detection results change up to the detector's halo away from an
+        // edit, restored pixels up to another context margin away from that
+        for(const auto& region: changed) {
+            detector_.detect_region(corrupted_image_,
+                    grow(region, Detector::halo, width, height), mask_);
+        }
+
+        const std::size_t margin = Detector::halo + filter_.context_margin();
+        for(const auto& region: changed) {
+            filter_.restore_region(corrupted_image_, mask_,
+                    grow(region, margin, width, height), restored_image_);
+        }
+    }
+
+private:
+    monochrome_image corrupted_image_;
+    const Detector detector_;
+    uwmf_filter filter_;
+    noise_mask mask_;
+    monochrome_image restored_image_;
+};
+
+// instantiated once for every detector in incremental.cpp, which also keeps
+// the class compiling while the tree has no other user
+extern template class incremental_restorer<naive_noise_detector>;
+extern template class incremental_restorer<road_noise_detector>;
+
+} // uwmf
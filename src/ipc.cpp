@@ -0,0 +1,366 @@
+#include "ipc.h"
+
+#include "logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+
+// shared buffers keep their size for as long as they are mapped
+constexpr int size_seals = F_SEAL_SHRINK | F_SEAL_GROW;
+
+std::optional<sockaddr_un> to_address(const std::string& path)
+{
+    sockaddr_un address{};
+    if(path.size() >= sizeof(address.sun_path)) {
+        LOGE() << "socket path too long: " << path;
+        return std::nullopt;
+    }
+
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    return address;
+}
+
+} // anonymous
+
+namespace uwmf
+{
+
+unix_socket::unix_socket()
+    : fd_(-1)
+{
+}
+
+unix_socket::unix_socket(int fd)
+    : fd_(fd)
+{
+}
+
+unix_socket::unix_socket(unix_socket&& other)
+    : fd_(std::exchange(other.fd_, -1))
+{
+}
+
+unix_socket& unix_socket::operator=(unix_socket&& other)
+{
+    if(this != &other) {
+        if(fd_ != -1) {
+            ::close(fd_);
+        }
+        fd_ = std::exchange(other.fd_, -1);
+    }
+    return *this;
+}
+
+unix_socket::~unix_socket()
+{
+    if(fd_ != -1) {
+        ::close(fd_);
+    }
+}
+
+std::optional<unix_socket> unix_socket::listen(const std::string& path,
+        const int backlog)
+{
+    auto address = to_address(path);
+    if(!address) {
+        return std::nullopt;
+    }
+
+    unix_socket sock(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    if(sock.fd_ == -1) {
+        LOGE() << "failed to create socket: " << std::strerror(errno);
+        return std::nullopt;
+    }
+
+    ::unlink(path.c_str());
+    if(::bind(sock.fd_, reinterpret_cast<const sockaddr*>(&*address),
+                    sizeof(*address)) == -1) {
+        LOGE() << "failed to bind " << path << ": " << std::strerror(errno);
+        return std::nullopt;
+    }
+
+    if(::listen(sock.fd_, backlog) == -1) {
+        LOGE() << "failed to listen on " << path << ": "
+                << std::strerror(errno);
+        return std::nullopt;
+    }
+
+    return sock;
+}
+
+std::optional<unix_socket> unix_socket::connect(const std::string& path)
+{
+    auto address = to_address(path);
+    if(!address) {
+        return std::nullopt;
+    }
+
+    unix_socket sock(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    if(sock.fd_ == -1) {
+        LOGE() << "failed to create socket: " << std::strerror(errno);
+        return std::nullopt;
+    }
+
+    if(::connect(sock.fd_, reinterpret_cast<const sockaddr*>(&*address),
+                    sizeof(*address)) == -1) {
+        LOGE() << "failed to connect to " << path << ": "
+                << std::strerror(errno);
+        return std::nullopt;
+    }
+
+    return sock;
+}
+
+std::optional<unix_socket> unix_socket::accept() const
+{
+    const int fd = ::accept4(fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if(fd == -1) {
+        LOGE() << "failed to accept connection: " << std::strerror(errno);
+        return std::nullopt;
+    }
+
+    return unix_socket(fd);
+}
+
+bool unix_socket::send(const void* data, const std::size_t size,
+        const int fd) const
+{
+    const auto* bytes = static_cast<const char*>(data);
+    std::size_t sent = 0;
+
+    while(sent < size) {
+        iovec iov{const_cast<char*>(bytes + sent), size - sent};
+        msghdr message{};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+        if(fd != -1 && sent == 0) {
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            cmsghdr* header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+        }
+
+        const ssize_t result = ::sendmsg(fd_, &message, MSG_NOSIGNAL);
+        if(result == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        sent += result;
+    }
+
+    return true;
+}
+
+bool unix_socket::receive(void* data, const std::size_t size,
+        int* passed_fd) const
+{
+    auto* bytes = static_cast<char*>(data);
+    std::size_t received = 0;
+
+    if(passed_fd) {
+        *passed_fd = -1;
+    }
+
+    while(received < size) {
+        iovec iov{bytes + received, size - received};
+        msghdr message{};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        const ssize_t result = ::recvmsg(fd_, &message, MSG_CMSG_CLOEXEC);
+        if(result == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        else if(result == 0) {
+            return false;
+        }
+
+        for(cmsghdr* header = CMSG_FIRSTHDR(&message); header;
+                header = CMSG_NXTHDR(&message, header)) {
+            if(header->cmsg_level != SOL_SOCKET
+                    || header->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+
+            int fd;
+            std::memcpy(&fd, CMSG_DATA(header), sizeof(int));
+            if(passed_fd && *passed_fd == -1) {
+                *passed_fd = fd;
+            }
+            else {
+                ::close(fd);
+            }
+        }
+        received += result;
+    }
+
+    return true;
+}
+
+bool unix_socket::receive_available(void* data, const std::size_t size,
+        std::size_t& received, int& passed_fd) const
+{
+    auto* bytes = static_cast<char*>(data);
+    while(received < size) {
+        iovec iov{bytes + received, size - received};
+        msghdr message{};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        const ssize_t result =
+                ::recvmsg(fd_, &message, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+        if(result == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        else if(result == 0) {
+            return false;
+        }
+
+        for(cmsghdr* header = CMSG_FIRSTHDR(&message); header;
+                header = CMSG_NXTHDR(&message, header)) {
+            if(header->cmsg_level != SOL_SOCKET
+                    || header->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+
+            int fd;
+            std::memcpy(&fd, CMSG_DATA(header), sizeof(int));
+            if(passed_fd == -1) {
+                passed_fd = fd;
+            }
+            else {
+                ::close(fd);
+            }
+        }
+        received += result;
+    }
+
+    return true;
+}
+
+shared_buffer::shared_buffer(int fd, unsigned char* data, std::size_t size)
+    : fd_(fd)
+    , data_(data)
+    , size_(size)
+{
+}
+
+shared_buffer::shared_buffer(shared_buffer&& other)
+    : fd_(std::exchange(other.fd_, -1))
+    , data_(std::exchange(other.data_, nullptr))
+    , size_(std::exchange(other.size_, 0))
+{
+}
+
+shared_buffer& shared_buffer::operator=(shared_buffer&& other)
+{
+    if(this != &other) {
+        release();
+        fd_ = std::exchange(other.fd_, -1);
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+shared_buffer::~shared_buffer()
+{
+    release();
+}
+
+void shared_buffer::release()
+{
+    if(data_) {
+        ::munmap(data_, size_);
+    }
+
+    if(fd_ != -1) {
+        ::close(fd_);
+    }
+}
+
+std::optional<shared_buffer> shared_buffer::create(const std::size_t size)
+{
+    const int fd = ::memfd_create("uwmf", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if(fd == -1) {
+        LOGE() << "failed to create memfd: " << std::strerror(errno);
+        return std::nullopt;
+    }
+
+    if(::ftruncate(fd, size) == -1) {
+        LOGE() << "failed to resize memfd: " << std::strerror(errno);
+        ::close(fd);
+        return std::nullopt;
+    }
+
+    if(::fcntl(fd, F_ADD_SEALS, size_seals) == -1) {
+        LOGE() << "failed to seal memfd: " << std::strerror(errno);
+        ::close(fd);
+        return std::nullopt;
+    }
+
+    return map(fd);
+}
+
+std::optional<shared_buffer> shared_buffer::map(const int fd)
+{
+    const int seals = ::fcntl(fd, F_GET_SEALS);
+    if(seals == -1 || (seals & size_seals) != size_seals) {
+        LOGE() << "shared buffer is not sealed against resizing";
+        ::close(fd);
+        return std::nullopt;
+    }
+
+    struct stat status{};
+    if(::fstat(fd, &status) == -1 || status.st_size <= 0) {
+        LOGE() << "invalid shared buffer";
+        ::close(fd);
+        return std::nullopt;
+    }
+
+    const std::size_t size = status.st_size;
+    void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+            fd, 0);
+    if(data == MAP_FAILED) {
+        LOGE() << "failed to map shared buffer: " << std::strerror(errno);
+        ::close(fd);
+        return std::nullopt;
+    }
+
+    return shared_buffer(fd, static_cast<unsigned char*>(data), size);
+}
+
+} // uwmf
@@ -0,0 +1,103 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+
+#include "utils.h"
+
+namespace uwmf
+{
+
+// owning wrapper around a unix domain stream socket
+class unix_socket
+{
+public:
+    unix_socket();
+    explicit unix_socket(int fd);
+    unix_socket(unix_socket&& other);
+    unix_socket& operator=(unix_socket&& other);
+    ~unix_socket();
+
+    DELETE_COPY_AND_ASSIGN(unix_socket);
+
+    static std::optional<unix_socket> listen(const std::string& path,
+            const int backlog);
+    static std::optional<unix_socket> connect(const std::string& path);
+
+    std::optional<unix_socket> accept() const;
+
+    // fd, if valid, is passed to the peer along with the first byte
+    bool send(const void* data, const std::size_t size,
+            const int fd = -1) const;
+
+    // returns false on error or when the peer closed the connection. if
+    // passed_fd is not null, it receives the file descriptor that came with
+    // the message (or -1 if there was none)
+    bool receive(void* data, const std::size_t size,
+            int* passed_fd = nullptr) const;
+
+    // reads whatever has arrived of a message of size bytes, without
+    // blocking, and adds it to received. the file descriptor that came with
+    // the message, if any, ends up in passed_fd, which must be -1 before the
+    // first byte. returns false on error or when the peer closed the
+    // connection
+    bool receive_available(void* data, const std::size_t size,
+            std::size_t& received, int& passed_fd) const;
+
+    int fd() const
+    {
+        return fd_;
+    }
+
+private:
+    int fd_;
+};
+
+// memory mapped anonymous file that can be shared between processes by
+// passing its file descriptor over a unix_socket. its size is sealed, a
+// peer that truncated it would make the other side fault (SIGBUS) on
+// accessing the mapping
+class shared_buffer
+{
+public:
+    shared_buffer(shared_buffer&& other);
+    shared_buffer& operator=(shared_buffer&& other);
+    ~shared_buffer();
+
+    DELETE_COPY_AND_ASSIGN(shared_buffer);
+
+    static std::optional<shared_buffer> create(const std::size_t size);
+
+    // takes ownership of fd, which must be sealed against shrinking and
+    // growing like the buffers of create()
+    static std::optional<shared_buffer> map(const int fd);
+
+    unsigned char* data() const
+    {
+        return data_;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    int fd() const
+    {
+        return fd_;
+    }
+
+private:
+    shared_buffer(int fd, unsigned char* data, std::size_t size);
+
+    void release();
+
+    int fd_;
+    unsigned char* data_;
+    std::size_t size_;
+};
+
+} // uwmf
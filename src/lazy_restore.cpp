@@ -0,0 +1,275 @@
+#include "lazy_restore.h"
+
+#include "image.h"
+#include "noise_detectors.h"
+#include "tiled_file.h"
+#include "trace.h"
+#include "utils.h"
+#include "uwmf.h"
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+namespace uwmf
+{
+
+lazy_restored_image::lazy_restored_image(monochrome_image corrupted_image,
+        const uwmf_parameters& parameters,
+        const lazy_restore_options& options)
+    : lazy_restored_image(corrupted_image.width(), corrupted_image.height(),
+            parameters, options)
+{
+    corrupted_image_ = std::move(corrupted_image);
+    start_prefetching();
+}
+
+std::unique_ptr<lazy_restored_image> lazy_restored_image::open(
+        const std::string& tiled_file, const uwmf_parameters& parameters,
+        const lazy_restore_options& options)
+{
+    auto reader = tiled_file_reader::open(tiled_file);
+    if(!reader) {
+        return nullptr;
+    }
+
+    std::unique_ptr<lazy_restored_image> image(new lazy_restored_image(
+            reader->width(), reader->height(), parameters, options));
+    image->reader_ = std::move(reader);
+    image->start_prefetching();
+    return image;
+}
+
+lazy_restored_image::lazy_restored_image(const std::size_t width,
+        const std::size_t height, const uwmf_parameters& parameters,
+        const lazy_restore_options& options)
+    : parameters_(parameters)
+    , options_(options)
+    , width_(width)
+    , height_(height)
+    , filter_(parameters, options.engine)
+{
+    ASSERT(options_.tile_size > 0 && options_.cache_tiles > 0,
+            "tiles and the cache must not be empty");
+
+    columns_ = (width_ + options_.tile_size - 1) / options_.tile_size;
+    rows_ = (height_ + options_.tile_size - 1) / options_.tile_size;
+    // the mask is only exact away from the border of the context
+    const std::size_t halo = visit_detector(options_.detector,
+            [] (const auto& d)
+            {
+                return static_cast<std::size_t>(
+                        std::decay_t<decltype(d)>::halo);
+            });
+    reach_ = filter_.context_margin() + halo;
+}
+
+lazy_restored_image::~lazy_restored_image()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        prefetch_queue_.clear();
+    }
+    prefetch_wanted_.notify_all();
+    for(auto& prefetcher: prefetchers_) {
+        prefetcher.join();
+    }
+}
+
+bool lazy_restored_image::read_region(const rect& region,
+        monochrome_image& image)
+{
+    ASSERT(region.x + region.width <= width_
+            && region.y + region.height <= height_,
+            "region out of bounds");
+
+    std::lock_guard<std::mutex> read_lock(read_mutex_);
+    image.resize(region.width, region.height);
+    if(region.width == 0 || region.height == 0) {
+        return true;
+    }
+
+    const std::size_t tile_size = options_.tile_size;
+    for(std::size_t ty = region.y / tile_size;
+            ty <= (region.y + region.height - 1) / tile_size; ty++) {
+        for(std::size_t tx = region.x / tile_size;
+                tx <= (region.x + region.width - 1) / tile_size; tx++) {
+            const std::size_t tile = ty * columns_ + tx;
+            const tile_ptr pixels = get_tile(tile);
+            if(!pixels) {
+                return false;
+            }
+
+            const rect r = tile_region(tile);
+            const std::size_t x = std::max(r.x, region.x);
+            const std::size_t y = std::max(r.y, region.y);
+            const std::size_t x_end =
+                    std::min(r.x + r.width, region.x + region.width);
+            const std::size_t y_end =
+                    std::min(r.y + r.height, region.y + region.height);
+            paste(*pixels, {x - r.x, y - r.y, x_end - x, y_end - y}, image,
+                    x - region.x, y - region.y);
+        }
+    }
+
+    prefetch_around(region);
+    return true;
+}
+
+lazy_restored_image::statistics lazy_restored_image::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void lazy_restored_image::start_prefetching()
+{
+    for(std::size_t i = 0; i < options_.prefetch_threads; i++) {
+        prefetchers_.emplace_back([this] { prefetch_loop(); });
+    }
+}
+
+rect lazy_restored_image::tile_region(const std::size_t tile) const
+{
+    const std::size_t x = (tile % columns_) * options_.tile_size;
+    const std::size_t y = (tile / columns_) * options_.tile_size;
+    return {x, y, std::min(options_.tile_size, width_ - x),
+            std::min(options_.tile_size, height_ - y)};
+}
+
+lazy_restored_image::tile_ptr lazy_restored_image::get_tile(
+        const std::size_t tile)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool waited = false;
+    while(in_flight_.count(tile) != 0) {
+        waited = true; // being prefetched
+        restored_.wait(lock);
+    }
+
+    const auto it = index_.find(tile);
+    if(it != index_.end()) {
+        cache_.splice(cache_.begin(), cache_, it->second);
+        if(waited) {
+            stats_.misses++;
+        }
+        else {
+            stats_.hits++;
+        }
+        return it->second->image;
+    }
+
+    stats_.misses++;
+    in_flight_.insert(tile);
+    lock.unlock();
+    tile_ptr image = restore_tile(tile, filter_);
+    lock.lock();
+    finish_tile(tile, image);
+    return image;
+}
+
+lazy_restored_image::tile_ptr lazy_restored_image::restore_tile(
+        const std::size_t tile, uwmf_filter& filter)
+{
+    TRACE_SCOPE("lazy tile", tile);
+    const rect region = tile_region(tile);
+    const rect context = grow(region, reach_, width_, height_);
+    monochrome_image corrupted;
+    if(reader_) {
+        if(!reader_->read_region(context, corrupted, 1)) {
+            return nullptr;
+        }
+    }
+    else {
+        crop(corrupted_image_, context, corrupted);
+    }
+
+    const rect inner = {region.x - context.x, region.y - context.y,
+            region.width, region.height};
+    monochrome_image restored(corrupted.width(), corrupted.height());
+    visit_detector(options_.detector,
+            [&] (const auto& detector)
+            {
+                filter.restore_region(corrupted,
+                        detect_noise(corrupted, detector), inner, restored);
+            });
+    return std::make_shared<const monochrome_image>(crop(restored, inner));
+}
+
+void lazy_restored_image::finish_tile(const std::size_t tile, tile_ptr image)
+{
+    in_flight_.erase(tile);
+    if(image) {
+        stats_.restored++;
+        cache_.push_front({tile, std::move(image)});
+        index_[tile] = cache_.begin();
+        while(cache_.size() > options_.cache_tiles) {
+            index_.erase(cache_.back().tile);
+            cache_.pop_back();
+        }
+    }
+    restored_.notify_all();
+}
+
+void lazy_restored_image::prefetch_around(const rect& region)
+{
+    if(prefetchers_.empty()) {
+        return;
+    }
+
+    // the ring of tiles around those of region, as far as the cache holds
+    // them next to region's
+    const std::size_t tile_size = options_.tile_size;
+    const std::size_t tx0 = region.x / tile_size;
+    const std::size_t ty0 = region.y / tile_size;
+    const std::size_t tx1 = (region.x + region.width - 1) / tile_size;
+    const std::size_t ty1 = (region.y + region.height - 1) / tile_size;
+    const std::size_t visible = (tx1 - tx0 + 1) * (ty1 - ty0 + 1);
+    std::deque<std::size_t> ring;
+    for(std::size_t ty = ty0 > 0 ? ty0 - 1 : 0;
+            ty <= std::min(ty1 + 1, rows_ - 1); ty++) {
+        for(std::size_t tx = tx0 > 0 ? tx0 - 1 : 0;
+                tx <= std::min(tx1 + 1, columns_ - 1); tx++) {
+            if(tx < tx0 || tx > tx1 || ty < ty0 || ty > ty1) {
+                ring.push_back(ty * columns_ + tx);
+            }
+        }
+    }
+    ring.resize(std::min(ring.size(), options_.cache_tiles > visible
+            ? options_.cache_tiles - visible
+            : 0));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        prefetch_queue_ = std::move(ring);
+    }
+    prefetch_wanted_.notify_all();
+}
+
+void lazy_restored_image::prefetch_loop()
+{
+    uwmf_filter filter(parameters_, options_.engine);
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(true) {
+        prefetch_wanted_.wait(lock,
+                [this] { return stopping_ || !prefetch_queue_.empty(); });
+        if(stopping_) {
+            return;
+        }
+
+        const std::size_t tile = prefetch_queue_.front();
+        prefetch_queue_.pop_front();
+        if(index_.count(tile) != 0 || in_flight_.count(tile) != 0) {
+            continue;
+        }
+
+        in_flight_.insert(tile);
+        lock.unlock();
+        tile_ptr image = restore_tile(tile, filter);
+        lock.lock();
+        finish_tile(tile, std::move(image));
+    }
+}
+
+} // uwmf
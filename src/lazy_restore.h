@@ -0,0 +1,151 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "image.h"
+#include "noise_detectors.h"
+#include "tiled_file.h"
+#include "utils.h"
+#include "uwmf.h"
+
+namespace uwmf
+{
+
+struct lazy_restore_options
+{
+    engine_type engine = engine_type::AUTO;
+    detector_options detector = {detector_type::NAIVE,
+            road_noise_detector::default_threshold};
+    std::size_t tile_size = 256;
+    std::size_t cache_tiles = 64; // restored tiles kept
+    std::size_t prefetch_threads = 1; // none disables prefetching
+};
+
+// Restored image of a corrupted one that is only restored where it is
+// read, for viewers that show a small part of a large scan. The image is
+// divided into square tiles, every tile is restored on first access from
+// a context that covers the pixels it depends on (the reach of the filter
+// and of the detector, see restore_tiled_file()), so the pixels are the
+// same as those of a full restoration. Restored tiles are kept in a cache
+// of bounded size, the least recently used ones are evicted first. After
+// every read the tiles around the region are restored in the background,
+// so that panning finds them ready. Safe to read from several threads.
+class lazy_restored_image
+{
+public:
+    lazy_restored_image(monochrome_image corrupted_image,
+            const uwmf_parameters& parameters,
+            const lazy_restore_options& options);
+
+    // tiles of the file are only decoded when the contexts of restored
+    // tiles need them. returns nullptr if the file can't be read
+    static std::unique_ptr<lazy_restored_image> open(
+            const std::string& tiled_file, const uwmf_parameters& parameters,
+            const lazy_restore_options& options);
+
+    // waits for the tile being prefetched, drops the others
+    ~lazy_restored_image();
+
+    DELETE_COPY_AND_ASSIGN(lazy_restored_image);
+
+    std::size_t width() const
+    {
+        return width_;
+    }
+
+    std::size_t height() const
+    {
+        return height_;
+    }
+
+    // restores the tiles overlapping region that aren't cached and copies
+    // region into image, which is resized to it. the tiles around region
+    // are prefetched afterwards, replacing earlier prefetches that haven't
+    // started yet. fails if the tiled file can't be read
+    bool read_region(const rect& region, monochrome_image& image);
+
+    struct statistics
+    {
+        std::uint64_t hits;     // tiles read from the cache
+        std::uint64_t misses;   // tiles read before they were restored
+        std::uint64_t restored; // tiles restored, including prefetches
+    };
+
+    statistics stats() const;
+
+private:
+    using tile_ptr = std::shared_ptr<const monochrome_image>;
+
+    struct cache_entry
+    {
+        std::size_t tile;
+        tile_ptr image;
+    };
+
+    lazy_restored_image(const std::size_t width, const std::size_t height,
+            const uwmf_parameters& parameters,
+            const lazy_restore_options& options);
+
+    void start_prefetching();
+
+    rect tile_region(const std::size_t tile) const;
+
+    // the tile from the cache, restored with filter_ if it isn't cached
+    // and nobody else is restoring it. nullptr if reading the context
+    // failed
+    tile_ptr get_tile(const std::size_t tile);
+
+    // nullptr if reading the context failed
+    tile_ptr restore_tile(const std::size_t tile, uwmf_filter& filter);
+
+    // caches the tile of a restoration started with in_flight_, with
+    // mutex_ held
+    void finish_tile(const std::size_t tile, tile_ptr image);
+
+    void prefetch_around(const rect& region);
+    void prefetch_loop();
+
+    uwmf_parameters parameters_;
+    lazy_restore_options options_;
+    std::size_t width_;
+    std::size_t height_;
+    std::size_t columns_;
+    std::size_t rows_;
+    std::size_t reach_; // of the filter and the detector
+    // one of them is the source
+    monochrome_image corrupted_image_;
+    std::optional<tiled_file_reader> reader_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable restored_;
+    // tiles are ordered from the most to the least recently used
+    std::list<cache_entry> cache_;
+    std::unordered_map<std::size_t, std::list<cache_entry>::iterator> index_;
+    std::unordered_set<std::size_t> in_flight_;
+    statistics stats_{};
+
+    // calls of read_region() are serialized, they share the filter
+    std::mutex read_mutex_;
+    uwmf_filter filter_;
+
+    std::condition_variable prefetch_wanted_;
+    std::deque<std::size_t> prefetch_queue_;
+    bool stopping_ = false;
+    std::vector<std::thread> prefetchers_;
+};
+
+} // uwmf
@@ -1,17 +1,45 @@
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
 #include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
 #include <ostream>
 #include <optional>
+#include <sstream>
 #include <string>
 #include <sys/types.h>
+#include <utility>
 
+#include "batch.h"
 #include "image.h"
+#include "image_statistics.h"
 #include "image_utils.h"
+#include "lazy_restore.h"
 #include "logger.h"
 #include "math_utils.h"
+#include "median_filters.h"
+#include "multi_window.h"
+#include "planner.h"
 #include "png_image.h"
+#include "result_cache.h"
+#include "results_store.h"
+#include "stream.h"
+#include "sweep.h"
+#include "thread_pool.h"
+#include "tiled_file.h"
+#include "trace.h"
+#include "tuner.h"
 #include "uwmf.h"
 
+#ifdef UWMF_WITH_SERVER
+#include "client.h"
+#include "server.h"
+#endif
+
 #include "../external/cxxopts/include/cxxopts.hpp"
 
 namespace
@@ -21,7 +49,15 @@ enum class mode
 {
     RESTORATION,
     CORRUPTION,
-    SIMULATION
+    SIMULATION,
+    SERVE,
+    CLIENT,
+    STREAM,
+    TUNE,
+    CONVERT,
+    SWEEP,
+    BATCH,
+    SUMMARISE
 };
 
 struct program_options
@@ -30,10 +66,43 @@ struct program_options
     int k;         // weight fall-off
     int p;         // Minkowski exponent
     int w;         // filtering window size
+    int passes;    // maximum number of restoration passes
     double d;      // corruption density
     int r;         // repeat counter
     std::string i; // input image
     std::string o; // output image
+    std::string s; // server socket
+    int t;         // worker threads
+    bool stats;    // query server statistics (client)
+    bool shutdown; // stop the server (client)
+    uwmf::detector_options detector; // noise detector
+    bool random_noise; // random-valued instead of fixed-valued impulses
+    bool in_place; // restore without a second image buffer
+    double psnr_ci; // target confidence interval half-width of the psnr
+    double ssim_ci; // target confidence interval half-width of the ssim
+    std::string table; // tuned parameter table
+    bool tiled;    // restore in tiled instead of row-major layout
+    int tile_size; // edge length of the tiles
+    uwmf::engine_type engine; // window evaluation
+    bool planned;  // engine and layout picked per image by the cost model
+    std::string model; // cost model file
+    bool calibrate; // measure the cost model
+    uwmf::algorithm_type algorithm; // the first of algorithms
+    std::vector<uwmf::algorithm_type> algorithms; // compared in simulations
+    int ibinr_p;   // Minkowski exponent of ibinr, euclidean unless given
+    std::optional<uwmf::rect> roi; // region to convert or restore
+    std::vector<uwmf::rect> panned_rois; // restored after roi, in order
+    uwmf::result_cache_options cache; // restored images, by input
+    std::string jobs; // sweep directory
+    bool plan;     // create the jobs of a sweep
+    bool work;     // run jobs of a sweep
+    bool merge;    // report the results of a sweep
+    uwmf::sweep_grid grid; // configurations of a sweep
+    int batch_size; // images restored per batch
+    std::vector<int> windows; // window sizes simulated in a single pass
+    std::string trace; // chrome trace output, no tracing if empty
+    std::string results; // store of completed cells, resumed from
+    std::uint64_t seed; // of the first corrupted copy, with results
 };
 
 std::optional<mode> to_mode(std::string str)
@@ -50,6 +119,30 @@ std::optional<mode> to_mode(std::string str)
     else if(str == "s" || str == "simulation") {
         return mode::SIMULATION;
     }
+    else if(str == "serve") {
+        return mode::SERVE;
+    }
+    else if(str == "client") {
+        return mode::CLIENT;
+    }
+    else if(str == "stream") {
+        return mode::STREAM;
+    }
+    else if(str == "tune") {
+        return mode::TUNE;
+    }
+    else if(str == "convert") {
+        return mode::CONVERT;
+    }
+    else if(str == "sweep") {
+        return mode::SWEEP;
+    }
+    else if(str == "batch") {
+        return mode::BATCH;
+    }
+    else if(str == "summarise") {
+        return mode::SUMMARISE;
+    }
 
     return std::nullopt;
 }
@@ -60,6 +153,14 @@ std::string to_string(mode m)
     case mode::RESTORATION: return "restoration"; break;
     case mode::CORRUPTION: return "corruption"; break;
     case mode::SIMULATION: return "simulation"; break;
+    case mode::SERVE: return "serve"; break;
+    case mode::CLIENT: return "client"; break;
+    case mode::STREAM: return "stream"; break;
+    case mode::TUNE: return "tune"; break;
+    case mode::CONVERT: return "convert"; break;
+    case mode::SWEEP: return "sweep"; break;
+    case mode::BATCH: return "batch"; break;
+    case mode::SUMMARISE: return "summarise"; break;
     default: ASSERT(false, "invalid mode"); break;
     }
 
@@ -70,18 +171,116 @@ std::ostream& operator<<(std::ostream& out, const program_options& opts)
 {
     out << "\n";
     out << "    m = " << to_string(opts.m) << "\n";
-    if(opts.m == mode::SIMULATION) {
+    if(!opts.trace.empty()) {
+        out << "    trace = " << opts.trace << "\n";
+    }
+    if(opts.m == mode::SIMULATION || opts.m == mode::TUNE) {
         out << "    r = " << opts.r << "\n";
+        if(opts.psnr_ci > 0) {
+            out << "    psnr ci = " << opts.psnr_ci << "\n";
+        }
+        if(opts.ssim_ci > 0) {
+            out << "    ssim ci = " << opts.ssim_ci << "\n";
+        }
     }
 
-    if(opts.m == mode::RESTORATION || opts.m == mode::SIMULATION) {
+    if(opts.m == mode::RESTORATION || opts.m == mode::SIMULATION
+            || opts.m == mode::STREAM || opts.m == mode::BATCH) {
         out << "    k = " << opts.k << "\n";
         out << "    p = " << opts.p << "\n";
-        out << "    w = " << opts.w << "\n";
+        if(opts.m == mode::RESTORATION && opts.table.empty()
+                && opts.w == 0) {
+            out << "    w = estimated\n";
+        }
+        else if(opts.windows.empty()) {
+            out << "    w = " << opts.w << "\n";
+        }
+        else {
+            out << "    w =";
+            for(const int w: opts.windows) {
+                out << " " << w;
+            }
+            out << "\n";
+        }
+        out << "    passes = " << opts.passes << "\n";
+        if(opts.tiled) {
+            out << "    tile size = " << opts.tile_size << "\n";
+        }
+        out << "    engine = "
+                << (opts.planned ? "plan" : to_string(opts.engine)) << "\n";
+        if(opts.planned) {
+            out << "    model = " << opts.model << "\n";
+        }
+        out << "    algorithm =";
+        for(const auto algorithm: opts.algorithms) {
+            out << " " << to_string(algorithm);
+        }
+        out << "\n";
+    }
+
+    if(opts.m == mode::RESTORATION || opts.m == mode::SIMULATION
+            || opts.m == mode::STREAM || opts.m == mode::BATCH) {
+        out << "    detector = " << to_string(opts.detector.type) << "\n";
+    }
+
+    if(!opts.table.empty()) {
+        out << "    table = " << opts.table << "\n";
     }
 
-    if(opts.m == mode::CORRUPTION || opts.m == mode::SIMULATION) {
+    if(opts.m == mode::RESTORATION && opts.roi) {
+        out << "    roi = " << *opts.roi << "\n";
+        for(const auto& region: opts.panned_rois) {
+            out << "    then roi = " << region << "\n";
+        }
+    }
+
+    if(opts.m == mode::CORRUPTION || opts.m == mode::SIMULATION
+            || opts.m == mode::TUNE) {
         out << "    d = " << opts.d << "\n";
+        out << "    noise = " << (opts.random_noise ? "random" : "fixed")
+                << "\n";
+    }
+
+    if(opts.m == mode::SERVE || opts.m == mode::CLIENT) {
+        out << "    s = " << opts.s << "\n";
+    }
+
+    if(!opts.cache.directory.empty()) {
+        out << "    cache = " << opts.cache.directory << "\n";
+    }
+
+    if(opts.m == mode::SERVE) {
+        out << "    t = " << opts.t << "\n";
+        return out;
+    }
+
+    if(opts.m == mode::BATCH) {
+        out << "    t = " << opts.t << "\n";
+        out << "    batch size = " << opts.batch_size << "\n";
+    }
+
+    if(opts.m == mode::SUMMARISE) {
+        out << "    results = " << opts.results;
+        return out;
+    }
+
+    if(opts.m == mode::SIMULATION && !opts.results.empty()) {
+        out << "    results = " << opts.results << "\n";
+        out << "    seed = " << opts.seed << "\n";
+    }
+
+    if(opts.m == mode::SWEEP) {
+        out << "    jobs = " << opts.jobs << "\n";
+        out << "    action = "
+                << (opts.plan ? "plan" : opts.work ? "work" : "merge");
+        return out;
+    }
+
+    if(opts.m == mode::CONVERT) {
+        out << "    tile size = " << opts.tile_size << "\n";
+        if(opts.roi) {
+            out << "    roi = " << *opts.roi << "\n";
+        }
     }
 
     out << "    i = " << opts.i << "\n";
@@ -95,11 +294,172 @@ std::ostream& operator<<(std::ostream& out, const program_options& opts)
 
 constexpr const char* help()
 {
-    return "uwmf [-m r] -i <...> -w <...> [-k <...>] [-p <...>] [-o <...>]\n  "
-            "uwmf -m c -i <...> -d <...> [-o <...>]\n  "
-            "uwmf -m s -i <...> -w <...> -d <...> [-k <...>] [-p <...>]"
-                "[-r <...>]";
+    return "uwmf [-m r] -i <...> [-w <...>|--table <...>] [-k <...>] [-p <...>] "
+                "[-o <...>] [--detector <...>] [--passes <...>] [--in-place]\n  "
+                "[--algorithm <...>] "
+                "[--layout <...>] [--tile-size <...>] [--engine <...>] "
+                "[-t <...>]\n  "
+                "[--cache <...>] [--cache-size <...>] [--cache-memory <...>] "
+                "[--trace <...>]\n  "
+                "[--model <...>] [--roi <...>] [--stats]\n  "
+            "uwmf -m c -i <...> -d <...> [-o <...>] [--noise <...>]\n  "
+            "uwmf -m s -i <...> -w <...>|--wsizes <...> -d <...> [-k <...>] "
+                "[-p <...>]"
+                "[-r <...>] [--detector <...>] [--noise <...>] [--passes <...>] "
+                "[--psnr-ci <...>] [--ssim-ci <...>] [--layout <...>] "
+                "[--tile-size <...>] [--engine <...>] [-t <...>] "
+                "[--algorithm <...>] [--trace <...>] [--model <...>]\n  "
+                "[--results <...>] [--seed <...>]\n  "
+            "uwmf --calibrate --model <...>\n  "
+            "uwmf -m serve --socket <...> [-t <...>] [--cache <...>] "
+                "[--cache-size <...>] [--cache-memory <...>]\n  "
+            "uwmf -m client --socket <...> -i <...> -w <...> [-k <...>] "
+                "[-p <...>] [-o <...>] [--algorithm <...>]\n  "
+            "uwmf -m client --socket <...> --stats|--shutdown\n  "
+            "uwmf -m stream -w <...> [-i <...>] [-o <...>] [-k <...>] "
+                "[-p <...>] [--detector <...>] [--algorithm <...>]\n  "
+            "uwmf -m tune -i <...> -d <...> --table <...> [-r <...>] "
+                "[-t <...>] [--detector <...>] [--noise <...>] [--passes <...>] "
+                "[--algorithm <...>]\n  "
+            "uwmf -m convert -i <...> -o <...> [-t <...>] [--tile-size <...>] "
+                "[--roi <...>]\n  "
+            "uwmf -m sweep --jobs <...> --plan -i <...> [-r <...>] "
+                "[--shard-size <...>] [--densities <...>] [--wsizes <...>]\n  "
+                "[--ks <...>] [--ps <...>] [--passes <...>] [--algorithm <...>] "
+                "[--engine <...>] [--detector <...>] [--noise <...>]\n  "
+            "uwmf -m sweep --jobs <...> --work [-t <...>]\n  "
+            "uwmf -m sweep --jobs <...> --merge [-o <...>]\n  "
+            "uwmf -m batch -i <...> -o <...> -w <...> [-k <...>] [-p <...>] "
+                "[--passes <...>] [--batch-size <...>] [-t <...>]\n  "
+                "[--engine <...>] [--detector <...>] [--algorithm <...>]\n  "
+                "[--cache <...>] [--cache-size <...>] [--cache-memory <...>]\n  "
+            "uwmf -m summarise --results <...> [-o <...>]";
+
+}
+
+// x,y,width,height
+std::optional<uwmf::rect> to_rect(const std::string& str)
+{
+    uwmf::rect r{};
+    int length = 0;
+    if(std::sscanf(str.c_str(), "%zu,%zu,%zu,%zu%n", &r.x, &r.y, &r.width,
+               &r.height, &length) != 4
+            || static_cast<std::size_t>(length) != str.size()) {
+        return std::nullopt;
+    }
+    return r;
+}
+
+// comma separated values, e.g. 0.1,0.3,0.5
+template<typename T>
+std::optional<std::vector<T>> to_list(const std::string& str)
+{
+    std::vector<T> values;
+    std::istringstream items(str);
+    std::string item;
+    while(std::getline(items, item, ',')) {
+        std::istringstream field(item);
+        T value;
+        std::string rest;
+        if(!(field >> value) || (field >> rest)) {
+            return std::nullopt;
+        }
+        values.push_back(value);
+    }
+
+    if(values.empty()) {
+        return std::nullopt;
+    }
+    return values;
+}
+
+// input names an image or a directory of them, sorted by name
+std::vector<std::string> list_images(const std::string& input)
+{
+    namespace fs = std::filesystem;
+
+    std::vector<std::string> images;
+    std::error_code error;
+    if(fs::is_directory(input, error)) {
+        for(const auto& file: fs::directory_iterator(input, error)) {
+            if(file.path().extension() == ".png") {
+                images.push_back(file.path().string());
+            }
+        }
+        std::sort(images.begin(), images.end());
+    }
+    else {
+        images.push_back(input);
+    }
+    if(images.empty()) {
+        LOGE() << "no images in " << input;
+    }
+    return images;
+}
+
+std::optional<uwmf::sweep_grid> to_sweep_grid(
+        const cxxopts::ParseResult& results, const program_options& opts)
+{
+    uwmf::sweep_grid grid{};
+    if(results["i"].count() == 0) {
+        LOGE() << "missing input";
+        return std::nullopt;
+    }
+    grid.images = list_images(results["i"].as<std::string>());
+    if(grid.images.empty()) {
+        return std::nullopt;
+    }
+
+    // ibinr is euclidean unless told otherwise, as with -p
+    const auto densities =
+            to_list<double>(results["densities"].as<std::string>());
+    const auto w = to_list<int>(results["wsizes"].as<std::string>());
+    const auto p = to_list<int>(results["ps"].as<std::string>());
+    const auto ibinr_p = to_list<int>(results["ps"].count()
+            ? results["ps"].as<std::string>()
+            : "2");
+    const auto k = to_list<int>(results["ks"].as<std::string>());
+    if(!densities || !w || !p || !k) {
+        LOGE() << "malformed grid, expected comma separated values";
+        return std::nullopt;
+    }
+    grid.densities = *densities;
+    grid.w = *w;
+    grid.p = *p;
+    grid.ibinr_p = *ibinr_p;
+    grid.k = *k;
+
+    const auto outside = [] (const auto& values, const auto min,
+            const auto max)
+    {
+        return std::any_of(values.begin(), values.end(),
+                [&] (const auto value) { return value < min || value > max; });
+    };
+    const int no_limit = std::numeric_limits<int>::max();
+    if(outside(grid.densities, 0.0, 1.0) || outside(grid.w, 1, no_limit)
+            || outside(grid.p, 1, no_limit) || outside(grid.k, 0, no_limit)) {
+        LOGE() << "grid values out of range";
+        return std::nullopt;
+    }
+    if(opts.engine == uwmf::engine_type::LUT && outside(grid.w, 1, 1)) {
+        LOGE() << "the lut engine requires w = 1";
+        return std::nullopt;
+    }
 
+    const int repetitions = results["r"].as<int>();
+    const int shard_size = results["shard-size"].as<int>();
+    grid.passes = results["passes"].as<int>();
+    if(repetitions < 1 || shard_size < 1 || grid.passes < 1) {
+        LOGE() << "r, shard size and passes must be positive";
+        return std::nullopt;
+    }
+    grid.repetitions = repetitions;
+    grid.shard_size = shard_size;
+    grid.algorithms = opts.algorithms;
+    grid.engine = opts.engine;
+    grid.detector = opts.detector;
+    grid.random_noise = opts.random_noise;
+    return grid;
 }
 
 std::optional<program_options> extract_program_options(
@@ -113,14 +473,273 @@ std::optional<program_options> extract_program_options(
         return std::nullopt;
     }
     opts.m = *m;
+    opts.t = results["t"].as<int>();
+    opts.stats = results["stats"].as<bool>();
+    opts.shutdown = results["shutdown"].as<bool>();
+    if(results["trace"].count()) {
+        opts.trace = results["trace"].as<std::string>();
+    }
+    if(results["model"].count()) {
+        opts.model = results["model"].as<std::string>();
+    }
+    if(results["results"].count()) {
+        opts.results = results["results"].as<std::string>();
+        if(*m != mode::SIMULATION && *m != mode::SUMMARISE) {
+            LOGE() << "only simulation and summarise mode use a results "
+                    "store, sweeps keep their own";
+            return std::nullopt;
+        }
+    }
+    opts.seed = results["seed"].as<std::uint64_t>();
 
-    if(results["i"].count() == 0) {
+    if(*m == mode::SUMMARISE) {
+        if(opts.results.empty()) {
+            LOGE() << "missing option results";
+            return std::nullopt;
+        }
+
+        // the report goes to stdout by default
+        opts.o = results["o"].count() ? results["o"].as<std::string>() : "-";
+        return opts;
+    }
+
+    opts.calibrate = results["calibrate"].as<bool>();
+    if(opts.calibrate) {
+        if(opts.model.empty()) {
+            LOGE() << "missing option model";
+            return std::nullopt;
+        }
+        return opts;
+    }
+
+    auto detector = uwmf::to_detector_type(
+            results["detector"].as<std::string>());
+    if(!detector) {
+        LOGE() << "unrecognized noise detector";
+        return std::nullopt;
+    }
+    opts.detector = {*detector, results["road-threshold"].as<int>()};
+
+    const auto noise = results["noise"].as<std::string>();
+    if(noise != "fixed" && noise != "random") {
+        LOGE() << "unrecognized noise model";
+        return std::nullopt;
+    }
+    opts.random_noise = noise == "random";
+    opts.in_place = results["in-place"].as<bool>();
+    if(results["table"].count()) {
+        opts.table = results["table"].as<std::string>();
+    }
+
+    if(*m == mode::TUNE && opts.table.empty()) {
+        LOGE() << "missing option table";
+        return std::nullopt;
+    }
+
+    const auto layout = results["layout"].as<std::string>();
+    if(layout != "rows" && layout != "tiles") {
+        LOGE() << "unrecognized layout";
+        return std::nullopt;
+    }
+    opts.tiled = layout == "tiles";
+    opts.tile_size = results["tile-size"].as<int>();
+    if(opts.tile_size < 1) {
+        LOGE() << "tile size must be positive";
+        return std::nullopt;
+    }
+
+    // the planner picks the engine once the noise mask is known
+    opts.planned = results["engine"].as<std::string>() == "plan";
+    auto engine = opts.planned
+            ? uwmf::engine_type::AUTO
+            : uwmf::to_engine_type(results["engine"].as<std::string>());
+    if(!engine) {
+        LOGE() << "unrecognized engine";
+        return std::nullopt;
+    }
+    opts.engine = *engine;
+
+    if(opts.planned) {
+        if(opts.model.empty()) {
+            LOGE() << "missing option model";
+            return std::nullopt;
+        }
+        if(*m != mode::RESTORATION && *m != mode::SIMULATION) {
+            LOGE() << "only restoration and simulation plan the engine";
+            return std::nullopt;
+        }
+        if(opts.in_place || results["layout"].count()) {
+            LOGE() << "the planner picks the layout itself";
+            return std::nullopt;
+        }
+        if(!opts.results.empty()) {
+            // fft rounding makes the engine part of a cell
+            LOGE() << "planned engines can't be stored as results";
+            return std::nullopt;
+        }
+    }
+
+    auto algorithm = results["algorithm"].as<std::string>();
+    if(algorithm == "both") {
+        algorithm = "uwmf,ibinr";
+    }
+    const auto algorithms = to_list<std::string>(algorithm);
+    if(!algorithms) {
+        LOGE() << "malformed algorithm list, expected comma separated names";
+        return std::nullopt;
+    }
+    for(const auto& name: *algorithms) {
+        const auto algorithm_type = uwmf::to_algorithm_type(name);
+        if(!algorithm_type) {
+            LOGE() << "unrecognized algorithm";
+            return std::nullopt;
+        }
+        if(std::find(opts.algorithms.begin(), opts.algorithms.end(),
+                *algorithm_type) == opts.algorithms.end()) {
+            opts.algorithms.push_back(*algorithm_type);
+        }
+    }
+    opts.algorithm = opts.algorithms.front();
+    if(opts.algorithms.size() > 1 && *m != mode::SIMULATION
+            && *m != mode::SWEEP) {
+        LOGE() << "only simulation and sweep mode compare algorithms";
+        return std::nullopt;
+    }
+
+    // the median baselines share neither the engines nor the layouts of
+    // uwmf_filter
+    const bool baseline = std::any_of(opts.algorithms.begin(),
+            opts.algorithms.end(), uwmf::is_baseline);
+    if(baseline) {
+        if(*m != mode::RESTORATION && *m != mode::SIMULATION
+                && *m != mode::SWEEP) {
+            LOGE() << "only restoration, simulation and sweep mode run the "
+                    "median baselines";
+            return std::nullopt;
+        }
+        if(opts.in_place || opts.tiled || opts.planned
+                || !opts.table.empty()) {
+            LOGE() << "the median baselines don't support in-place "
+                    "restoration, tiled layouts, planned engines or "
+                    "parameter tables";
+            return std::nullopt;
+        }
+    }
+
+    if(opts.in_place && opts.tiled) {
+        LOGE() << "in-place restoration only supports the rows layout";
+        return std::nullopt;
+    }
+
+    if(opts.in_place && !opts.table.empty()) {
+        // the density estimate needs the noise mask of the whole image
+        LOGE() << "in-place restoration can't pick parameters from a table";
+        return std::nullopt;
+    }
+
+    if(results["cache"].count()) {
+        constexpr std::size_t mib = 1024 * 1024;
+        const int disk_limit = results["cache-size"].as<int>();
+        const int memory_limit = results["cache-memory"].as<int>();
+        if(disk_limit < 0 || memory_limit < 0) {
+            LOGE() << "cache limits must not be negative";
+            return std::nullopt;
+        }
+        opts.cache = {results["cache"].as<std::string>(), memory_limit * mib,
+                disk_limit * mib};
+
+        // tuned parameters, planned engines (fft rounding) and in-place
+        // restoration are not part of the key
+        if(opts.in_place || !opts.table.empty() || opts.planned) {
+            LOGE() << "the cache doesn't support in-place restoration, "
+                    "parameter tables or planned engines";
+            return std::nullopt;
+        }
+    }
+
+    if(results["roi"].count()) {
+        // several regions are separated by semicolons
+        std::istringstream regions(results["roi"].as<std::string>());
+        std::string item;
+        while(std::getline(regions, item, ';')) {
+            const auto region = to_rect(item);
+            if(!region) {
+                LOGE() << "malformed roi, expected x,y,width,height";
+                return std::nullopt;
+            }
+            if(!opts.roi) {
+                opts.roi = region;
+            }
+            else {
+                opts.panned_rois.push_back(*region);
+            }
+        }
+        if(!opts.roi) {
+            LOGE() << "malformed roi, expected x,y,width,height";
+            return std::nullopt;
+        }
+    }
+
+    if(*m == mode::SERVE || *m == mode::CLIENT) {
+        if(results["socket"].count() == 0) {
+            LOGE() << "missing option socket";
+            return std::nullopt;
+        }
+        opts.s = results["socket"].as<std::string>();
+
+        // every worker is a thread of the pool, there is no calling thread
+        // that could take over
+        if(*m == mode::SERVE && opts.t < 1) {
+            LOGE() << "t must be positive";
+            return std::nullopt;
+        }
+
+        if(*m == mode::SERVE || opts.stats || opts.shutdown) {
+            return opts;
+        }
+    }
+
+    if(*m == mode::SWEEP) {
+        if(results["jobs"].count() == 0) {
+            LOGE() << "missing option jobs";
+            return std::nullopt;
+        }
+        opts.jobs = results["jobs"].as<std::string>();
+        opts.plan = results["plan"].as<bool>();
+        opts.work = results["work"].as<bool>();
+        opts.merge = results["merge"].as<bool>();
+        if(opts.plan + opts.work + opts.merge != 1) {
+            LOGE() << "exactly one of plan, work and merge is required";
+            return std::nullopt;
+        }
+
+        // the report goes to stdout by default
+        opts.o = results["o"].count() ? results["o"].as<std::string>() : "-";
+        if(opts.plan) {
+            auto grid = to_sweep_grid(results, opts);
+            if(!grid) {
+                return std::nullopt;
+            }
+            opts.grid = *grid;
+        }
+        return opts;
+    }
+
+    if(*m == mode::STREAM) {
+        // frames are read from stdin and written to stdout by default
+        opts.i = results["i"].count() ? results["i"].as<std::string>() : "-";
+        opts.o = results["o"].count() ? results["o"].as<std::string>() : "-";
+    }
+    else if(results["i"].count() == 0) {
         LOGE() << "missing input";
         return std::nullopt;
     }
-    opts.i = results["i"].as<std::string>();
+    else {
+        opts.i = results["i"].as<std::string>();
+    }
 
-    if(*m != mode::SIMULATION) {
+    if(*m == mode::RESTORATION || *m == mode::CORRUPTION
+            || *m == mode::CLIENT) {
         if(results["o"].count() == 0) {
             opts.o = opts.i;
             std::size_t dot_pos = opts.o.find_last_of('.');
@@ -128,33 +747,161 @@ std::optional<program_options> extract_program_options(
                 dot_pos = opts.o.length();
             }
             opts.o.insert(dot_pos,
-                    opts.m == mode::RESTORATION ? "_restored" : "_corrupted");
+                    opts.m == mode::CORRUPTION ? "_corrupted" : "_restored");
         }
         else {
             opts.o = results["o"].as<std::string>();
         }
+
+        // regions are restored lazily, from png images and tiled files
+        if(*m == mode::RESTORATION && opts.roi) {
+            if(uwmf::is_tiled_file_name(opts.o)) {
+                LOGE() << "restored regions are written as png images";
+                return std::nullopt;
+            }
+            if(opts.in_place || !opts.table.empty()
+                    || !opts.cache.directory.empty() || opts.planned
+                    || opts.tiled || uwmf::is_baseline(opts.algorithm)) {
+                LOGE() << "regions don't support in-place restoration, "
+                        "parameter tables, planned engines, the cache, "
+                        "tiled layouts or the median baselines";
+                return std::nullopt;
+            }
+        }
+        // tiled files are restored tile by tile, straight into another one
+        else if(*m == mode::RESTORATION && uwmf::is_tiled_file_name(opts.i)) {
+            if(!uwmf::is_tiled_file_name(opts.o)) {
+                LOGE() << "tiled files can only be restored into tiled files";
+                return std::nullopt;
+            }
+            if(opts.in_place || !opts.table.empty()
+                    || !opts.cache.directory.empty() || opts.planned
+                    || uwmf::is_baseline(opts.algorithm)) {
+                LOGE() << "tiled files don't support in-place restoration, "
+                        "parameter tables, planned engines, the cache or "
+                        "the median baselines";
+                return std::nullopt;
+            }
+        }
     }
-    else {
-        if(results["r"].count() == 0) {
+    else if(*m == mode::BATCH) {
+        if(results["o"].count() == 0) {
+            LOGE() << "missing output directory";
+            return std::nullopt;
+        }
+        opts.o = results["o"].as<std::string>();
+        opts.batch_size = results["batch-size"].as<int>();
+        if(opts.batch_size < 1) {
+            LOGE() << "batch size must be positive";
+            return std::nullopt;
+        }
+    }
+    else if(*m == mode::CONVERT) {
+        if(results["o"].count() == 0) {
+            LOGE() << "missing output";
+            return std::nullopt;
+        }
+        opts.o = results["o"].as<std::string>();
+
+        // the extensions pick the direction
+        if(uwmf::is_tiled_file_name(opts.i)
+                == uwmf::is_tiled_file_name(opts.o)) {
+            LOGE() << "exactly one of input and output must be a .uwt file";
+            return std::nullopt;
+        }
+        if(opts.roi && !uwmf::is_tiled_file_name(opts.i)) {
+            LOGE() << "roi only applies to tiled input";
+            return std::nullopt;
+        }
+        if(!opts.panned_rois.empty()) {
+            LOGE() << "only a single roi can be converted";
+            return std::nullopt;
+        }
+    }
+    else if(*m == mode::SIMULATION || *m == mode::TUNE) {
+        if(*m == mode::SIMULATION && results["r"].count() == 0) {
             LOGE() << "missing option r";
             return std::nullopt;
         }
 
         opts.r = results["r"].as<int>();
+        if(opts.r < 1) {
+            LOGE() << "r must be positive";
+            return std::nullopt;
+        }
+        opts.psnr_ci = results["psnr-ci"].as<double>();
+        opts.ssim_ci = results["ssim-ci"].as<double>();
     }
 
-    if(*m == mode::RESTORATION || *m == mode::SIMULATION) {
-        if(results["w"].count() == 0) {
+    if(*m == mode::RESTORATION || *m == mode::SIMULATION
+            || *m == mode::CLIENT || *m == mode::STREAM || *m == mode::TUNE
+            || *m == mode::BATCH) {
+        // tuned parameters are picked per image or searched for
+        const bool tuned = *m == mode::TUNE
+                || (*m == mode::RESTORATION && !opts.table.empty());
+
+        // several window sizes share a single pass in simulation mode
+        if(*m == mode::SIMULATION && results["wsizes"].count()) {
+            if(results["w"].count()) {
+                LOGE() << "w and wsizes are mutually exclusive";
+                return std::nullopt;
+            }
+            auto windows = to_list<int>(results["wsizes"].as<std::string>());
+            if(!windows || *std::min_element(windows->begin(),
+                    windows->end()) < 1) {
+                LOGE() << "malformed window sizes, expected comma separated "
+                        "positive values";
+                return std::nullopt;
+            }
+            if(results["engine"].count() || opts.tiled) {
+                LOGE() << "window size lists are evaluated in a single pass "
+                        "of their own, without engines or layouts";
+                return std::nullopt;
+            }
+            std::sort(windows->begin(), windows->end());
+            windows->erase(std::unique(windows->begin(), windows->end()),
+                    windows->end());
+            opts.windows = *windows;
+        }
+
+        // without -w, restoration picks the window from the density of the
+        // noise once the image has been read
+        const bool estimated = *m == mode::RESTORATION && opts.table.empty()
+                && results["w"].count() == 0;
+        if(estimated && (opts.roi || uwmf::is_tiled_file_name(opts.i))) {
+            LOGE() << "the filtering window size is only estimated for whole "
+                    "png images, missing option w";
+            return std::nullopt;
+        }
+        if(results["w"].count() == 0 && !tuned && !estimated
+                && opts.windows.empty()) {
             LOGE() << "missing option w";
             return std::nullopt;
         }
 
-        opts.w = results["w"].as<int>();
+        opts.w = tuned || estimated ? 0
+                : opts.windows.empty() ? results["w"].as<int>()
+                : opts.windows.front();
         opts.k = results["k"].as<int>();
         opts.p = results["p"].as<int>();
+        opts.ibinr_p = results["p"].count() ? opts.p : 2;
+        opts.passes = results["passes"].as<int>();
+        if(opts.passes < 1) {
+            LOGE() << "passes must be positive";
+            return std::nullopt;
+        }
+
+        // tuned and estimated windows are only known once the image has
+        // been read
+        if(opts.engine == uwmf::engine_type::LUT && !tuned && !estimated
+                && opts.w != 1) {
+            LOGE() << "the lut engine requires w = 1";
+            return std::nullopt;
+        }
     }
 
-    if(*m == mode::CORRUPTION || *m == mode::SIMULATION) {
+    if(*m == mode::CORRUPTION || *m == mode::SIMULATION
+            || *m == mode::TUNE) {
         if(results["d"].count() == 0) {
             LOGE() << "missing option d";
             return std::nullopt;
@@ -166,32 +913,410 @@ std::optional<program_options> extract_program_options(
     return opts;
 }
 
-} // anonymous
+uwmf::uwmf_parameters to_parameters(const program_options& opts,
+        const uwmf::algorithm_type algorithm)
+{
+    const int p = algorithm == uwmf::algorithm_type::IBINR
+            ? opts.ibinr_p
+            : opts.p;
+    return {opts.w, p, opts.k, opts.passes, algorithm};
+}
 
-int main(int argc, char** argv)
+uwmf::uwmf_parameters to_parameters(const program_options& opts)
 {
-    uwmf::logger::filter() = uwmf::logger::log_level::INFO;
+    return to_parameters(opts, opts.algorithm);
+}
 
-    cxxopts::Options opts("uwmf");
-    opts.custom_help(help());
+int stream(const program_options& optvals)
+{
+    uwmf::stream_options options{};
+    options.input = optvals.i;
+    options.output = optvals.o;
+    options.queue_capacity = 4;
+    return uwmf::restore_stream(options, to_parameters(optvals),
+            optvals.detector) ? 0 : -1;
+}
 
-    opts.add_options()
-            (
-                    "h,help",
-                    "Display help"
-            )
-            (
-                    "m,mode",
-                    "Program mode",
-                    cxxopts::value<std::string>()->default_value("r")
-            )
-            (
-                    "k,weight-fall-off",
-                    "Weight fall-off",
-                    cxxopts::value<int>()->default_value("4")
-            )
-            (
-                    "p,minkowski-exponent",
+int calibrate(const program_options& optvals)
+{
+    LOGI() << "calibrating the cost model, this takes a few seconds";
+    return uwmf::cost_model::calibrate().save(optvals.model) ? 0 : -1;
+}
+
+int tune(const program_options& optvals)
+{
+    auto png = uwmf::read_png_image(optvals.i);
+    if(!png) {
+        return -1;
+    }
+    uwmf::monochrome_image image(std::move(png->buffer), png->width,
+            png->height);
+
+    // existing entries for other densities are kept
+    uwmf::parameter_table table;
+    if(std::ifstream(optvals.table)) {
+        auto existing = uwmf::parameter_table::load(optvals.table);
+        if(!existing) {
+            return -1;
+        }
+        table = *existing;
+    }
+
+    uwmf::tuning_options options{};
+    options.density = optvals.d;
+    options.copies = optvals.r;
+    options.threads = optvals.t;
+    options.passes = optvals.passes;
+    options.algorithm = optvals.algorithm;
+    options.random_noise = optvals.random_noise;
+    options.detector = optvals.detector;
+    const auto result = uwmf::tune(image, options);
+
+    LOGI() << "corruption density    : " << optvals.d;
+    LOGI() << "tuned w               : " << result.parameters.w;
+    LOGI() << "tuned p               : " << result.parameters.p;
+    LOGI() << "tuned k               : " << result.parameters.k;
+    LOGI() << "psnr                  : " << result.psnr;
+    LOGI() << "rounds                : " << result.rounds;
+
+    table.insert({optvals.d, result.parameters.w, result.parameters.p,
+            result.parameters.k});
+    return table.save(optvals.table) ? 0 : -1;
+}
+
+int convert(const program_options& optvals)
+{
+    const std::size_t threads = optvals.t;
+    if(!uwmf::is_tiled_file_name(optvals.i)) {
+        auto png = uwmf::read_png_image(optvals.i);
+        if(!png) {
+            return -1;
+        }
+        uwmf::monochrome_image image(std::move(png->buffer), png->width,
+                png->height);
+        return uwmf::write_tiled_file(image, optvals.tile_size, optvals.o,
+                threads) ? 0 : -1;
+    }
+
+    auto reader = uwmf::tiled_file_reader::open(optvals.i);
+    if(!reader) {
+        return -1;
+    }
+
+    const uwmf::rect region = optvals.roi.value_or(
+            uwmf::rect{0, 0, reader->width(), reader->height()});
+    if(region.x + region.width > reader->width()
+            || region.y + region.height > reader->height()) {
+        LOGE() << "roi exceeds the image";
+        return -1;
+    }
+
+    uwmf::monochrome_image image;
+    if(!reader->read_region(region, image, threads)) {
+        return -1;
+    }
+    return uwmf::write_png_image(image.data(), image.width(), image.height(),
+            optvals.o) ? 0 : -1;
+}
+
+// restores only the tiles the region overlaps, as a viewer would, from a
+// tiled file without decoding the tiles out of reach. further regions are
+// read one after another like a panning viewer, with the tiles around the
+// previous one prefetched meanwhile, and written to -o numbered from 1
+int restore_roi(const program_options& optvals)
+{
+    uwmf::lazy_restore_options options{};
+    options.engine = optvals.engine;
+    options.detector = optvals.detector;
+    options.tile_size = optvals.tile_size;
+    if(optvals.panned_rois.empty()) {
+        options.prefetch_threads = 0; // nothing is read afterwards
+    }
+
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    std::unique_ptr<uwmf::lazy_restored_image> image;
+    if(uwmf::is_tiled_file_name(optvals.i)) {
+        image = uwmf::lazy_restored_image::open(optvals.i,
+                to_parameters(optvals), options);
+    }
+    else if(auto png = uwmf::read_png_image(optvals.i)) {
+        image = std::make_unique<uwmf::lazy_restored_image>(
+                uwmf::monochrome_image(std::move(png->buffer), png->width,
+                        png->height),
+                to_parameters(optvals), options);
+    }
+    if(!image) {
+        return -1;
+    }
+
+    std::vector<uwmf::rect> regions = {*optvals.roi};
+    regions.insert(regions.end(), optvals.panned_rois.begin(),
+            optvals.panned_rois.end());
+    for(const auto& region: regions) {
+        if(region.x + region.width > image->width()
+                || region.y + region.height > image->height()) {
+            LOGE() << "roi exceeds the image";
+            return -1;
+        }
+    }
+
+    // png encoding is left out of the restoration time
+    double restoration_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - t1).count();
+    uwmf::monochrome_image restored_image;
+    for(std::size_t i = 0; i < regions.size(); i++) {
+        const auto start = std::chrono::high_resolution_clock::now();
+        if(!image->read_region(regions[i], restored_image)) {
+            return -1;
+        }
+        const double region_ms = std::chrono::duration<double, std::milli>(
+                std::chrono::high_resolution_clock::now() - start).count();
+        restoration_ms += region_ms;
+        if(optvals.stats && regions.size() > 1) {
+            LOGI() << "roi " << i << " time (ms)      : " << region_ms;
+        }
+
+        std::string name = optvals.o;
+        if(i > 0) {
+            std::size_t dot_pos = name.find_last_of('.');
+            if(dot_pos == std::string::npos) {
+                dot_pos = name.length();
+            }
+            name.insert(dot_pos, "_" + std::to_string(i));
+        }
+        if(!uwmf::write_png_image(restored_image.data(),
+                   restored_image.width(), restored_image.height(), name)) {
+            return -1;
+        }
+    }
+    if(optvals.stats) {
+        const auto stats = image->stats();
+        LOGI() << "restoration time (ms) : " << restoration_ms;
+        LOGI() << "tiles restored        : " << stats.restored;
+        if(regions.size() > 1) {
+            LOGI() << "tiles found ready     : " << stats.hits;
+            LOGI() << "tiles waited for      : " << stats.misses;
+        }
+    }
+    return 0;
+}
+
+#ifdef UWMF_WITH_SERVER
+int serve(const program_options& optvals)
+{
+    uwmf::server_options options{};
+    options.socket_path = optvals.s;
+    options.threads = optvals.t;
+    options.queue_capacity = optvals.t * 4;
+    options.cache = optvals.cache;
+    return uwmf::serve(options) ? 0 : -1;
+}
+
+int request(const program_options& optvals)
+{
+    auto client = uwmf::restoration_client::connect(optvals.s);
+    if(!client) {
+        return -1;
+    }
+
+    if(optvals.shutdown) {
+        return client->shutdown() ? 0 : -1;
+    }
+
+    if(optvals.stats) {
+        auto stats = client->stats();
+        if(!stats) {
+            return -1;
+        }
+
+        LOGI() << "workers               : " << stats->workers;
+        LOGI() << "completed jobs        : " << stats->completed_jobs;
+        LOGI() << "failed jobs           : " << stats->failed_jobs;
+        LOGI() << "cancelled jobs        : " << stats->cancelled_jobs;
+        LOGI() << "rejected jobs         : " << stats->rejected_jobs;
+        LOGI() << "cache hits            : " << stats->cache_hits;
+        LOGI() << "queue depth           : " << stats->queue_depth;
+        LOGI() << "in flight             : " << stats->in_flight;
+        LOGI() << "latency p50 (ms)      : " << stats->latency_p50_ms;
+        LOGI() << "latency p90 (ms)      : " << stats->latency_p90_ms;
+        LOGI() << "latency p99 (ms)      : " << stats->latency_p99_ms;
+        return 0;
+    }
+
+    auto png = uwmf::read_png_image(optvals.i);
+    if(!png) {
+        return -1;
+    }
+
+    uwmf::monochrome_image input_image(png->buffer, png->width, png->height);
+    auto restored_image = client->restore(input_image,
+            to_parameters(optvals));
+    if(!restored_image) {
+        return -1;
+    }
+
+    return uwmf::write_png_image(restored_image->data(),
+            restored_image->width(), restored_image->height(), optvals.o)
+            ? 0 : -1;
+}
+#endif
+
+int sweep(const program_options& optvals)
+{
+    if(optvals.plan) {
+        return uwmf::plan_sweep(optvals.jobs, optvals.grid) ? 0 : -1;
+    }
+    else if(optvals.work) {
+        return uwmf::work_sweep(optvals.jobs, optvals.t) ? 0 : -1;
+    }
+
+    if(optvals.o == "-") {
+        return uwmf::merge_sweep(optvals.jobs, std::cout) ? 0 : -1;
+    }
+    std::ofstream report(optvals.o);
+    return uwmf::merge_sweep(optvals.jobs, report) ? 0 : -1;
+}
+
+int summarise(const program_options& optvals)
+{
+    if(optvals.o == "-") {
+        return uwmf::summarise_results({optvals.results}, std::cout) ? 0 : -1;
+    }
+    std::ofstream report(optvals.o);
+    return uwmf::summarise_results({optvals.results}, report) ? 0 : -1;
+}
+
+// -i names a directory of images (or a single one), which are restored in
+// batches under their names into the directory -o. with --cache, only the
+// images missing from it are restored
+int batch(const program_options& optvals)
+{
+    namespace fs = std::filesystem;
+
+    const auto files = list_images(optvals.i);
+    if(files.empty()) {
+        return -1;
+    }
+    std::error_code error;
+    fs::create_directories(optvals.o, error);
+    if(error) {
+        LOGE() << "failed to create " << optvals.o << ": " << error.message();
+        return -1;
+    }
+
+    std::unique_ptr<uwmf::result_cache> cache;
+    if(!optvals.cache.directory.empty()) {
+        cache = uwmf::result_cache::open(optvals.cache);
+        if(!cache) {
+            return -1;
+        }
+    }
+
+    uwmf::batch_restorer restorer(to_parameters(optvals), optvals.engine,
+            optvals.detector, optvals.t);
+    std::vector<uwmf::monochrome_image> images;
+    std::vector<uwmf::monochrome_image> restored_images;
+    // the images of a batch taken from the cache, and the positions in the
+    // batch of those that are restored
+    std::vector<uwmf::monochrome_image> cached_images;
+    std::vector<std::size_t> missed;
+    std::vector<uwmf::result_cache::key_type> keys;
+    double restoration_ms = 0;
+    const auto start = std::chrono::high_resolution_clock::now();
+    for(std::size_t first = 0; first < files.size();
+            first += optvals.batch_size) {
+        const std::size_t last = std::min(files.size(),
+                first + static_cast<std::size_t>(optvals.batch_size));
+        images.clear();
+        cached_images.resize(last - first);
+        missed.clear();
+        keys.clear();
+        for(std::size_t i = first; i < last; i++) {
+            auto png = uwmf::read_png_image(files[i]);
+            if(!png) {
+                return -1;
+            }
+            uwmf::monochrome_image image(std::move(png->buffer), png->width,
+                    png->height);
+            if(cache) {
+                auto key = uwmf::result_cache::key(image,
+                        to_parameters(optvals), optvals.engine,
+                        optvals.detector);
+                if(cache->lookup(key, cached_images[i - first])) {
+                    continue;
+                }
+                keys.push_back(std::move(key));
+            }
+            missed.push_back(i - first);
+            images.push_back(std::move(image));
+        }
+
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        restorer.restore(images, restored_images);
+        const auto t2 = std::chrono::high_resolution_clock::now();
+        restoration_ms +=
+                std::chrono::duration<double, std::milli>(t2 - t1).count();
+
+        for(std::size_t j = 0; j < missed.size(); j++) {
+            if(cache) {
+                cache->store(keys[j], restored_images[j]);
+            }
+            cached_images[missed[j]] = std::move(restored_images[j]);
+        }
+
+        for(std::size_t i = first; i < last; i++) {
+            const auto& restored_image = cached_images[i - first];
+            const auto name = fs::path(optvals.o)
+                    / fs::path(files[i]).filename();
+            if(!uwmf::write_png_image(restored_image.data(),
+                       restored_image.width(), restored_image.height(),
+                       name.string())) {
+                return -1;
+            }
+        }
+    }
+    const auto end = std::chrono::high_resolution_clock::now();
+    const double total_ms =
+            std::chrono::duration<double, std::milli>(end - start).count();
+
+    LOGI() << "images                : " << files.size();
+    LOGI() << "restoration time (ms) : " << restoration_ms;
+    LOGI() << "images per second     : " << files.size() * 1e3
+            / std::max(restoration_ms, 1e-3);
+    LOGI() << "with png io           : " << files.size() * 1e3
+            / std::max(total_ms, 1e-3);
+    if(cache) {
+        LOGI() << "cache hits            : " << cache->hits();
+    }
+    return 0;
+}
+
+} // anonymous
+
+int main(int argc, char** argv)
+{
+    uwmf::logger::filter() = uwmf::logger::log_level::INFO;
+
+    cxxopts::Options opts("uwmf");
+    opts.custom_help(help());
+
+    opts.add_options()
+            (
+                    "h,help",
+                    "Display help"
+            )
+            (
+                    "m,mode",
+                    "Program mode",
+                    cxxopts::value<std::string>()->default_value("r")
+            )
+            (
+                    "k,weight-fall-off",
+                    "Weight fall-off",
+                    cxxopts::value<int>()->default_value("4")
+            )
+            (
+                    "p,minkowski-exponent",
                     "Minkowski exponent",
                     cxxopts::value<int>()->default_value("1")
             )
@@ -200,6 +1325,11 @@ int main(int argc, char** argv)
                     "Filtering window size",
                     cxxopts::value<int>()
             )
+            (
+                    "passes",
+                    "Maximum number of restoration passes",
+                    cxxopts::value<int>()->default_value("1")
+            )
             (
                     "d,corruption-density",
                     "Image corruption density ()",
@@ -219,6 +1349,185 @@ int main(int argc, char** argv)
                     "o,output",
                     "Output file name",
                     cxxopts::value<std::string>()
+            )
+            (
+                    "socket",
+                    "Server socket path",
+                    cxxopts::value<std::string>()
+            )
+            (
+                    "t,threads",
+                    "Number of worker threads",
+                    cxxopts::value<int>()->default_value(std::to_string(
+                            uwmf::thread_pool::default_thread_count()))
+            )
+            (
+                    "stats",
+                    "Query server statistics (client), report the plan "
+                            "(restoration)",
+                    cxxopts::value<bool>()->default_value("false")
+            )
+            (
+                    "shutdown",
+                    "Stop the server",
+                    cxxopts::value<bool>()->default_value("false")
+            )
+            (
+                    "detector",
+                    "Noise detector (naive, road)",
+                    cxxopts::value<std::string>()->default_value("naive")
+            )
+            (
+                    "road-threshold",
+                    "Impulse threshold of the road detector",
+                    cxxopts::value<int>()->default_value(std::to_string(
+                            uwmf::road_noise_detector::default_threshold))
+            )
+            (
+                    "noise",
+                    "Impulse noise model (fixed, random)",
+                    cxxopts::value<std::string>()->default_value("fixed")
+            )
+            (
+                    "in-place",
+                    "Restore into the input buffer",
+                    cxxopts::value<bool>()->default_value("false")
+            )
+            (
+                    "layout",
+                    "Image layout during restoration (rows, tiles)",
+                    cxxopts::value<std::string>()->default_value("rows")
+            )
+            (
+                    "tile-size",
+                    "Edge length of the tiles (tiles layout, tiled files)",
+                    cxxopts::value<int>()->default_value("64")
+            )
+            (
+                    "cache",
+                    "Result cache directory (restoration, serve, batch)",
+                    cxxopts::value<std::string>()
+            )
+            (
+                    "cache-size",
+                    "Disk limit of the result cache (MiB)",
+                    cxxopts::value<int>()->default_value("1024")
+            )
+            (
+                    "cache-memory",
+                    "Memory limit of the result cache (MiB)",
+                    cxxopts::value<int>()->default_value("256")
+            )
+            (
+                    "roi",
+                    "Region of a tiled file to convert or of an image to restore "
+                    "(x,y,width,height), regions restored one after another "
+                    "are separated by semicolons",
+                    cxxopts::value<std::string>()
+            )
+            (
+                    "algorithm",
+                    "Restoration algorithm (uwmf, ibinr, median, amf), comma "
+                    "separated lists or both (uwmf,ibinr) in simulation and "
+                    "sweep",
+                    cxxopts::value<std::string>()->default_value("uwmf")
+            )
+            (
+                    "engine",
+                    "Window evaluation (auto, direct, lut, fft, plan)",
+                    cxxopts::value<std::string>()->default_value("auto")
+            )
+            (
+                    "model",
+                    "Cost model file of the planner (--engine plan)",
+                    cxxopts::value<std::string>()
+            )
+            (
+                    "calibrate",
+                    "Measure the cost model of this machine into --model",
+                    cxxopts::value<bool>()->default_value("false")
+            )
+            (
+                    "table",
+                    "Tuned parameter table (tune, restoration)",
+                    cxxopts::value<std::string>()
+            )
+            (
+                    "trace",
+                    "Chrome trace event file of the run",
+                    cxxopts::value<std::string>()
+            )
+            (
+                    "results",
+                    "Store of completed cells (simulation, summarise)",
+                    cxxopts::value<std::string>()
+            )
+            (
+                    "seed",
+                    "Seed of the first corrupted copy (simulation with "
+                    "results)",
+                    cxxopts::value<std::uint64_t>()->default_value("1")
+            )
+            (
+                    "jobs",
+                    "Sweep directory shared by the workers",
+                    cxxopts::value<std::string>()
+            )
+            (
+                    "plan",
+                    "Create the jobs of a sweep",
+                    cxxopts::value<bool>()->default_value("false")
+            )
+            (
+                    "work",
+                    "Run jobs of a sweep until none is left",
+                    cxxopts::value<bool>()->default_value("false")
+            )
+            (
+                    "merge",
+                    "Report the results of a sweep",
+                    cxxopts::value<bool>()->default_value("false")
+            )
+            (
+                    "shard-size",
+                    "Repetitions per sweep job",
+                    cxxopts::value<int>()->default_value("10")
+            )
+            (
+                    "batch-size",
+                    "Images restored per batch (batch)",
+                    cxxopts::value<int>()->default_value("256")
+            )
+            (
+                    "densities",
+                    "Corruption densities of a sweep",
+                    cxxopts::value<std::string>()->default_value(
+                            "0.1,0.3,0.5,0.7,0.9")
+            )
+            (
+                    "wsizes",
+                    "Filtering window sizes of a sweep or a simulation",
+                    cxxopts::value<std::string>()->default_value("1,2,3,4,6")
+            )
+            (
+                    "ps",
+                    "Minkowski exponents of a sweep",
+                    cxxopts::value<std::string>()->default_value("1")
+            )
+            (
+                    "ks",
+                    "Weight fall-offs of a sweep",
+                    cxxopts::value<std::string>()->default_value("4")
+            )
+            (
+                    "psnr-ci",
+                    "Target 95% confidence interval half-width of the psnr (dB)",
+                    cxxopts::value<double>()->default_value("0")
+            )
+            (
+                    "ssim-ci",
+                    "Target 95% confidence interval half-width of the ssim",
+                    cxxopts::value<double>()->default_value("0")
             );
 
 
@@ -247,47 +1556,459 @@ int main(int argc, char** argv)
 
     LOGD() << "running UWMF with" << optvals;
 
+    // written on every way out of main
+    const uwmf::trace_session trace(optvals.trace);
+
+    if(optvals.calibrate) {
+        return calibrate(optvals);
+    }
+
+    if(optvals.m == mode::STREAM) {
+        return stream(optvals);
+    }
+
+    if(optvals.m == mode::TUNE) {
+        return tune(optvals);
+    }
+
+    if(optvals.m == mode::CONVERT) {
+        return convert(optvals);
+    }
+
+    if(optvals.m == mode::SWEEP) {
+        return sweep(optvals);
+    }
+
+    if(optvals.m == mode::BATCH) {
+        return batch(optvals);
+    }
+
+    if(optvals.m == mode::SUMMARISE) {
+        return summarise(optvals);
+    }
+
+    if(optvals.m == mode::RESTORATION && optvals.roi) {
+        return restore_roi(optvals);
+    }
+
+    if(optvals.m == mode::RESTORATION && uwmf::is_tiled_file_name(optvals.i)) {
+        return uwmf::restore_tiled_file(optvals.i, optvals.o,
+                to_parameters(optvals), optvals.engine, optvals.detector,
+                optvals.t) ? 0 : -1;
+    }
+
+    if(optvals.m == mode::SERVE || optvals.m == mode::CLIENT) {
+#ifdef UWMF_WITH_SERVER
+        return optvals.m == mode::SERVE ? serve(optvals) : request(optvals);
+#else
+        LOGE() << "server support is not available on this platform";
+        return -1;
+#endif
+    }
+
     uwmf::monochrome_png_image png = *uwmf::read_png_image(optvals.i);
-    uwmf::monochrome_image input_image(png.buffer, png.width, png.height);
+    uwmf::monochrome_image input_image(
+            std::move(png.buffer), png.width, png.height);
+
+    if(optvals.m == mode::RESTORATION && optvals.table.empty()
+            && optvals.w == 0) {
+        // the naive detector flags exactly the extreme pixels, their counts
+        // come from a single pass over the image without building the mask
+        double density = 0;
+        if(optvals.detector.type == uwmf::detector_type::NAIVE) {
+            const auto noise = uwmf::estimate_noise(
+                    uwmf::compute_moments(input_image, optvals.t));
+            density = noise.density;
+            LOGI() << "estimated density     : " << density;
+            LOGI() << "salt fraction         : " << noise.salt_fraction;
+        }
+        else {
+            density = uwmf::estimate_density(uwmf::visit_detector(
+                    optvals.detector,
+                    [&] (const auto& detector)
+                    {
+                        return uwmf::detect_noise(input_image, detector);
+                    }));
+            LOGI() << "estimated density     : " << density;
+        }
+        optvals.w = uwmf::suggested_window_size(density);
+        if(optvals.engine == uwmf::engine_type::LUT && optvals.w != 1) {
+            optvals.engine = uwmf::engine_type::AUTO;
+        }
+        LOGI() << "estimated w           : " << optvals.w;
+    }
+
+    const auto corrupt = [&optvals] (const uwmf::monochrome_image& image)
+    {
+        return optvals.random_noise
+                ? uwmf::rvin(image, optvals.d)
+                : uwmf::fvin(image, optvals.d);
+    };
+
+    std::optional<uwmf::cost_model> model;
+    if(optvals.planned) {
+        model = uwmf::cost_model::load(optvals.model);
+        if(!model) {
+            return -1;
+        }
+    }
+
+    // the planner needs the noise mask, it is only reported once
+    bool plan_reported = false;
+    const auto restore_with_mask = [&] (const uwmf::monochrome_image& image,
+            const uwmf::noise_mask& mask,
+            const uwmf::uwmf_parameters& parameters)
+    {
+        uwmf::monochrome_image restored_image;
+        if(uwmf::is_baseline(parameters.algorithm)) {
+            uwmf::restore_baseline(image, mask, parameters, restored_image);
+            return restored_image;
+        }
+
+        auto engine = optvals.engine;
+        if(engine == uwmf::engine_type::LUT && parameters.w != 1) {
+            engine = uwmf::engine_type::AUTO; // tuned window
+        }
+        bool tiled = optvals.tiled;
+        std::size_t tile_size = optvals.tile_size;
+        if(model) {
+            const auto plan = model->plan(mask, parameters, optvals.t);
+            engine = plan.engine;
+            tiled = plan.tiled;
+            tile_size = plan.tile_size;
+            if(optvals.stats && !plan_reported) {
+                plan_reported = true;
+                if(optvals.table.empty()) {
+                    LOGI() << "estimated density     : " << plan.density;
+                }
+                LOGI() << "planned engine        : " << to_string(engine);
+                LOGI() << "planned layout        : " << (tiled
+                        ? "tiles of " + std::to_string(tile_size)
+                        : std::string("rows"));
+                LOGI() << "estimated time (ms)   : " << plan.estimated_ms;
+            }
+        }
+
+        uwmf::uwmf_filter filter(parameters, engine, optvals.t);
+        if(tiled) {
+            filter.restore_tiled_with_mask(image, mask, tile_size,
+                    restored_image);
+        }
+        else {
+            filter.restore_with_mask(image, mask, restored_image);
+        }
+        return restored_image;
+    };
+
+    const auto restore = [&] (const uwmf::monochrome_image& image,
+            const uwmf::uwmf_parameters& parameters)
+    {
+        const auto mask = uwmf::visit_detector(optvals.detector,
+                [&] (const auto& detector)
+                {
+                    return uwmf::detect_noise(image, detector);
+                });
+        return restore_with_mask(image, mask, parameters);
+    };
 
     if(optvals.m == mode::CORRUPTION) {
-        auto corrupt_image = fvin(input_image, optvals.d);
+        auto corrupt_image = corrupt(input_image);
         uwmf::write_png_image(corrupt_image.data(),
                 corrupt_image.width(), corrupt_image.height(), optvals.o);
     }
+    else if(optvals.m == mode::RESTORATION && optvals.in_place) {
+        uwmf::uwmf_filter filter(to_parameters(optvals), optvals.engine);
+        uwmf::visit_detector(optvals.detector,
+                [&] (const auto& detector)
+                {
+                    filter.restore_in_place(input_image, detector);
+                });
+        uwmf::write_png_image(input_image.data(),
+                input_image.width(), input_image.height(), optvals.o);
+    }
+    else if(optvals.m == mode::RESTORATION && !optvals.table.empty()) {
+        auto table = uwmf::parameter_table::load(optvals.table);
+        if(!table) {
+            return -1;
+        }
+        else if(table->empty()) {
+            LOGE() << "no tuned parameters in " << optvals.table;
+            return -1;
+        }
+
+        auto mask = uwmf::visit_detector(optvals.detector,
+                [&] (const auto& detector)
+                {
+                    return uwmf::detect_noise(input_image, detector);
+                });
+        const double density = uwmf::estimate_density(mask);
+        const auto& entry = table->lookup(density);
+        LOGI() << "estimated density     : " << density;
+        LOGI() << "tuned parameters      : w = " << entry.w << ", p = "
+                << entry.p << ", k = " << entry.k;
+
+        const auto restored_image = restore_with_mask(input_image, mask,
+                {entry.w, entry.p, entry.k, optvals.passes, optvals.algorithm});
+        uwmf::write_png_image(restored_image.data(),
+                restored_image.width(), restored_image.height(), optvals.o);
+    }
     else if(optvals.m == mode::RESTORATION) {
-        auto restored_image = uwmf::uwmf(input_image,
-                uwmf::naive_noise_detector, {optvals.w, optvals.p, optvals.k});
+        std::unique_ptr<uwmf::result_cache> cache;
+        uwmf::result_cache::key_type key;
+        if(!optvals.cache.directory.empty()) {
+            cache = uwmf::result_cache::open(optvals.cache);
+            if(!cache) {
+                return -1;
+            }
+            key = uwmf::result_cache::key(input_image, to_parameters(optvals),
+                    optvals.engine, optvals.detector);
+        }
+
+        uwmf::monochrome_image restored_image;
+        if(cache && cache->lookup(key, restored_image)) {
+            LOGI() << "restored image taken from the cache";
+        }
+        else {
+            const auto t1 = std::chrono::high_resolution_clock::now();
+            restored_image = restore(input_image, to_parameters(optvals));
+            const auto t2 = std::chrono::high_resolution_clock::now();
+            if(optvals.stats) {
+                LOGI() << "restoration time (ms) : "
+                        << std::chrono::duration<double, std::milli>(
+                                t2 - t1).count();
+            }
+            if(cache) {
+                cache->store(key, restored_image);
+            }
+        }
         uwmf::write_png_image(restored_image.data(),
                 restored_image.width(), restored_image.height(), optvals.o);
     }
     else {
-        double psnr_sum = 0;
-        double ssim_sum = 0;
-        double ief_sum = 0;
-        long int time_sum = 0;
+        // with a list of algorithms, every corrupted copy is restored with
+        // all of them, so that they are compared on the same noise, and so
+        // is every window size of --wsizes
+        struct evaluation
+        {
+            uwmf::uwmf_parameters parameters;
+            uwmf::running_statistics psnr;
+            uwmf::running_statistics ssim;
+            uwmf::running_statistics ief;
+            double time_sum = 0; // ms
+        };
+        const auto& algorithms = optvals.algorithms;
+        const auto windows = optvals.windows.empty()
+                ? std::vector<int>{optvals.w}
+                : optvals.windows;
+        std::vector<evaluation> evaluations;
+        for(const auto algorithm: algorithms) {
+            for(const int w: windows) {
+                auto parameters = to_parameters(optvals, algorithm);
+                parameters.w = w;
+                evaluations.push_back({parameters, {}, {}, {}, 0});
+            }
+        }
 
-        for(int i = 0; i < optvals.r; i++) {
-            auto corrupt_image = fvin(input_image, optvals.d);
+        // with confidence interval targets r is only an upper bound
+        const bool adaptive = optvals.psnr_ci > 0 || optvals.ssim_ci > 0;
+        const auto converged = [&]
+        {
+            constexpr std::size_t min_repetitions = 3;
+            return std::all_of(evaluations.begin(), evaluations.end(),
+                    [&] (const evaluation& e)
+                    {
+                        return e.psnr.count() >= min_repetitions
+                                && (optvals.psnr_ci <= 0
+                                        || e.psnr.half_width()
+                                                <= optvals.psnr_ci)
+                                && (optvals.ssim_ci <= 0
+                                        || e.ssim.half_width()
+                                                <= optvals.ssim_ci);
+                    });
+        };
 
-            auto t1 = std::chrono::high_resolution_clock::now();
-            auto restored_image = uwmf::uwmf(corrupt_image,
-                    uwmf::naive_noise_detector,
-                    {optvals.w, optvals.p, optvals.k});
-            auto t2 = std::chrono::high_resolution_clock::now();
+        // with a results store, copy i is corrupted with seed + i and the
+        // copies restored by an earlier run are taken from the store
+        std::unique_ptr<uwmf::results_store> store;
+        std::string image_path;
+        if(!optvals.results.empty()) {
+            store = uwmf::results_store::open(optvals.results);
+            if(!store) {
+                return -1;
+            }
+            image_path = std::filesystem::absolute(optvals.i).string();
+        }
+        const auto to_cell = [&] (const evaluation& e, const std::size_t i)
+        {
+            return uwmf::result_cell{image_path, optvals.d,
+                    optvals.random_noise, optvals.detector, e.parameters,
+                    optvals.engine, optvals.seed, i,
+                    !optvals.windows.empty()
+                            && !uwmf::is_baseline(e.parameters.algorithm)};
+        };
+        const auto add = [] (evaluation& e, const uwmf::cell_result& result)
+        {
+            e.psnr.add(result.psnr);
+            e.ssim.add(result.ssim);
+            e.ief.add(result.ief);
+            e.time_sum += result.time_ms;
+        };
+        const auto stored = [&] (const evaluation& e, const std::size_t i)
+        {
+            return store ? store->find(to_cell(e, i)) : nullptr;
+        };
+
+        const auto evaluate = [&] (evaluation& e, const std::size_t i,
+                const uwmf::monochrome_image& restored_image,
+                const uwmf::monochrome_image& corrupt_image, const double ms)
+        {
+            const uwmf::cell_result result{
+                    uwmf::psnr(input_image, restored_image),
+                    uwmf::ssim(input_image, restored_image),
+                    uwmf::ief(input_image, restored_image, corrupt_image), ms};
+            add(e, result);
+            if(store) {
+                store->append(to_cell(e, i), result);
+            }
+        };
+
+        std::vector<uwmf::monochrome_image> restored_images;
+        for(int i = 0; i < optvals.r && !(adaptive && converged()); i++) {
+            if(std::all_of(evaluations.begin(), evaluations.end(),
+                    [&] (const evaluation& e) { return stored(e, i); })) {
+                for(auto& e: evaluations) {
+                    add(e, *stored(e, i));
+                }
+                continue;
+            }
+
+            auto corrupt_image = !store ? corrupt(input_image)
+                    : optvals.random_noise
+                    ? uwmf::rvin(input_image, optvals.d, optvals.seed + i)
+                    : uwmf::fvin(input_image, optvals.d, optvals.seed + i);
+
+            if(optvals.windows.empty()) {
+                for(auto& e: evaluations) {
+                    if(const auto* result = stored(e, i)) {
+                        add(e, *result);
+                        continue;
+                    }
+                    auto t1 = std::chrono::high_resolution_clock::now();
+                    auto restored_image = restore(corrupt_image, e.parameters);
+                    auto t2 = std::chrono::high_resolution_clock::now();
+                    evaluate(e, i, restored_image, corrupt_image,
+                            std::chrono::duration<double, std::milli>(
+                                    t2 - t1).count());
+                }
+                continue;
+            }
+
+            // a single pass per algorithm, its time is split evenly. the
+            // baselines restore every window size on its own
+            for(std::size_t a = 0; a < evaluations.size();
+                    a += windows.size()) {
+                const auto first = evaluations.begin() + a;
+                if(std::all_of(first, first + windows.size(),
+                        [&] (const evaluation& e) { return stored(e, i); })) {
+                    for(auto e = first; e != first + windows.size(); e++) {
+                        add(*e, *stored(*e, i));
+                    }
+                    continue;
+                }
+                if(uwmf::is_baseline(evaluations[a].parameters.algorithm)) {
+                    for(std::size_t j = 0; j < windows.size(); j++) {
+                        auto& e = evaluations[a + j];
+                        if(const auto* result = stored(e, i)) {
+                            add(e, *result);
+                            continue;
+                        }
+                        auto t1 = std::chrono::high_resolution_clock::now();
+                        auto restored_image = restore(corrupt_image,
+                                e.parameters);
+                        auto t2 = std::chrono::high_resolution_clock::now();
+                        evaluate(e, i, restored_image, corrupt_image,
+                                std::chrono::duration<double, std::milli>(
+                                        t2 - t1).count());
+                    }
+                    continue;
+                }
 
-            psnr_sum += uwmf::psnr(input_image, restored_image);
-            ssim_sum += uwmf::ssim(input_image, restored_image);
-            ief_sum += uwmf::ief(input_image, restored_image, corrupt_image);
-            time_sum += std::chrono::duration_cast<
-                    std::chrono::milliseconds>(t2 - t1).count();
+                auto t1 = std::chrono::high_resolution_clock::now();
+                uwmf::multi_window_filter filter(windows,
+                        evaluations[a].parameters);
+                uwmf::visit_detector(optvals.detector,
+                        [&] (const auto& detector)
+                        {
+                            filter.restore(corrupt_image, detector,
+                                    restored_images);
+                        });
+                auto t2 = std::chrono::high_resolution_clock::now();
+                const double ms = std::chrono::duration<double, std::milli>(
+                        t2 - t1).count() / windows.size();
+                for(std::size_t j = 0; j < windows.size(); j++) {
+                    evaluate(evaluations[a + j], i, restored_images[j],
+                            corrupt_image, ms);
+                }
+            }
         }
 
+        const auto repetitions =
+                static_cast<long int>(evaluations.front().psnr.count());
         LOGI() << "corruption density    : " << optvals.d;
-        LOGI() << "average psnr          : " << psnr_sum / optvals.r;
-        LOGI() << "average ssim          : " << ssim_sum / optvals.r;
-        LOGI() << "average ief           : " << ief_sum / optvals.r;
-        LOGI() << "average cpu time (ms) : " << time_sum / optvals.r;
+        LOGI() << "repetitions           : " << repetitions;
+        for(const auto& e: evaluations) {
+            if(algorithms.size() > 1
+                    && uwmf::is_baseline(e.parameters.algorithm)) {
+                LOGI() << "algorithm             : "
+                        << uwmf::to_string(e.parameters.algorithm);
+            }
+            else if(algorithms.size() > 1) {
+                LOGI() << "algorithm             : "
+                        << uwmf::to_string(e.parameters.algorithm)
+                        << " (p = " << e.parameters.p << ")";
+            }
+            if(windows.size() > 1) {
+                LOGI() << "window size           : " << e.parameters.w;
+            }
+            LOGI() << "average psnr          : " << e.psnr.mean();
+            LOGI() << "average ssim          : " << e.ssim.mean();
+            LOGI() << "average ief           : " << e.ief.mean();
+            LOGI() << "average cpu time (ms) : "
+                    << static_cast<long int>(e.time_sum) / repetitions;
+            if(repetitions > 1) {
+                LOGI() << "psnr 95% ci           : +/- " << e.psnr.half_width();
+                LOGI() << "ssim 95% ci           : +/- " << e.ssim.half_width();
+            }
+        }
+        // the first algorithm against each of the others
+        const auto label = [] (std::string str)
+        {
+            str.resize(std::max<std::size_t>(str.size() + 1, 22), ' ');
+            return str + ": ";
+        };
+        for(std::size_t a = 1; a < algorithms.size(); a++) {
+            const auto pair = uwmf::to_string(algorithms.front()) + " - "
+                    + uwmf::to_string(algorithms[a]);
+            const auto ratio = uwmf::to_string(algorithms.front()) + " / "
+                    + uwmf::to_string(algorithms[a]);
+            for(std::size_t j = 0; j < windows.size(); j++) {
+                const auto& first = evaluations[j];
+                const auto& other = evaluations[a * windows.size() + j];
+                if(windows.size() > 1) {
+                    LOGI() << "window size           : " << windows[j];
+                }
+                LOGI() << label(pair + " psnr")
+                        << first.psnr.mean() - other.psnr.mean();
+                LOGI() << label(pair + " ssim")
+                        << first.ssim.mean() - other.ssim.mean();
+                LOGI() << label(ratio + " cpu time")
+                        << first.time_sum / other.time_sum;
+            }
+        }
+        if(adaptive && !converged()) {
+            LOGW() << "confidence interval targets not reached within "
+                    << optvals.r << " repetitions";
+        }
     }
 
     return 0;
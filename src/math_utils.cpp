@@ -1,60 +1,36 @@
 #include "math_utils.h"
 
+#include "image_statistics.h"
+
 namespace uwmf
 {
 
 double mean(const monochrome_image& image)
 {
-    double sum = 0;
-
-    for(const auto& [x, y, pixel]: image) {
-        sum += *pixel;
-    }
-
-    return sum / (image.width() * image.height());
+    return compute_moments(image).mean();
 }
 
 double variance(const monochrome_image& image, const double m)
 {
-    double sum = 0;
-
-    for(const auto& [x, y, pixel]: image) {
-        const auto val = *pixel - m;
-        sum += (val * val);
-    }
-
-    return sum / (image.width() * image.height());
+    return compute_moments(image).variance(m);
 }
 
 double covariance(const monochrome_image& image1, const double avg1,
         const monochrome_image& image2, const double avg2)
 {
-    double sum = 0;
-
-    for(const auto& [px1, px2]: make_image_zip(image1, image2)) {
-        sum += (*px1.value - avg1) * (*px2.value - avg2);
-    }
-
-    return sum / (image1.width() * image1.height());
+    return compute_moments(image1, image2).covariance(avg1, avg2);
 }
 
 double covariance(const monochrome_image& image1, const monochrome_image& image2)
 {
-    const double avg1 = mean(image1);
-    const double avg2 = mean(image2);
-    return covariance(image1, avg1, image2, avg2);
+    const auto moments = compute_moments(image1, image2);
+    return moments.covariance(moments.first().mean(),
+            moments.second().mean());
 }
 
 double se(const monochrome_image& image1, const monochrome_image& image2)
 {
-    double sum = 0;
-
-    for(const auto& [px1, px2]: make_image_zip(image1, image2)) {
-        const auto val = *px1.value - *px2.value;
-        sum += val * val;
-    }
-
-    return sum;
+    return compute_moments(image1, image2).se();
 }
 
 double minkowski_distance(const discrete_point2d& p1,
@@ -64,7 +40,7 @@ double minkowski_distance(const discrete_point2d& p1,
     double d2 = std::abs(p1.y - p2.y);
     d1 = std::pow(d1, p);
     d2 = std::pow(d2, p);
-    return std::pow(d1 + d2, 1 / p);
+    return std::pow(d1 + d2, 1.0 / p);
 }
 
 std::vector<double> gen_minkowski_weights(const int w, const int p, const int k)
@@ -5,7 +5,11 @@
 #include "image.h"
 #include "utils.h"
 
+#include <array>
 #include <cmath>
+#include <cstddef>
+#include <limits>
+#include <utility>
 #include <vector>
 
 namespace uwmf
@@ -36,6 +40,111 @@ inline double mse(const monochrome_image& image1,
     return se(image1, image2) / (image1.width() * image1.height());
 }
 
+// two-sided 95 % quantile of Student's t distribution
+inline double t_quantile_95(const std::size_t degrees_of_freedom)
+{
+    static constexpr std::array<double, 30> quantiles = {
+            12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+            2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101,
+            2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052,
+            2.048, 2.045, 2.042};
+
+    // beyond the table, the usual entries for 40, 60, 120 and infinitely
+    // many degrees of freedom, interpolated linearly in 1 / df
+    static constexpr std::array<std::pair<double, double>, 5> tail = {{
+            {30, 2.042}, {40, 2.021}, {60, 2.000}, {120, 1.980},
+            {std::numeric_limits<double>::infinity(), 1.960}}};
+
+    if(degrees_of_freedom == 0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    else if(degrees_of_freedom <= quantiles.size()) {
+        return quantiles[degrees_of_freedom - 1];
+    }
+
+    const double df = static_cast<double>(degrees_of_freedom);
+    std::size_t i = 1;
+    while(df > tail[i].first) {
+        i++;
+    }
+    const double t = (1 / tail[i - 1].first - 1 / df)
+            / (1 / tail[i - 1].first - 1 / tail[i].first);
+    return tail[i - 1].second + t * (tail[i].second - tail[i - 1].second);
+}
+
+// mean and variance of a sample that grows one value at a time (Welford)
+class running_statistics
+{
+public:
+    running_statistics() = default;
+
+    // statistics of a sample summarized elsewhere, see m2()
+    running_statistics(const std::size_t count, const double mean,
+            const double m2)
+        : count_(count)
+        , mean_(mean)
+        , m2_(m2)
+    {
+    }
+
+    void add(const double value)
+    {
+        count_++;
+        const double delta = value - mean_;
+        mean_ += delta / count_;
+        m2_ += delta * (value - mean_);
+    }
+
+    // statistics of both samples together (Chan et al.), so that samples
+    // can be collected apart and combined afterwards
+    void merge(const running_statistics& other)
+    {
+        const std::size_t count = count_ + other.count_;
+        if(count == 0) {
+            return;
+        }
+        const double delta = other.mean_ - mean_;
+        mean_ += delta * other.count_ / count;
+        m2_ += other.m2_ + delta * delta * count_ * other.count_ / count;
+        count_ = count;
+    }
+
+    std::size_t count() const
+    {
+        return count_;
+    }
+
+    double mean() const
+    {
+        return mean_;
+    }
+
+    // sum of the squared deviations from the mean
+    double m2() const
+    {
+        return m2_;
+    }
+
+    double variance() const
+    {
+        return count_ > 1 ? m2_ / (count_ - 1) : 0;
+    }
+
+    // half-width of the 95 % confidence interval of the mean
+    double half_width() const
+    {
+        if(count_ < 2) {
+            return std::numeric_limits<double>::infinity();
+        }
+        return t_quantile_95(count_ - 1) * std::sqrt(variance() / count_);
+    }
+
+private:
+    std::size_t count_ = 0;
+    double mean_ = 0;
+    double m2_ = 0;
+};
+
 double minkowski_distance(const discrete_point2d& p1,
         const discrete_point2d& p2, const int p);
 
@@ -0,0 +1,217 @@
+#include "median_filters.h"
+
+#include "image.h"
+#include "noise_detectors.h"
+#include "trace.h"
+#include "utils.h"
+#include "uwmf.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace
+{
+
+using uwmf::monochrome_image;
+
+// two levels, the median is located among the 16 coarse bins first and then
+// among the 16 fine bins of one of them. a column holds at most 2 r + 1
+// pixels, the window (2 r + 1)^2, which needs wider bins from r = 128 on
+template<typename Count>
+struct histogram
+{
+    std::array<Count, 256> fine;
+    std::array<Count, 16> coarse;
+
+    template<typename OtherCount>
+    void add(const histogram<OtherCount>& other)
+    {
+        for(std::size_t i = 0; i < fine.size(); i++) {
+            fine[i] += other.fine[i];
+        }
+        for(std::size_t i = 0; i < coarse.size(); i++) {
+            coarse[i] += other.coarse[i];
+        }
+    }
+
+    template<typename OtherCount>
+    void remove(const histogram<OtherCount>& other)
+    {
+        for(std::size_t i = 0; i < fine.size(); i++) {
+            fine[i] -= other.fine[i];
+        }
+        for(std::size_t i = 0; i < coarse.size(); i++) {
+            coarse[i] -= other.coarse[i];
+        }
+    }
+
+    // value with rank elements below it
+    monochrome_image::value_type select(std::size_t rank) const
+    {
+        std::size_t bin = 0;
+        while(coarse[bin] <= rank) {
+            rank -= coarse[bin++];
+        }
+        std::size_t value = bin * 16;
+        while(fine[value] <= rank) {
+            rank -= fine[value++];
+        }
+        return static_cast<monochrome_image::value_type>(value);
+    }
+};
+
+monochrome_image::value_type median(
+        std::vector<monochrome_image::value_type>& values)
+{
+    const auto middle = values.begin() + (values.size() - 1) / 2;
+    std::nth_element(values.begin(), middle, values.end());
+    return *middle;
+}
+
+} // anonymous
+
+namespace uwmf
+{
+
+void median_filter(const monochrome_image& image, const int radius,
+        monochrome_image& filtered_image)
+{
+    TRACE_SCOPE("median");
+    ASSERT(radius > 0, "the window must have a radius");
+    ASSERT(2 * radius + 1 <= std::numeric_limits<std::uint16_t>::max(),
+            "the window is too large for the column histograms");
+
+    const int width = image.width();
+    const int height = image.height();
+    filtered_image.resize(width, height);
+
+    using column_histogram = histogram<std::uint16_t>;
+    const auto update = [] (column_histogram& h, const int value,
+            const int delta)
+    {
+        h.fine[value] += delta;
+        h.coarse[value / 16] += delta;
+    };
+
+    // column x covers rows y - radius up to y + radius of the current row
+    std::vector<column_histogram> columns(width, column_histogram{});
+    for(int y = 0; y < std::min(radius, height); y++) {
+        for(int x = 0; x < width; x++) {
+            update(columns[x], image(x, y), 1);
+        }
+    }
+
+    histogram<std::uint32_t> window;
+    for(int y = 0; y < height; y++) {
+        if(y + radius < height) {
+            for(int x = 0; x < width; x++) {
+                update(columns[x], image(x, y + radius), 1);
+            }
+        }
+        if(y - radius - 1 >= 0) {
+            for(int x = 0; x < width; x++) {
+                update(columns[x], image(x, y - radius - 1), -1);
+            }
+        }
+        const int rows = std::min(y + radius, height - 1)
+                - std::max(y - radius, 0) + 1;
+
+        window = histogram<std::uint32_t>{};
+        for(int x = 0; x < std::min(radius, width); x++) {
+            window.add(columns[x]);
+        }
+        for(int x = 0; x < width; x++) {
+            if(x + radius < width) {
+                window.add(columns[x + radius]);
+            }
+            if(x - radius - 1 >= 0) {
+                window.remove(columns[x - radius - 1]);
+            }
+            const int cols = std::min(x + radius, width - 1)
+                    - std::max(x - radius, 0) + 1;
+            filtered_image(x, y) = window.select((rows * cols - 1) / 2);
+        }
+    }
+}
+
+void adaptive_median_filter(const monochrome_image& image,
+        const noise_mask& mask, const int max_radius,
+        monochrome_image& filtered_image)
+{
+    TRACE_SCOPE("adaptive median");
+    ASSERT(max_radius > 0, "the window must have a radius");
+    ASSERT(mask.width() == image.width() && mask.height() == image.height(),
+            "mask and image dimensions differ");
+
+    const int width = image.width();
+    const int height = image.height();
+    filtered_image.resize(width, height);
+    filtered_image.data() = image.data();
+
+    std::vector<monochrome_image::value_type> clean;
+    std::vector<monochrome_image::value_type> all;
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
+            if(mask(x, y) == corruption::NONE) {
+                continue;
+            }
+
+            // the window grows ring by ring until it has clean pixels
+            clean.clear();
+            all.assign(1, image(x, y));
+            const auto add = [&] (const int xx, const int yy)
+            {
+                all.push_back(image(xx, yy));
+                if(mask(xx, yy) == corruption::NONE) {
+                    clean.push_back(image(xx, yy));
+                }
+            };
+            for(int r = 1; r <= max_radius && clean.empty(); r++) {
+                const int left = std::max(x - r, 0);
+                const int right = std::min(x + r, width - 1);
+                if(y - r >= 0) {
+                    for(int xx = left; xx <= right; xx++) {
+                        add(xx, y - r);
+                    }
+                }
+                if(y + r < height) {
+                    for(int xx = left; xx <= right; xx++) {
+                        add(xx, y + r);
+                    }
+                }
+                for(int yy = std::max(y - r + 1, 0);
+                        yy <= std::min(y + r - 1, height - 1); yy++) {
+                    if(x - r >= 0) {
+                        add(x - r, yy);
+                    }
+                    if(x + r < width) {
+                        add(x + r, yy);
+                    }
+                }
+            }
+
+            filtered_image(x, y) = median(clean.empty() ? all : clean);
+        }
+    }
+}
+
+void restore_baseline(const monochrome_image& corrupted_image,
+        const noise_mask& mask, const uwmf_parameters& parameters,
+        monochrome_image& restored_image)
+{
+    switch(parameters.algorithm) {
+    case algorithm_type::MEDIAN:
+        median_filter(corrupted_image, parameters.w, restored_image);
+        break;
+    case algorithm_type::ADAPTIVE_MEDIAN:
+        adaptive_median_filter(corrupted_image, mask, parameters.w,
+                restored_image);
+        break;
+    default: ASSERT(false, "not a baseline"); break;
+    }
+}
+
+} // uwmf
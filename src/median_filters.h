@@ -0,0 +1,38 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include "image.h"
+#include "noise_detectors.h"
+#include "uwmf.h"
+
+namespace uwmf
+{
+
+// baselines UWMF is measured against. they share the images, the noise
+// detectors and the metrics with it, so that simulations and sweeps compare
+// quality and speed under the same conditions
+
+// median of the (2 radius + 1)^2 window of every pixel, flagged or not,
+// windows are clipped at the border. the window histogram follows the
+// window from column to column by adding and removing histograms of whole
+// columns, which in turn follow the rows (Perreault and Hebert), so that a
+// pixel costs the same for every radius
+void median_filter(const monochrome_image& image, const int radius,
+        monochrome_image& filtered_image);
+
+// switching median: only the pixels flagged in mask are replaced, by the
+// median of the clean pixels in the smallest window up to max_radius that
+// has any (adaptive median). pixels without a clean pixel even there take
+// the median of the whole window
+void adaptive_median_filter(const monochrome_image& image,
+        const noise_mask& mask, const int max_radius,
+        monochrome_image& filtered_image);
+
+// restores with the baseline parameters.algorithm stands for, w is the
+// (maximum) radius of its window
+void restore_baseline(const monochrome_image& corrupted_image,
+        const noise_mask& mask, const uwmf_parameters& parameters,
+        monochrome_image& restored_image);
+
+} // uwmf
@@ -0,0 +1,175 @@
+#include "multi_window.h"
+
+#include "image.h"
+#include "math_utils.h"
+#include "noise_detectors.h"
+#include "trace.h"
+#include "utils.h"
+#include "uwmf.h"
+#include "window_moments.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace uwmf
+{
+
+multi_window_filter::multi_window_filter(std::vector<int> windows,
+        const uwmf_parameters& parameters)
+    : windows_(std::move(windows))
+    , algorithm_(parameters.algorithm)
+{
+    std::sort(windows_.begin(), windows_.end());
+    windows_.erase(std::unique(windows_.begin(), windows_.end()),
+            windows_.end());
+    ASSERT(!windows_.empty() && windows_.front() > 0,
+            "window sizes must be positive");
+
+    const int w = windows_.back();
+    weights_ = gen_minkowski_weights(w, parameters.p, parameters.k);
+
+    // as in uwmf_fft, the moments are bounded by the weights times w^2
+    const int edge_length = 2 * w + 1;
+    for(const int window: windows_) {
+        double magnitude = 0;
+        for(int dy = -window; dy <= window; dy++) {
+            for(int dx = -window; dx <= window; dx++) {
+                magnitude += weights_[(dy + w) * edge_length + dx + w]
+                        * window * window;
+            }
+        }
+        magnitudes_.push_back(magnitude);
+
+        auto window_parameters = parameters;
+        window_parameters.w = window;
+        filters_.emplace_back(window_parameters, engine_type::DIRECT);
+    }
+    unsupported_.resize(windows_.size());
+}
+
+void multi_window_filter::restore_with_mask(
+        const monochrome_image& corrupted_image, const noise_mask& mask,
+        std::vector<monochrome_image>& restored_images)
+{
+    TRACE_SCOPE("restore windows");
+    ASSERT(mask.width() == corrupted_image.width()
+            && mask.height() == corrupted_image.height(),
+            "mask and image dimensions differ");
+
+    const int width = corrupted_image.width();
+    const int height = corrupted_image.height();
+    restored_images.resize(windows_.size());
+    for(std::size_t i = 0; i < windows_.size(); i++) {
+        restored_images[i].resize(width, height);
+        restored_images[i].data() = corrupted_image.data();
+        unsupported_[i].clear();
+    }
+
+    const int w = windows_.back();
+    const int edge_length = 2 * w + 1;
+    const bool correct_bias = algorithm_ == algorithm_type::UWMF;
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
+            if(mask(x, y) == corruption::NONE) {
+                continue;
+            }
+
+            window_moments m{};
+            std::size_t clean = 0;
+            const auto add = [&] (const int dx, const int dy)
+            {
+                if(mask(x + dx, y + dy) != corruption::NONE) {
+                    return;
+                }
+                clean++;
+                const double weight =
+                        weights_[(dy + w) * edge_length + dx + w];
+                const double value = weight * corrupted_image(x + dx, y + dy);
+                m.sumwo += weight;
+                m.sumio += value;
+                if(correct_bias) {
+                    m.rw += weight * dx;
+                    m.ri += value * dx;
+                    m.tw += weight * dy;
+                    m.ti += value * dy;
+                    m.P += weight * dx * dx;
+                    m.S += weight * dy * dy;
+                    m.Q += weight * dx * dy;
+                }
+            };
+
+            // ring r holds the offsets at chessboard distance r, clipped to
+            // the image
+            std::size_t next = 0;
+            for(int r = 1; r <= w; r++) {
+                const int left = std::max(-r, -x);
+                const int right = std::min(r, width - 1 - x);
+                const int top = std::max(-r + 1, -y);
+                const int bottom = std::min(r - 1, height - 1 - y);
+                if(r <= y) {
+                    for(int dx = left; dx <= right; dx++) {
+                        add(dx, -r);
+                    }
+                }
+                for(int dy = top; dy <= bottom; dy++) {
+                    if(r <= x) {
+                        add(-r, dy);
+                    }
+                    if(r < width - x) {
+                        add(r, dy);
+                    }
+                }
+                if(r < height - y) {
+                    for(int dx = left; dx <= right; dx++) {
+                        add(dx, r);
+                    }
+                }
+
+                if(r != windows_[next]) {
+                    continue;
+                }
+                // windows the sums can't decide are left to the filter of
+                // their window as well
+                const double value = clean == 0
+                        ? std::numeric_limits<double>::quiet_NaN()
+                        : correct_bias
+                        ? corrected_mean(m, magnitudes_[next])
+                        : weighted_mean(m.sumwo, m.sumio, magnitudes_[next]);
+                if(std::isnan(value)) {
+                    unsupported_[next].push_back({static_cast<std::size_t>(x),
+                            static_cast<std::size_t>(y)});
+                }
+                else {
+                    restored_images[next](x, y) =
+                            static_cast<monochrome_image::value_type>(value);
+                }
+                next++;
+            }
+        }
+    }
+
+    // the only pixels further passes are about. they are rare unless the
+    // density is extreme, then restoring the neighbourhood of every one of
+    // them costs more than restoring the whole image once
+    const std::size_t pixels = corrupted_image.data().size();
+    for(std::size_t i = 0; i < windows_.size(); i++) {
+        const auto& unsupported = unsupported_[i];
+        const std::size_t reach = 2 * filters_[i].context_margin() + 1;
+        if(unsupported.size() * reach * reach <= pixels) {
+            for(const auto& [x, y]: unsupported) {
+                filters_[i].restore_region(corrupted_image, mask,
+                        {x, y, 1, 1}, restored_images[i]);
+            }
+            continue;
+        }
+
+        filters_[i].restore_with_mask(corrupted_image, mask, fallback_);
+        for(const auto& [x, y]: unsupported) {
+            restored_images[i](x, y) = fallback_(x, y);
+        }
+    }
+}
+
+} // uwmf
@@ -0,0 +1,66 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <vector>
+
+#include "image.h"
+#include "noise_detectors.h"
+#include "uwmf.h"
+
+namespace uwmf
+{
+
+// restores an image for several window sizes in a single traversal. the
+// weights only depend on the offset from the center, not on w, so the sums
+// the kernel needs (see window_moments) grow ring by ring from the center
+// outwards, and every window size is read off as soon as its outermost ring
+// has been added. a corrupted pixel costs one pass over the largest window
+// instead of three passes over every window. the sums are accumulated in
+// another order than in uwmf_filter, so windows their rounding could
+// change are left to the filter of their window size, as in uwmf_fft, and
+// the restored pixels are those of uwmf_filter. the cpu time of the pass
+// is split evenly between the window sizes, so simulations record its
+// timings apart from those of the engines (see result_cell)
+class multi_window_filter
+{
+public:
+    // parameters.w is ignored, every window size is restored with the
+    // other parameters
+    multi_window_filter(std::vector<int> windows,
+            const uwmf_parameters& parameters);
+
+    // sorted and without duplicates
+    const std::vector<int>& windows() const
+    {
+        return windows_;
+    }
+
+    // one restored image per window size, in the order of windows()
+    template<typename Detector>
+    void restore(const monochrome_image& corrupted_image,
+            const Detector& detector,
+            std::vector<monochrome_image>& restored_images)
+    {
+        detect_noise(corrupted_image, detector, mask_);
+        restore_with_mask(corrupted_image, mask_, restored_images);
+    }
+
+    void restore_with_mask(const monochrome_image& corrupted_image,
+            const noise_mask& mask,
+            std::vector<monochrome_image>& restored_images);
+
+private:
+    std::vector<int> windows_;
+    algorithm_type algorithm_;
+    std::vector<double> weights_; // of the largest window
+    std::vector<double> magnitudes_; // bound of the moments per window
+    // pixels without clean support or whose sums can't decide them are
+    // left to the filter of their window
+    std::vector<uwmf_filter> filters_;
+    std::vector<std::vector<basic_point2d<std::size_t>>> unsupported_;
+    monochrome_image fallback_;
+    noise_mask mask_;
+};
+
+} // uwmf
@@ -0,0 +1,277 @@
+#include "noise_detectors.h"
+
+#include "image.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cctype>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+using uwmf::corruption;
+using uwmf::monochrome_image;
+using uwmf::noise_mask;
+
+// leaves the four smallest of the eight values in d[0..3] (in no particular
+// order): both halves get sorted, then the lower half of a bitonic merge
+// keeps the smaller elements. works on scalars and on simd lanes alike
+template<typename ValueType, typename Min, typename Max>
+void select_smallest4(std::array<ValueType, 8>& d, Min min, Max max)
+{
+    const auto compare_exchange = [&] (ValueType& a, ValueType& b)
+    {
+        const ValueType lo = min(a, b);
+        b = max(a, b);
+        a = lo;
+    };
+
+    for(std::size_t o = 0; o < 8; o += 4) {
+        compare_exchange(d[o], d[o + 1]);
+        compare_exchange(d[o + 2], d[o + 3]);
+        compare_exchange(d[o], d[o + 2]);
+        compare_exchange(d[o + 1], d[o + 3]);
+        compare_exchange(d[o + 1], d[o + 2]);
+    }
+
+    for(std::size_t i = 0; i < 4; i++) {
+        d[i] = min(d[i], d[7 - i]);
+    }
+}
+
+// mirrors out-of-image coordinates without repeating the edge
+int reflect(int i, const int n)
+{
+    if(i < 0) {
+        i = -i;
+    }
+    else if(i >= n) {
+        i = 2 * n - 2 - i;
+    }
+    return std::clamp(i, 0, n - 1);
+}
+
+int road(const monochrome_image& image, const int x, const int y)
+{
+    const int width = image.width();
+    const int height = image.height();
+    const int center = image(x, y);
+
+    std::array<int, 8> d{};
+    std::size_t i = 0;
+    for(int yy = -1; yy <= 1; yy++) {
+        for(int xx = -1; xx <= 1; xx++) {
+            if(xx == 0 && yy == 0) {
+                continue;
+            }
+
+            const int neighbour =
+                    image(reflect(x + xx, width), reflect(y + yy, height));
+            d[i++] = std::abs(center - neighbour);
+        }
+    }
+
+    const auto min = [] (int a, int b) { return std::min(a, b); };
+    const auto max = [] (int a, int b) { return std::max(a, b); };
+    select_smallest4(d, min, max);
+    return d[0] + d[1] + d[2] + d[3];
+}
+
+#if defined(__SSE2__)
+// classifies the 16 pixels starting at (x, y), which must all have their
+// complete 3x3 neighbourhood within the image
+void road16(const monochrome_image& image, const std::size_t x,
+        const std::size_t y, const int threshold, unsigned char* out)
+{
+    const std::size_t width = image.width();
+    const unsigned char* row = image.data().data() + y * width + x;
+
+    const auto load = [row, width] (const int xx, const int yy)
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+                row + yy * static_cast<std::ptrdiff_t>(width) + xx));
+    };
+    const auto absdiff = [] (const __m128i a, const __m128i b)
+    {
+        return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+    };
+
+    // vector types can't be template arguments without losing attributes
+    struct lane
+    {
+        __m128i v;
+    };
+
+    const __m128i center = load(0, 0);
+    std::array<lane, 8> d = {{
+        {absdiff(center, load(-1, -1))}, {absdiff(center, load(0, -1))},
+        {absdiff(center, load(1, -1))}, {absdiff(center, load(-1, 0))},
+        {absdiff(center, load(1, 0))}, {absdiff(center, load(-1, 1))},
+        {absdiff(center, load(0, 1))}, {absdiff(center, load(1, 1))}}};
+
+    select_smallest4(d,
+            [] (lane a, lane b) { return lane{_mm_min_epu8(a.v, b.v)}; },
+            [] (lane a, lane b) { return lane{_mm_max_epu8(a.v, b.v)}; });
+
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_setzero_si128();
+    __m128i hi = _mm_setzero_si128();
+    for(std::size_t i = 0; i < 4; i++) {
+        lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(d[i].v, zero));
+        hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(d[i].v, zero));
+    }
+
+    const __m128i limit = _mm_set1_epi16(threshold);
+    const __m128i corrupted = _mm_packs_epi16(
+            _mm_cmpgt_epi16(lo, limit), _mm_cmpgt_epi16(hi, limit));
+
+    // center <= 127 -> SALT, otherwise PEPPER, see classify()
+    const __m128i low = _mm_cmpeq_epi8(
+            _mm_min_epu8(center, _mm_set1_epi8(127)), center);
+    const __m128i type = _mm_or_si128(
+            _mm_and_si128(low, _mm_set1_epi8(corruption::NONE - corruption::SALT)),
+            _mm_andnot_si128(low, _mm_set1_epi8(corruption::NONE - corruption::PEPPER)));
+    const __m128i result = _mm_sub_epi8(_mm_set1_epi8(corruption::NONE),
+            _mm_and_si128(corrupted, type));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), result);
+}
+#endif
+
+void classify_span(const unsigned char* in, unsigned char* out,
+        const std::size_t count)
+{
+    std::size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i none = _mm_set1_epi8(corruption::NONE);
+    const __m128i salt = _mm_set1_epi8(corruption::NONE - corruption::SALT);
+    const __m128i pepper =
+            _mm_set1_epi8(corruption::NONE - corruption::PEPPER);
+    const __m128i min = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi8(static_cast<char>(0xff));
+    for(; i + 16 <= count; i += 16) {
+        const __m128i pixels =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        const __m128i result = _mm_sub_epi8(_mm_sub_epi8(none,
+                _mm_and_si128(_mm_cmpeq_epi8(pixels, min), salt)),
+                _mm_and_si128(_mm_cmpeq_epi8(pixels, max), pepper));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), result);
+    }
+#endif
+
+    for(; i < count; i++) {
+        out[i] = uwmf::naive_noise_detector::classify(in[i]);
+    }
+}
+
+} // anonymous
+
+namespace uwmf
+{
+
+void naive_noise_detector::detect_rows(const monochrome_image& image,
+        const std::size_t y_begin, const std::size_t y_end,
+        noise_mask& mask) const
+{
+    ASSERT(mask.width() == image.width() && mask.height() == image.height(),
+            "mask and image dimensions differ");
+
+    // whole rows are contiguous, so they are classified as a single span
+    const std::size_t offset = y_begin * image.width();
+    classify_span(image.data().data() + offset, mask.data().data() + offset,
+            (y_end - y_begin) * image.width());
+}
+
+void naive_noise_detector::detect_region(const monochrome_image& image,
+        const rect& region, noise_mask& mask) const
+{
+    ASSERT(mask.width() == image.width() && mask.height() == image.height(),
+            "mask and image dimensions differ");
+
+    for(std::size_t y = region.y; y < region.y + region.height; y++) {
+        classify_span(&image(region.x, y), &mask(region.x, y), region.width);
+    }
+}
+
+void road_noise_detector::detect_rows(const monochrome_image& image,
+        const std::size_t y_begin, const std::size_t y_end,
+        noise_mask& mask) const
+{
+    detect_region(image, {0, y_begin, image.width(), y_end - y_begin}, mask);
+}
+
+void road_noise_detector::detect_region(const monochrome_image& image,
+        const rect& region, noise_mask& mask) const
+{
+    ASSERT(mask.width() == image.width() && mask.height() == image.height(),
+            "mask and image dimensions differ");
+
+    const std::size_t width = image.width();
+    const std::size_t height = image.height();
+    const std::size_t x_end = region.x + region.width;
+
+    for(std::size_t y = region.y; y < region.y + region.height; y++) {
+        std::size_t x = region.x;
+
+#if defined(__SSE2__)
+        if(y > 0 && y + 1 < height) {
+            if(x == 0 && x < x_end) {
+                mask(0, y) = classify(image(0, y), road(image, 0, y),
+                        threshold);
+                x = 1;
+            }
+
+            for(; x + 16 <= x_end && x + 16 < width; x += 16) {
+                road16(image, x, y, threshold, &mask(x, y));
+            }
+        }
+#endif
+
+        for(; x < x_end; x++) {
+            mask(x, y) = classify(image(x, y), road(image, x, y), threshold);
+        }
+    }
+}
+
+double estimate_density(const noise_mask& mask)
+{
+    const auto& data = mask.data();
+    if(data.empty()) {
+        return 0;
+    }
+
+    const auto clean = std::count(data.begin(), data.end(), corruption::NONE);
+    return 1 - static_cast<double>(clean) / data.size();
+}
+
+std::optional<detector_type> to_detector_type(std::string str)
+{
+    std::transform(str.begin(), str.end(), str.begin(),
+            [] (unsigned char ch) { return std::tolower(ch); });
+
+    if(str == naive_noise_detector::name) {
+        return detector_type::NAIVE;
+    }
+    else if(str == road_noise_detector::name) {
+        return detector_type::ROAD;
+    }
+
+    return std::nullopt;
+}
+
+std::string to_string(const detector_type type)
+{
+    switch(type) {
+    case detector_type::NAIVE: return naive_noise_detector::name; break;
+    case detector_type::ROAD: return road_noise_detector::name; break;
+    default: ASSERT(false, "invalid detector type"); break;
+    }
+
+    return "";
+}
+
+} // uwmf
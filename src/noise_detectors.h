@@ -0,0 +1,163 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include "image.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <string>
+#include <utility>
+
+namespace uwmf
+{
+
+enum corruption
+{
+    SALT = 0,
+    PEPPER = 1,
+    NONE
+};
+
+// corruption type of every pixel, as reported by a noise detector
+using noise_mask = basic_image<unsigned char>;
+
+// Noise detectors are policy types rather than functions, so that callers
+// are instantiated for them and the per-pixel tests get inlined. A detector
+// provides:
+//   static constexpr const char* name; // stable identifier
+//   static constexpr int halo;         // neighbourhood radius it looks at
+//   void detect_rows(const monochrome_image& image,
+//           std::size_t y_begin, std::size_t y_end, noise_mask& mask) const;
+//   void detect_region(const monochrome_image& image, const rect& region,
+//           noise_mask& mask) const;
+// detect_rows() fills rows [y_begin, y_end) of mask, detect_region() only
+// the given region. mask must already have the dimensions of image.
+
+// Naive Noise Detection
+// pixel with extreme values are considered corrupted
+struct naive_noise_detector
+{
+    static constexpr const char* name = "naive";
+    static constexpr int halo = 0;
+
+    static corruption classify(const monochrome_image::value_type pixel)
+    {
+        using value_type = monochrome_image::value_type;
+        constexpr auto min = std::numeric_limits<value_type>::min();
+        constexpr auto max = std::numeric_limits<value_type>::max();
+        return pixel == min
+                ? corruption::SALT
+                : pixel == max ? corruption::PEPPER : corruption::NONE;
+    }
+
+    std::pair<bool, corruption> operator()(
+            const monochrome_image::value_type pixel) const
+    {
+        const corruption type = classify(pixel);
+        return {type != corruption::NONE, type};
+    }
+
+    void detect_rows(const monochrome_image& image, const std::size_t y_begin,
+            const std::size_t y_end, noise_mask& mask) const;
+    void detect_region(const monochrome_image& image, const rect& region,
+            noise_mask& mask) const;
+};
+
+// Random-Valued Impulse Detection
+// rank-ordered absolute differences (ROAD): sum of the four smallest
+// absolute differences between a pixel and its eight neighbours. impulses
+// differ from most of their neighbours, so their ROAD value is large.
+// borders are handled by mirroring the image
+struct road_noise_detector
+{
+    static constexpr const char* name = "road";
+    static constexpr int halo = 1;
+    static constexpr int default_threshold = 40;
+
+    int threshold = default_threshold;
+
+    // low impulses count as salt, high ones as pepper
+    static corruption classify(const monochrome_image::value_type pixel,
+            const int road, const int threshold)
+    {
+        if(road <= threshold) {
+            return corruption::NONE;
+        }
+
+        return pixel < 128 ? corruption::SALT : corruption::PEPPER;
+    }
+
+    void detect_rows(const monochrome_image& image, const std::size_t y_begin,
+            const std::size_t y_end, noise_mask& mask) const;
+    void detect_region(const monochrome_image& image, const rect& region,
+            noise_mask& mask) const;
+};
+
+template<typename Detector>
+void detect_noise(const monochrome_image& image, const Detector& detector,
+        noise_mask& mask)
+{
+    TRACE_SCOPE("detect");
+    mask.resize(image.width(), image.height());
+    detector.detect_rows(image, 0, image.height(), mask);
+}
+
+template<typename Detector>
+noise_mask detect_noise(const monochrome_image& image,
+        const Detector& detector)
+{
+    noise_mask mask;
+    detect_noise(image, detector, mask);
+    return mask;
+}
+
+enum class detector_type
+{
+    NAIVE,
+    ROAD
+};
+
+std::optional<detector_type> to_detector_type(std::string str);
+std::string to_string(const detector_type type);
+
+struct detector_options
+{
+    detector_type type;
+    int road_threshold;
+};
+
+// instantiates func for the detector selected at runtime
+template<typename Func>
+decltype(auto) visit_detector(const detector_options& options, Func&& func)
+{
+    switch(options.type) {
+    case detector_type::ROAD:
+        return func(road_noise_detector{options.road_threshold});
+    case detector_type::NAIVE:
+    default:
+        return func(naive_noise_detector{});
+    }
+}
+
+// fraction of the pixels flagged by the detector that produced mask
+double estimate_density(const noise_mask& mask);
+
+// restored value of a pixel without a single clean pixel in its filtering
+// window, decided by the dominant corruption type within the window
+inline monochrome_image::value_type fallback_value(
+        const std::array<int, 2>& corr_count)
+{
+    using value_type = monochrome_image::value_type;
+    constexpr auto min = std::numeric_limits<value_type>::min();
+    constexpr auto max = std::numeric_limits<value_type>::max();
+    return corr_count[corruption::SALT] > corr_count[corruption::PEPPER]
+            ? min
+            : max;
+}
+
+} // uwmf
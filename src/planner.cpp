@@ -0,0 +1,387 @@
+#include "planner.h"
+
+#include "image.h"
+#include "image_utils.h"
+#include "logger.h"
+#include "noise_detectors.h"
+#include "utils.h"
+#include "uwmf.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace
+{
+
+constexpr int calibrated_windows[] = {1, 2, 3, 4, 6, 8, 12};
+constexpr std::size_t calibrated_tile_sizes[] = {32, 64, 128};
+// wide images are where the rows of a window fall out of the cache
+constexpr std::size_t calibrated_widths[] = {1024, 4096, 16384};
+constexpr std::size_t tiled_height = 64;
+constexpr double calibration_density = 0.5;
+constexpr std::uint64_t calibration_seed = 1;
+// timings are noisy, tiles have to win by a margin to be worth it
+constexpr double min_tiled_speedup = 1.05;
+// see uwmf_filter::restore_corrupted()
+constexpr std::size_t min_pixels_per_thread = 4096;
+
+constexpr uwmf::algorithm_type algorithms[] = {uwmf::algorithm_type::UWMF,
+        uwmf::algorithm_type::IBINR};
+
+std::size_t index(const uwmf::algorithm_type algorithm)
+{
+    return algorithm == uwmf::algorithm_type::UWMF ? 0 : 1;
+}
+
+// a gradient without the extreme values, which the detectors would take
+// for impulses
+uwmf::monochrome_image synthetic_image(const std::size_t width,
+        const std::size_t height)
+{
+    uwmf::monochrome_image image(width, height);
+    for(std::size_t y = 0; y < height; y++) {
+        for(std::size_t x = 0; x < width; x++) {
+            image(x, y) = 1 + (x * 7 + y * 13) % 254;
+        }
+    }
+    return image;
+}
+
+// fastest of a few runs, in ns
+template<typename Func>
+double time_ns(Func&& func)
+{
+    constexpr int runs = 3;
+    double best = std::numeric_limits<double>::max();
+    for(int i = 0; i < runs; i++) {
+        const auto t1 = std::chrono::steady_clock::now();
+        func();
+        const auto t2 = std::chrono::steady_clock::now();
+        best = std::min(best,
+                std::chrono::duration<double, std::nano>(t2 - t1).count());
+    }
+    return best;
+}
+
+struct calibration_image
+{
+    uwmf::monochrome_image image;
+    uwmf::noise_mask mask;
+    std::size_t corrupted;
+};
+
+calibration_image make_calibration_image(const std::size_t width,
+        const std::size_t height)
+{
+    calibration_image c;
+    c.image = uwmf::fvin(synthetic_image(width, height), calibration_density,
+            calibration_seed);
+    c.mask = uwmf::detect_noise(c.image, uwmf::naive_noise_detector{});
+    c.corrupted = std::max<std::size_t>(1, static_cast<std::size_t>(
+            uwmf::estimate_density(c.mask) * width * height + 0.5));
+    return c;
+}
+
+double time_rows(const calibration_image& c, const uwmf::uwmf_parameters& p,
+        const uwmf::engine_type engine)
+{
+    uwmf::uwmf_filter filter(p, engine);
+    uwmf::monochrome_image restored_image;
+    return time_ns(
+            [&]
+            {
+                filter.restore_with_mask(c.image, c.mask, restored_image);
+            });
+}
+
+// whether the fft engine restores the pixels of direct evaluation
+bool fft_exact(const calibration_image& c, const uwmf::uwmf_parameters& p)
+{
+    uwmf::monochrome_image direct;
+    uwmf::monochrome_image fft;
+    uwmf::uwmf_filter(p, uwmf::engine_type::DIRECT).restore_with_mask(
+            c.image, c.mask, direct);
+    uwmf::uwmf_filter(p, uwmf::engine_type::FFT).restore_with_mask(
+            c.image, c.mask, fft);
+    return direct.data() == fft.data();
+}
+
+double time_tiles(const calibration_image& c, const uwmf::uwmf_parameters& p,
+        const std::size_t tile_size)
+{
+    uwmf::uwmf_filter filter(p, uwmf::engine_type::DIRECT);
+    uwmf::monochrome_image restored_image;
+    return time_ns(
+            [&]
+            {
+                filter.restore_tiled_with_mask(c.image, c.mask, tile_size,
+                        restored_image);
+            });
+}
+
+} // anonymous
+
+namespace uwmf
+{
+
+cost_model cost_model::calibrate()
+{
+    cost_model model;
+    model.fft_exact_ = true;
+
+    const auto square = make_calibration_image(256, 256);
+    const double pixels = square.image.width() * square.image.height();
+    for(const auto algorithm: algorithms) {
+        auto& kernels = model.kernels_[index(algorithm)];
+        for(const int w: calibrated_windows) {
+            const uwmf_parameters p{w, 1, 4, 1, algorithm};
+            const double direct = time_rows(square, p, engine_type::DIRECT);
+            const double fft = time_rows(square, p, engine_type::FFT);
+            kernels.push_back({w, direct / square.corrupted, fft / pixels});
+            if(!fft_exact(square, p)) {
+                LOGW() << to_string(algorithm) << " w = " << w
+                        << ": fft restores other pixels than direct "
+                        "evaluation, it is never planned";
+                model.fft_exact_ = false;
+            }
+            LOGD() << to_string(algorithm) << " w = " << w << ": direct "
+                    << kernels.back().direct_ns << " ns, fft "
+                    << kernels.back().fft_ns << " ns";
+        }
+
+        model.lut_ns_[index(algorithm)] = time_rows(square,
+                {1, 1, 4, 1, algorithm}, engine_type::LUT) / square.corrupted;
+    }
+
+    // the tile size is picked on the widest image, the others tell from
+    // which width on it pays off
+    const uwmf_parameters p{2, 1, 4, 1, algorithm_type::UWMF};
+    std::vector<calibration_image> wide;
+    for(const std::size_t width: calibrated_widths) {
+        wide.push_back(make_calibration_image(width, tiled_height));
+    }
+
+    const double widest_rows = time_rows(wide.back(), p, engine_type::DIRECT);
+    double best_speedup = 0;
+    std::size_t best_tile_size = 0;
+    for(const std::size_t tile_size: calibrated_tile_sizes) {
+        const double speedup =
+                widest_rows / time_tiles(wide.back(), p, tile_size);
+        LOGD() << "tile size " << tile_size << ": speedup " << speedup;
+        if(speedup > best_speedup) {
+            best_speedup = speedup;
+            best_tile_size = tile_size;
+        }
+    }
+
+    if(best_speedup >= min_tiled_speedup) {
+        for(std::size_t i = 0; i < wide.size(); i++) {
+            const double speedup = time_rows(wide[i], p, engine_type::DIRECT)
+                    / time_tiles(wide[i], p, best_tile_size);
+            if(speedup >= min_tiled_speedup) {
+                model.tile_size_ = best_tile_size;
+                model.tiled_min_width_ = calibrated_widths[i];
+                model.tiled_speedup_ = best_speedup;
+                break;
+            }
+        }
+    }
+
+    return model;
+}
+
+std::optional<cost_model> cost_model::load(const std::string& path)
+{
+    std::ifstream file(path);
+    if(!file) {
+        LOGE() << "failed to open " << path;
+        return std::nullopt;
+    }
+
+    cost_model model;
+    std::string line;
+    for(std::size_t number = 1; std::getline(file, line); number++) {
+        line.erase(std::min(line.find('#'), line.size()));
+
+        std::istringstream fields(line);
+        std::string type;
+        if(!(fields >> type)) {
+            continue; // blank line
+        }
+
+        bool valid = false;
+        if(type == "kernel") {
+            std::string algorithm;
+            kernel_costs k{};
+            valid = fields >> algorithm >> k.w >> k.direct_ns >> k.fft_ns
+                    && to_algorithm_type(algorithm)
+                    && !is_baseline(*to_algorithm_type(algorithm)) && k.w >= 1
+                    && k.direct_ns > 0 && k.fft_ns > 0;
+            if(valid) {
+                auto& kernels =
+                        model.kernels_[index(*to_algorithm_type(algorithm))];
+                valid = kernels.empty() || kernels.back().w < k.w;
+                kernels.push_back(k);
+            }
+        }
+        else if(type == "lut") {
+            std::string algorithm;
+            double ns = 0;
+            valid = fields >> algorithm >> ns && to_algorithm_type(algorithm)
+                    && !is_baseline(*to_algorithm_type(algorithm)) && ns > 0;
+            if(valid) {
+                model.lut_ns_[index(*to_algorithm_type(algorithm))] = ns;
+            }
+        }
+        else if(type == "fft") {
+            std::string exact;
+            valid = fields >> exact && (exact == "exact" || exact == "inexact");
+            model.fft_exact_ = exact == "exact";
+        }
+        else if(type == "tiles") {
+            valid = fields >> model.tile_size_ >> model.tiled_min_width_
+                    >> model.tiled_speedup_ && model.tiled_speedup_ > 0;
+        }
+
+        std::string rest;
+        if(!valid || (fields >> rest)) {
+            LOGE() << path << ":" << number << ": malformed model entry";
+            return std::nullopt;
+        }
+    }
+
+    for(const auto algorithm: algorithms) {
+        if(model.kernels_[index(algorithm)].empty()
+                || model.lut_ns_[index(algorithm)] <= 0) {
+            LOGE() << path << ": no costs for " << to_string(algorithm);
+            return std::nullopt;
+        }
+    }
+
+    return model;
+}
+
+bool cost_model::save(const std::string& path) const
+{
+    // readers never see a partially written model
+    const std::string temporary = temporary_file_name(path);
+    {
+        std::ofstream file(temporary);
+        file << "# kernel <algorithm> <w> <direct ns per corrupted pixel> "
+                "<fft ns per pixel>\n";
+        for(const auto algorithm: algorithms) {
+            for(const auto& k: kernels_[index(algorithm)]) {
+                file << "kernel " << to_string(algorithm) << " " << k.w << " "
+                        << k.direct_ns << " " << k.fft_ns << "\n";
+            }
+        }
+        file << "# lut <algorithm> <ns per corrupted pixel>\n";
+        for(const auto algorithm: algorithms) {
+            file << "lut " << to_string(algorithm) << " "
+                    << lut_ns_[index(algorithm)] << "\n";
+        }
+        file << "# fft exact|inexact, whether it restores the pixels of "
+                "direct evaluation\n";
+        file << "fft " << (fft_exact_ ? "exact" : "inexact") << "\n";
+        file << "# tiles <tile size> <min width> <speedup over rows>, "
+                "tile size 0 never tiles\n";
+        file << "tiles " << tile_size_ << " " << tiled_min_width_ << " "
+                << tiled_speedup_ << "\n";
+
+        if(!file.flush()) {
+            LOGE() << "failed to write " << temporary;
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+
+    if(std::rename(temporary.c_str(), path.c_str()) != 0) {
+        LOGE() << "failed to replace " << path;
+        std::remove(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+restoration_plan cost_model::plan(const noise_mask& mask,
+        const uwmf_parameters& parameters, const std::size_t threads) const
+{
+    const double pixels = static_cast<double>(mask.width()) * mask.height();
+    const double density = estimate_density(mask);
+    const double corrupted = density * pixels;
+    const auto k = costs(parameters.algorithm, parameters.w);
+
+    // only direct evaluation and the lookup table are split across threads,
+    // and only into runs of a minimum length
+    const double runs = std::clamp(
+            std::floor(corrupted / min_pixels_per_thread), 1.0,
+            static_cast<double>(std::max<std::size_t>(threads, 1)));
+    const double direct_ns = parameters.w == 1
+            ? std::min(k.direct_ns, lut_ns_[index(parameters.algorithm)])
+            : k.direct_ns;
+
+    restoration_plan plan{};
+    plan.density = density;
+    plan.engine = parameters.w == 1 && direct_ns < k.direct_ns
+            ? engine_type::LUT
+            : engine_type::DIRECT;
+    plan.estimated_ms = corrupted * direct_ns / runs * 1e-6;
+
+    // tiles are restored one after the other, each is too small to be split
+    if(tile_size_ > 0 && mask.width() >= tiled_min_width_) {
+        const double tiled_ms = corrupted * direct_ns / tiled_speedup_ * 1e-6;
+        if(tiled_ms < plan.estimated_ms) {
+            plan.tiled = true;
+            plan.tile_size = tile_size_;
+            plan.estimated_ms = tiled_ms;
+        }
+    }
+
+    // a plan must not change the restored pixels
+    const double fft_ms = pixels * k.fft_ns * 1e-6;
+    if(fft_exact_ && fft_ms < plan.estimated_ms) {
+        plan.engine = engine_type::FFT;
+        plan.tiled = false;
+        plan.tile_size = 0;
+        plan.estimated_ms = fft_ms;
+    }
+
+    return plan;
+}
+
+cost_model::kernel_costs cost_model::costs(const algorithm_type algorithm,
+        const int w) const
+{
+    const auto& kernels = kernels_[index(algorithm)];
+    ASSERT(!kernels.empty(), "no costs for the algorithm");
+
+    auto it = std::lower_bound(kernels.begin(), kernels.end(), w,
+            [] (const kernel_costs& k, const int value)
+            {
+                return k.w < value;
+            });
+    if(it == kernels.begin()) {
+        return kernels.front();
+    }
+    if(it == kernels.end()) {
+        const auto& last = kernels.back();
+        const double side = 2.0 * w + 1;
+        const double last_side = 2.0 * last.w + 1;
+        return {w, last.direct_ns * side * side / (last_side * last_side),
+                last.fft_ns};
+    }
+
+    const auto& lower = *(it - 1);
+    const auto& upper = *it;
+    const double t = static_cast<double>(w - lower.w) / (upper.w - lower.w);
+    return {w, lower.direct_ns + t * (upper.direct_ns - lower.direct_ns),
+            lower.fft_ns + t * (upper.fft_ns - lower.fft_ns)};
+}
+
+} // uwmf
@@ -0,0 +1,80 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "image.h"
+#include "noise_detectors.h"
+#include "uwmf.h"
+
+namespace uwmf
+{
+
+// how an image is to be restored, see cost_model::plan()
+struct restoration_plan
+{
+    engine_type engine;
+    bool tiled;            // tiles layout instead of rows
+    std::size_t tile_size; // of the tiles layout
+    double density;        // of the noise mask the plan was made for
+    double estimated_ms;
+};
+
+// costs of the engines on this machine. direct evaluation and the lookup
+// table pay per corrupted pixel, the fft engine per pixel of the image, so
+// which one is fastest depends on w and the density of the noise. stored
+// as text, '#' starts a comment:
+//
+//   kernel <algorithm> <w> <direct ns per corrupted pixel> <fft ns per pixel>
+//   lut <algorithm> <ns per corrupted pixel>
+//   fft exact|inexact
+//   tiles <tile size> <min width> <speedup over rows>
+class cost_model
+{
+public:
+    // times the engines on synthetic images, which takes a few seconds,
+    // and checks that fft restores them like direct evaluation. all costs
+    // are single-threaded
+    static cost_model calibrate();
+
+    // returns std::nullopt if the file can't be read or is malformed
+    static std::optional<cost_model> load(const std::string& path);
+
+    bool save(const std::string& path) const;
+
+    // cheapest engine and layout for restoring the image of mask with
+    // threads threads (see uwmf_filter)
+    restoration_plan plan(const noise_mask& mask,
+            const uwmf_parameters& parameters,
+            const std::size_t threads) const;
+
+private:
+    struct kernel_costs
+    {
+        int w;
+        double direct_ns;
+        double fft_ns;
+    };
+
+    // per algorithm, sorted by w
+    std::array<std::vector<kernel_costs>, 2> kernels_;
+    std::array<double, 2> lut_ns_{};
+    // the fft engine is only planned if it restored the pixels of direct
+    // evaluation in the calibration, models without the entry never plan it
+    bool fft_exact_ = false;
+    // the tiles layout only pays off from min_width on, if at all
+    std::size_t tile_size_ = 0; // 0 if it never does
+    std::size_t tiled_min_width_ = 0;
+    double tiled_speedup_ = 1;
+
+    // interpolated between the calibrated window sizes, beyond the largest
+    // one direct evaluation grows with the window area
+    kernel_costs costs(const algorithm_type algorithm, const int w) const;
+};
+
+} // uwmf
@@ -1,6 +1,7 @@
 #include "png_image.h"
 
 #include "logger.h"
+#include "trace.h"
 #include "../external/libpng-1.6.37/png.h"
 
 namespace uwmf
@@ -9,6 +10,7 @@ namespace uwmf
 std::optional<monochrome_png_image> read_png_image(
         const std::string& file_name)
 {
+    TRACE_SCOPE("decode png");
     png_image image{};
     image.version = PNG_IMAGE_VERSION;
 
@@ -32,6 +34,7 @@ bool write_png_image(const std::vector<unsigned char>& buffer,
         const std::size_t width, const std::size_t height,
         const std::string& file_name)
 {
+    TRACE_SCOPE("encode png");
     png_image image{};
     image.format = PNG_FORMAT_GRAY;
     image.version = PNG_IMAGE_VERSION;
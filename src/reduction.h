@@ -0,0 +1,50 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace uwmf
+{
+
+// bands shorter than this aren't worth a thread of their own
+constexpr std::size_t min_band_rows = 64;
+
+// reduces the rows [0, height) of an image: the rows are split into at most
+// threads bands of consecutive rows, map(y_begin, y_end) returns the partial
+// result of a band and the partial results are folded with
+// combine(result, partial) in the order of the bands. with exact (integer)
+// partial results the result doesn't depend on the number of threads. the
+// calling thread maps the first band itself
+template<typename Partial, typename Map, typename Combine>
+Partial reduce_rows(const std::size_t height, const std::size_t threads,
+        Map&& map, Combine&& combine)
+{
+    const std::size_t bands = std::max<std::size_t>(1,
+            std::min(threads, height / min_band_rows));
+    std::vector<Partial> partials(bands);
+    const auto band = [&] (const std::size_t i)
+    {
+        partials[i] = map(height * i / bands, height * (i + 1) / bands);
+    };
+
+    std::vector<std::thread> workers;
+    for(std::size_t i = 1; i < bands; i++) {
+        workers.emplace_back(band, i);
+    }
+    band(0);
+    for(auto& worker: workers) {
+        worker.join();
+    }
+
+    Partial result = partials.front();
+    for(std::size_t i = 1; i < bands; i++) {
+        combine(result, partials[i]);
+    }
+    return result;
+}
+
+} // uwmf
@@ -0,0 +1,390 @@
+#include "result_cache.h"
+
+#include "image.h"
+#include "logger.h"
+#include "noise_detectors.h"
+#include "tiled_file.h"
+#include "utils.h"
+#include "uwmf.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <optional>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+constexpr std::uint64_t prime1 = 0x9e3779b185ebca87;
+constexpr std::uint64_t prime2 = 0xc2b2ae3d27d4eb4f;
+// seeds the second hash of the pixels, which doesn't depend on the settings
+constexpr std::uint64_t check_seed = 0x165667b19e3779f9;
+constexpr std::size_t key_digits = 16;
+constexpr std::size_t file_tile_size = 256;
+const std::string file_extension = ".uwt";
+
+std::uint64_t rotl(const std::uint64_t value, const int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// final avalanche, every input bit affects every output bit
+std::uint64_t mix(std::uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53;
+    h ^= h >> 33;
+    return h;
+}
+
+// 32 bytes per round in four independent lanes, so that the
+// multiplications of a round overlap (the scheme of xxhash64)
+std::uint64_t hash_bytes(const unsigned char* data, const std::size_t size,
+        const std::uint64_t seed)
+{
+    std::array<std::uint64_t, 4> lanes =
+            {seed + prime1 + prime2, seed + prime2, seed, seed - prime1};
+    const auto round = [] (const std::uint64_t lane, const std::uint64_t word)
+    {
+        return rotl(lane + word * prime2, 31) * prime1;
+    };
+
+    std::size_t i = 0;
+    for(; i + 4 * sizeof(std::uint64_t) <= size;
+            i += 4 * sizeof(std::uint64_t)) {
+        for(std::size_t l = 0; l < lanes.size(); l++) {
+            std::uint64_t word;
+            std::memcpy(&word, data + i + l * sizeof(word), sizeof(word));
+            lanes[l] = round(lanes[l], word);
+        }
+    }
+
+    std::uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7)
+            + rotl(lanes[2], 12) + rotl(lanes[3], 18) + size;
+    for(; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)) {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        h = rotl(h ^ round(0, word), 27) * prime1 + prime2;
+    }
+    for(; i < size; i++) {
+        h = rotl(h ^ (data[i] * prime1), 11) * prime2;
+    }
+
+    return mix(h);
+}
+
+std::optional<std::uint64_t> parse_key(const std::string& str)
+{
+    if(str.size() != key_digits) {
+        return std::nullopt;
+    }
+
+    char* end = nullptr;
+    const auto key = std::strtoull(str.c_str(), &end, 16);
+    if(end != str.c_str() + str.size()) {
+        return std::nullopt;
+    }
+    return key;
+}
+
+} // anonymous
+
+namespace uwmf
+{
+
+std::unique_ptr<result_cache> result_cache::open(
+        const result_cache_options& options)
+{
+    std::error_code error;
+    fs::create_directories(options.directory, error);
+    if(error) {
+        LOGE() << "failed to create " << options.directory << ": "
+                << error.message();
+        return nullptr;
+    }
+
+    // files of earlier runs, most recently used first
+    std::vector<std::pair<fs::file_time_type, disk_entry>> files;
+    for(const auto& file: fs::directory_iterator(options.directory, error)) {
+        const auto& path = file.path();
+        const auto key = parse_key(path.stem().string());
+        if(!file.is_regular_file(error) || path.extension() != file_extension
+                || !key) {
+            continue;
+        }
+
+        const auto size = file.file_size(error);
+        const auto time = file.last_write_time(error);
+        if(!error) {
+            files.push_back({time, {*key, size}});
+        }
+    }
+    if(error) {
+        LOGE() << "failed to read " << options.directory << ": "
+                << error.message();
+        return nullptr;
+    }
+
+    std::sort(files.begin(), files.end(),
+            [] (const auto& lhs, const auto& rhs)
+            {
+                return lhs.first > rhs.first;
+            });
+
+    std::unique_ptr<result_cache> cache(new result_cache(options));
+    for(const auto& [time, entry]: files) {
+        cache->disk_.entries.push_back(entry);
+        cache->disk_.index[entry.key] = std::prev(cache->disk_.entries.end());
+        cache->disk_.size += entry.size;
+    }
+    cache->evict_disk();
+
+    LOGD() << "result cache " << options.directory << ": "
+            << cache->disk_.entries.size() << " entries, "
+            << cache->disk_.size << " bytes";
+    return cache;
+}
+
+result_cache::result_cache(const result_cache_options& options)
+    : options_(options)
+{
+}
+
+result_cache::key_type result_cache::key(
+        const monochrome_image& corrupted_image,
+        const uwmf_parameters& parameters, const engine_type engine,
+        const detector_options& detector)
+{
+    // everything that affects the restored pixels seeds the pixel hash
+    const std::array<std::uint64_t, 10> settings = {
+            corrupted_image.width(),
+            corrupted_image.height(),
+            static_cast<std::uint64_t>(parameters.w),
+            static_cast<std::uint64_t>(parameters.p),
+            static_cast<std::uint64_t>(parameters.k),
+            static_cast<std::uint64_t>(parameters.passes),
+            static_cast<std::uint64_t>(parameters.algorithm),
+            static_cast<std::uint64_t>(engine),
+            static_cast<std::uint64_t>(detector.type),
+            static_cast<std::uint64_t>(detector.road_threshold)};
+    const std::uint64_t seed = hash_bytes(
+            reinterpret_cast<const unsigned char*>(settings.data()),
+            sizeof(settings), 0);
+
+    key_type key;
+    key.hash = hash_bytes(corrupted_image.data().data(),
+            corrupted_image.data().size(), seed);
+
+    std::ostringstream description;
+    description << "uwmf-cache " << std::hex
+            << hash_bytes(corrupted_image.data().data(),
+                    corrupted_image.data().size(), check_seed) << std::dec;
+    for(const std::uint64_t setting: settings) {
+        description << " " << setting;
+    }
+    key.description = description.str();
+    return key;
+}
+
+bool result_cache::lookup(const key_type& key,
+        monochrome_image& restored_image)
+{
+    bool indexed = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(auto it = memory_.index.find(key.hash);
+                it != memory_.index.end()) {
+            // a colliding hash, the entry is kept for its own input
+            if(it->second->description != key.description) {
+                misses_++;
+                return false;
+            }
+            memory_.entries.splice(memory_.entries.begin(), memory_.entries,
+                    it->second);
+            restored_image = it->second->image;
+            hits_++;
+            return true;
+        }
+
+        // entries without a size are still being written
+        auto it = disk_.index.find(key.hash);
+        if(it != disk_.index.end()) {
+            if(it->second->size == 0) {
+                misses_++;
+                return false;
+            }
+            disk_.entries.splice(disk_.entries.begin(), disk_.entries,
+                    it->second);
+        }
+        else {
+            indexed = false;
+        }
+    }
+
+    // files are read outside of the lock, another thread or process may
+    // have evicted it by now
+    const std::string path = file_name(key.hash);
+    std::error_code error;
+    if(!indexed) {
+        // other processes sharing the directory store entries after open()
+        // has indexed it, their files only appear complete (see store())
+        const auto size = fs::file_size(path, error);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(error || size == 0) {
+            misses_++;
+            return false;
+        }
+        if(disk_.index.count(key.hash) == 0) {
+            disk_.entries.push_front({key.hash, size});
+            disk_.index[key.hash] = disk_.entries.begin();
+            disk_.size += size;
+        }
+    }
+
+    std::optional<tiled_file_reader> reader;
+    if(fs::exists(path, error)) {
+        reader = tiled_file_reader::open(path);
+    }
+    // files without a readable trailer are damaged like those without
+    // readable pixels
+    std::string description;
+    const bool readable = reader && reader->read_trailer(description);
+    if(readable && description != key.description) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        misses_++;
+        return false;
+    }
+    if(!readable || !reader->read(restored_image, 1)) {
+        fs::remove(path, error);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(auto it = disk_.index.find(key.hash); it != disk_.index.end()) {
+            disk_.size -= it->second->size;
+            disk_.entries.erase(it->second);
+            disk_.index.erase(it);
+        }
+        misses_++;
+        return false;
+    }
+
+    // the modification time keeps track of use across runs
+    fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    insert_memory(key, restored_image);
+    hits_++;
+    return true;
+}
+
+void result_cache::store(const key_type& key,
+        const monochrome_image& restored_image)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        insert_memory(key, restored_image);
+        if(disk_.index.count(key.hash) != 0) {
+            return;
+        }
+        // claimed with size 0 while it is written, so that concurrent
+        // stores of the same result don't write the same file
+        disk_.entries.push_front({key.hash, 0});
+        disk_.index[key.hash] = disk_.entries.begin();
+    }
+
+    const std::string path = file_name(key.hash);
+    std::error_code error;
+    std::size_t size = 0;
+    if(write_tiled_file(restored_image, file_tile_size, path, 1,
+            key.description)) {
+        size = fs::file_size(path, error);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = disk_.index.find(key.hash);
+    if(it == disk_.index.end()) {
+        return;
+    }
+    if(size == 0) {
+        disk_.entries.erase(it->second);
+        disk_.index.erase(it);
+        return;
+    }
+    it->second->size = size;
+    disk_.size += size;
+    evict_disk();
+}
+
+std::uint64_t result_cache::hits() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+std::uint64_t result_cache::misses() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
+
+std::string result_cache::file_name(const hash_type key) const
+{
+    std::ostringstream name;
+    name << std::hex << std::setw(key_digits) << std::setfill('0') << key
+            << file_extension;
+    return (fs::path(options_.directory) / name.str()).string();
+}
+
+void result_cache::insert_memory(const key_type& key,
+        const monochrome_image& image)
+{
+    const std::size_t size = image.data().size();
+    if(size > options_.memory_limit) {
+        return;
+    }
+
+    // an entry with a colliding hash stays
+    if(auto it = memory_.index.find(key.hash); it != memory_.index.end()) {
+        memory_.entries.splice(memory_.entries.begin(), memory_.entries,
+                it->second);
+        return;
+    }
+
+    memory_.entries.push_front({key.hash, key.description, image});
+    memory_.index[key.hash] = memory_.entries.begin();
+    memory_.size += size;
+    while(memory_.size > options_.memory_limit) {
+        const auto& last = memory_.entries.back();
+        memory_.size -= last.image.data().size();
+        memory_.index.erase(last.key);
+        memory_.entries.pop_back();
+    }
+}
+
+void result_cache::evict_disk()
+{
+    auto it = disk_.entries.end();
+    while(disk_.size > options_.disk_limit && it != disk_.entries.begin()) {
+        --it;
+        // claimed entries are still being written, their files would be
+        // left behind
+        if(it->size == 0) {
+            continue;
+        }
+        std::error_code error;
+        fs::remove(file_name(it->key), error);
+        disk_.size -= it->size;
+        disk_.index.erase(it->key);
+        it = disk_.entries.erase(it);
+    }
+}
+
+} // uwmf
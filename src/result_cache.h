@@ -0,0 +1,108 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "image.h"
+#include "noise_detectors.h"
+#include "utils.h"
+#include "uwmf.h"
+
+namespace uwmf
+{
+
+struct result_cache_options
+{
+    std::string directory;     // created if it doesn't exist
+    std::size_t memory_limit;  // bytes of restored pixels kept in memory
+    std::size_t disk_limit;    // bytes of cache files kept in directory
+};
+
+// Restored images addressed by a hash of the corrupted pixels and
+// everything that affects the restoration, so that resubmitted images are
+// answered without running the filter. Recently used results are kept in
+// memory, all of them in the directory as tiled files (see tiled_file.h),
+// both tiers evict the least recently used entries beyond their limit.
+// Every entry also records the settings and a second hash of the pixels,
+// and lookups compare them, so that colliding hashes are misses instead of
+// wrong results. Files are written to a temporary of the writer and
+// renamed, so concurrent readers and writers, including other processes,
+// never see partial results, and lookups that miss the index check the
+// directory for entries other processes have stored since. Safe to use
+// from several threads.
+class result_cache
+{
+public:
+    struct key_type
+    {
+        std::uint64_t hash; // names the entry
+        // the settings and the second hash, stored with the entry
+        std::string description;
+    };
+
+    // returns nullptr if the directory can't be used
+    static std::unique_ptr<result_cache> open(
+            const result_cache_options& options);
+
+    DELETE_COPY_AND_ASSIGN(result_cache);
+
+    static key_type key(const monochrome_image& corrupted_image,
+            const uwmf_parameters& parameters, const engine_type engine,
+            const detector_options& detector);
+
+    // restored_image is resized as necessary
+    bool lookup(const key_type& key, monochrome_image& restored_image);
+    void store(const key_type& key, const monochrome_image& restored_image);
+
+    std::uint64_t hits() const;
+    std::uint64_t misses() const;
+
+private:
+    using hash_type = std::uint64_t;
+
+    struct memory_entry
+    {
+        hash_type key;
+        std::string description;
+        monochrome_image image;
+    };
+
+    struct disk_entry
+    {
+        hash_type key;
+        std::size_t size; // 0 while the file is written
+    };
+
+    // entries are ordered from the most to the least recently used
+    template<typename Entry>
+    struct lru_list
+    {
+        std::list<Entry> entries;
+        std::unordered_map<hash_type, typename std::list<Entry>::iterator>
+                index;
+        std::size_t size = 0;
+    };
+
+    explicit result_cache(const result_cache_options& options);
+
+    std::string file_name(const hash_type key) const;
+    void insert_memory(const key_type& key, const monochrome_image& image);
+    // removes the files of the entries evicted from the disk tier
+    void evict_disk();
+
+    result_cache_options options_;
+    mutable std::mutex mutex_;
+    lru_list<memory_entry> memory_;
+    lru_list<disk_entry> disk_;
+    std::uint64_t hits_ = 0;
+    std::uint64_t misses_ = 0;
+};
+
+} // uwmf
@@ -0,0 +1,354 @@
+#include "results_store.h"
+
+#include "logger.h"
+#include "math_utils.h"
+#include "noise_detectors.h"
+#include "utils.h"
+#include "uwmf.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+using uwmf::cell_result;
+using uwmf::result_cell;
+
+// multi-window passes restore the pixels of the engines, but their cpu
+// time is split between the window sizes, they are kept apart
+const std::string multi_window_engine = "multi";
+
+std::string engine_name(const result_cell& cell)
+{
+    return cell.multi_window ? multi_window_engine : to_string(cell.engine);
+}
+
+// everything but the seed and the repetition, cells with the same one are
+// summarised together
+std::string configuration(const result_cell& cell)
+{
+    std::ostringstream str;
+    str << std::setprecision(17) << cell.density << " "
+            << (cell.random_noise ? "random" : "fixed") << " "
+            << to_string(cell.detector.type) << " "
+            << cell.detector.road_threshold << " " << cell.parameters.w << " "
+            << cell.parameters.p << " " << cell.parameters.k << " "
+            << cell.parameters.passes << " "
+            << to_string(cell.parameters.algorithm) << " "
+            << engine_name(cell);
+    return str.str();
+}
+
+std::string key(const result_cell& cell)
+{
+    std::ostringstream str;
+    str << cell.seed << " " << cell.repetition << " " << configuration(cell)
+            << " " << cell.image;
+    return str.str();
+}
+
+// the image goes last, paths may contain spaces
+std::string to_line(const result_cell& cell, const cell_result& result)
+{
+    std::ostringstream line;
+    line << std::setprecision(17) << cell.seed << " " << cell.repetition
+            << " " << configuration(cell) << " " << result.psnr << " "
+            << result.ssim << " " << result.ief << " " << result.time_ms
+            << " " << cell.image << "\n";
+    return line.str();
+}
+
+bool to_cell(const std::string& line, result_cell& cell, cell_result& result)
+{
+    std::istringstream fields(line);
+    std::string noise;
+    std::string detector;
+    std::string algorithm;
+    std::string engine;
+    cell = {};
+    if(!(fields >> cell.seed >> cell.repetition >> cell.density >> noise
+               >> detector >> cell.detector.road_threshold
+               >> cell.parameters.w >> cell.parameters.p >> cell.parameters.k
+               >> cell.parameters.passes >> algorithm >> engine
+               >> result.psnr >> result.ssim >> result.ief >> result.time_ms)
+            || !std::getline(fields >> std::ws, cell.image)
+            || cell.image.empty()) {
+        return false;
+    }
+
+    const auto detector_type = uwmf::to_detector_type(detector);
+    const auto algorithm_type = uwmf::to_algorithm_type(algorithm);
+    cell.multi_window = engine == multi_window_engine;
+    const auto engine_type = cell.multi_window
+            ? uwmf::engine_type::AUTO
+            : uwmf::to_engine_type(engine);
+    if(!detector_type || !algorithm_type || !engine_type
+            || (noise != "fixed" && noise != "random")) {
+        return false;
+    }
+    cell.random_noise = noise == "random";
+    cell.detector.type = *detector_type;
+    cell.parameters.algorithm = *algorithm_type;
+    cell.engine = *engine_type;
+    return true;
+}
+
+// calls visit for every complete cell of the store. a torn last line is
+// left by a crash in the middle of a batch, it is cut off if truncate is
+// set and skipped otherwise (the store may belong to a running process)
+template<typename Visitor>
+bool read_cells(const std::string& path, const bool truncate,
+        Visitor&& visit)
+{
+    std::ifstream file(path, std::ios::binary);
+    if(!file) {
+        LOGE() << "failed to open " << path;
+        return false;
+    }
+    std::string content((std::istreambuf_iterator<char>(file)),
+            std::istreambuf_iterator<char>());
+    file.close();
+
+    const std::size_t end = content.find_last_of('\n') + 1;
+    if(end < content.size()) {
+        content.resize(end);
+        if(truncate) {
+            LOGW() << path << ": cutting off a partially written cell";
+            std::error_code error;
+            fs::resize_file(path, end, error);
+            if(error) {
+                LOGE() << "failed to truncate " << path << ": "
+                        << error.message();
+                return false;
+            }
+        }
+    }
+
+    std::istringstream lines(content);
+    std::string line;
+    result_cell cell;
+    cell_result result;
+    for(std::size_t number = 1; std::getline(lines, line); number++) {
+        if(line.empty() || line[0] == '#') {
+            continue;
+        }
+        if(!to_cell(line, cell, result)) {
+            LOGW() << path << ":" << number << ": malformed cell";
+            continue;
+        }
+        visit(cell, result);
+    }
+    return true;
+}
+
+// the stores of a directory are taken in the order of their names
+std::vector<std::string> store_files(const std::vector<std::string>& paths)
+{
+    std::vector<std::string> files;
+    for(const auto& path: paths) {
+        std::error_code error;
+        if(!fs::is_directory(path, error)) {
+            files.push_back(path);
+            continue;
+        }
+
+        std::vector<std::string> names;
+        for(const auto& file: fs::directory_iterator(path, error)) {
+            if(file.is_regular_file(error)) {
+                names.push_back(file.path().string());
+            }
+        }
+        std::sort(names.begin(), names.end());
+        files.insert(files.end(), names.begin(), names.end());
+    }
+    return files;
+}
+
+} // anonymous
+
+namespace uwmf
+{
+
+std::unique_ptr<results_store> results_store::open(const std::string& path)
+{
+    std::unique_ptr<results_store> store;
+    std::error_code error;
+    if(fs::exists(path, error)) {
+        std::unordered_map<std::string, cell_result> cells;
+        if(!read_cells(path, true,
+                   [&] (const result_cell& cell, const cell_result& result)
+                   {
+                       cells[key(cell)] = result;
+                   })) {
+            return nullptr;
+        }
+
+        const int fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+        if(fd < 0) {
+            LOGE() << "failed to open " << path;
+            return nullptr;
+        }
+        store.reset(new results_store(path, fd));
+        store->cells_ = std::move(cells);
+        LOGI() << path << " holds " << store->cells_.size() << " cells";
+        return store;
+    }
+
+    const int fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if(fd < 0) {
+        LOGE() << "failed to create " << path;
+        return nullptr;
+    }
+    store.reset(new results_store(path, fd));
+    return store;
+}
+
+results_store::results_store(const std::string& path, const int fd)
+    : path_(path)
+    , fd_(fd)
+{
+}
+
+results_store::~results_store()
+{
+    flush();
+    ::close(fd_);
+}
+
+void results_store::merge(const std::string& path)
+{
+    read_cells(path, false,
+            [&] (const result_cell& cell, const cell_result& result)
+            {
+                cells_.emplace(key(cell), result);
+            });
+}
+
+const cell_result* results_store::find(const result_cell& cell) const
+{
+    const auto it = cells_.find(key(cell));
+    return it != cells_.end() ? &it->second : nullptr;
+}
+
+void results_store::append(const result_cell& cell, const cell_result& result)
+{
+    if(!cells_.emplace(key(cell), result).second) {
+        return;
+    }
+
+    if(batch_.empty()) {
+        batch_start_ = clock::now();
+    }
+    batch_ += to_line(cell, result);
+    if(clock::now() - batch_start_ >= flush_interval) {
+        flush();
+    }
+}
+
+bool results_store::flush()
+{
+    if(batch_.empty()) {
+        return true;
+    }
+
+    // the batch is dropped on failure, a retry could append a torn line
+    // in the middle of the file
+    std::string batch;
+    batch.swap(batch_);
+    for(std::size_t written = 0; written < batch.size(); ) {
+        const ssize_t n = ::write(fd_, batch.data() + written,
+                batch.size() - written);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        else if(n <= 0) {
+            LOGE() << "failed to write " << path_;
+            return false;
+        }
+        written += n;
+    }
+
+    if(::fsync(fd_) != 0) {
+        LOGE() << "failed to sync " << path_;
+        return false;
+    }
+    return true;
+}
+
+bool summarise_results(const std::vector<std::string>& paths,
+        std::ostream& report)
+{
+    struct summary
+    {
+        result_cell representative;
+        double time_ms;
+        running_statistics psnr;
+        running_statistics ssim;
+        running_statistics ief;
+    };
+
+    // configurations in the order they first appear in
+    std::vector<summary> summaries;
+    std::map<std::string, std::size_t> index;
+    std::unordered_set<std::string> seen;
+    for(const auto& path: store_files(paths)) {
+        const bool read = read_cells(path, false,
+                [&] (const result_cell& cell, const cell_result& result)
+                {
+                    if(!seen.insert(key(cell)).second) {
+                        return; // also in another store
+                    }
+                    const auto [it, inserted] = index.try_emplace(
+                            configuration(cell) + " " + cell.image,
+                            summaries.size());
+                    if(inserted) {
+                        summaries.push_back({cell, 0, {}, {}, {}});
+                    }
+                    auto& s = summaries[it->second];
+                    s.time_ms += result.time_ms;
+                    s.psnr.add(result.psnr);
+                    s.ssim.add(result.ssim);
+                    s.ief.add(result.ief);
+                });
+        if(!read) {
+            return false;
+        }
+    }
+
+    report << "# image density noise detector w p k passes algorithm engine "
+            "repetitions psnr psnr-ci ssim ssim-ci ief cpu-time-ms\n";
+    for(const auto& s: summaries) {
+        const result_cell& c = s.representative;
+        const std::size_t count = s.psnr.count();
+        report << c.image << " " << c.density << " "
+                << (c.random_noise ? "random" : "fixed") << " "
+                << to_string(c.detector.type) << " " << c.parameters.w << " "
+                << c.parameters.p << " " << c.parameters.k << " "
+                << c.parameters.passes << " "
+                << to_string(c.parameters.algorithm) << " "
+                << engine_name(c) << " " << count << " "
+                << s.psnr.mean() << " " << s.psnr.half_width() << " "
+                << s.ssim.mean() << " " << s.ssim.half_width() << " "
+                << s.ief.mean() << " " << s.time_ms / count << "\n";
+    }
+
+    if(summaries.empty()) {
+        LOGW() << "no cells to summarise";
+    }
+    return static_cast<bool>(report.flush());
+}
+
+} // uwmf
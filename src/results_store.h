@@ -0,0 +1,95 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "noise_detectors.h"
+#include "utils.h"
+#include "uwmf.h"
+
+namespace uwmf
+{
+
+// one restoration of one corrupted copy of an image, the unit simulations
+// and sweeps resume from
+struct result_cell
+{
+    std::string image;
+    double density;
+    bool random_noise;
+    detector_options detector;
+    uwmf_parameters parameters;
+    engine_type engine;
+    std::uint64_t seed;     // of the first repetition
+    std::size_t repetition; // corrupted with seed + repetition
+    // restored for several window sizes at once (see multi_window.h), the
+    // engine doesn't apply then and the timings are shares of one pass
+    bool multi_window = false;
+};
+
+struct cell_result
+{
+    double psnr;
+    double ssim;
+    double ief;
+    double time_ms;
+};
+
+// Append-only file of completed cells, one line each. Cells are buffered
+// and written and fsync'd in batches at most a second apart, so a killed
+// run loses about a second of work; a line torn by the crash is cut off
+// when the store is opened again. Runs look up the cells they would
+// compute and skip those that are already complete.
+class results_store
+{
+public:
+    // creates the file if it doesn't exist, returns nullptr if it can't be
+    // opened for appending
+    static std::unique_ptr<results_store> open(const std::string& path);
+
+    DELETE_COPY_AND_ASSIGN(results_store);
+
+    ~results_store();
+
+    // makes the cells of another store known as well, e.g. those of the
+    // other workers of a sweep. they are never written to this one
+    void merge(const std::string& path);
+
+    // nullptr if the cell isn't complete
+    const cell_result* find(const result_cell& cell) const;
+
+    // flushes the batch once it is a second old
+    void append(const result_cell& cell, const cell_result& result);
+
+    // writes the buffered cells, they are on disk once it returns true
+    bool flush();
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::seconds flush_interval{1};
+
+    results_store(const std::string& path, const int fd);
+
+    std::string path_;
+    int fd_;
+    clock::time_point batch_start_;
+    std::unordered_map<std::string, cell_result> cells_;
+    std::string batch_;
+};
+
+// aggregates the cells of the stores, or of all stores in a directory,
+// into one report line per configuration. cells found in several stores
+// are counted once
+bool summarise_results(const std::vector<std::string>& paths,
+        std::ostream& report);
+
+} // uwmf
@@ -0,0 +1,484 @@
+#include "server.h"
+
+#include "async_restore.h"
+#include "image.h"
+#include "image_utils.h"
+#include "ipc.h"
+#include "logger.h"
+#include "noise_detectors.h"
+#include "result_cache.h"
+#include "server_protocol.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "uwmf.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace
+{
+
+using uwmf::algorithm_type;
+using uwmf::monochrome_image;
+using uwmf::request_message;
+using uwmf::request_type;
+using uwmf::response_message;
+using uwmf::response_status;
+using uwmf::server_stats;
+using uwmf::shared_buffer;
+using uwmf::unix_socket;
+using uwmf::uwmf_filter;
+using uwmf::uwmf_parameters;
+using clock_type = std::chrono::steady_clock;
+
+int signal_pipe[2] = {-1, -1};
+
+void on_signal(int)
+{
+    const char byte = 0;
+    [[maybe_unused]] const auto result = ::write(signal_pipe[1], &byte, 1);
+}
+
+struct connection
+{
+    unix_socket socket;
+    // the message being received, the poll loop never waits for the rest
+    // of it, so that a slow client doesn't hold up the others
+    request_message request{};
+    std::size_t received = 0;
+    int passed_fd = -1;
+    std::mutex send_mutex;
+    // cancels the jobs of the connection once it is gone, nobody is left to
+    // take their results
+    uwmf::cancellation_token closed;
+
+    bool respond(const response_message& response)
+    {
+        std::lock_guard<std::mutex> lock(send_mutex);
+        return socket.send(&response, sizeof(response));
+    }
+};
+
+struct job
+{
+    std::shared_ptr<connection> conn;
+    request_message request;
+    shared_buffer buffer;
+    clock_type::time_point received;
+};
+
+// keeps the most recent latency samples around for percentile queries
+class latency_tracker
+{
+public:
+    void record(const double latency_ms)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(samples_.size() < max_samples) {
+            samples_.push_back(latency_ms);
+        }
+        else {
+            samples_[next_] = latency_ms;
+        }
+        next_ = (next_ + 1) % max_samples;
+    }
+
+    void percentiles(server_stats& stats) const
+    {
+        std::vector<double> samples;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            samples = samples_;
+        }
+
+        if(samples.empty()) {
+            return;
+        }
+
+        std::sort(samples.begin(), samples.end());
+        const auto at = [&samples] (const double percentile)
+        {
+            const std::size_t index = percentile * (samples.size() - 1);
+            return samples[index];
+        };
+        stats.latency_p50_ms = at(0.5);
+        stats.latency_p90_ms = at(0.9);
+        stats.latency_p99_ms = at(0.99);
+    }
+
+private:
+    static constexpr std::size_t max_samples = 4096;
+
+    mutable std::mutex mutex_;
+    std::vector<double> samples_;
+    std::size_t next_ = 0;
+};
+
+// filters stay warm per worker thread, so their weight tables and scratch
+// buffers survive between jobs with the same parameters
+class filter_cache
+{
+public:
+    uwmf_filter& get(const uwmf_parameters parameters)
+    {
+        auto it = std::find_if(filters_.begin(), filters_.end(),
+                [&parameters] (const uwmf_filter& filter)
+                {
+                    return filter.parameters() == parameters;
+                });
+        if(it != filters_.end()) {
+            return *it;
+        }
+
+        if(filters_.size() == capacity) {
+            filters_.erase(filters_.begin());
+        }
+        return filters_.emplace_back(parameters);
+    }
+
+private:
+    static constexpr std::size_t capacity = 8;
+
+    std::vector<uwmf_filter> filters_;
+};
+
+bool is_valid(const request_message& request, const shared_buffer& buffer)
+{
+    // the product of two 32-bit values can't overflow 64 bits
+    const std::uint64_t pixels =
+            static_cast<std::uint64_t>(request.width) * request.height;
+    return pixels > 0 && pixels <= uwmf::max_server_pixels
+            && request.w > 0 && request.w <= uwmf::max_server_window_size
+            && request.p > 0 && request.k >= 0
+            && request.algorithm
+                    <= static_cast<std::uint32_t>(algorithm_type::IBINR)
+            && buffer.size() >= uwmf::shared_buffer_size(
+                    request.width, request.height);
+}
+
+class restoration_server
+{
+public:
+    restoration_server(unix_socket listener,
+            std::unique_ptr<uwmf::result_cache> cache,
+            const uwmf::server_options& options)
+        : listener_(std::move(listener))
+        , cache_(std::move(cache))
+        , completed_(0)
+        , failed_(0)
+        , cancelled_(0)
+        , rejected_(0)
+        , in_flight_(0)
+        , running_(false)
+        , pool_(options.threads, options.queue_capacity)
+    {
+    }
+
+    DELETE_COPY_AND_ASSIGN(restoration_server);
+
+    void run()
+    {
+        running_ = true;
+        while(running_) {
+            std::vector<pollfd> fds;
+            fds.push_back({signal_pipe[0], POLLIN, 0});
+            fds.push_back({listener_.fd(), POLLIN, 0});
+            for(const auto& conn: connections_) {
+                fds.push_back({conn->socket.fd(), POLLIN, 0});
+            }
+
+            if(::poll(fds.data(), fds.size(), -1) == -1) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                LOGE() << "poll failed: " << std::strerror(errno);
+                break;
+            }
+
+            if(fds[0].revents != 0) {
+                LOGI() << "interrupted, shutting down";
+                break;
+            }
+
+            std::vector<std::shared_ptr<connection>> alive;
+            for(std::size_t i = 0; i < connections_.size(); i++) {
+                if(fds[i + 2].revents == 0 || handle(connections_[i])) {
+                    alive.push_back(connections_[i]);
+                }
+                else {
+                    connections_[i]->closed.cancel();
+                }
+            }
+            connections_ = std::move(alive);
+
+            if(fds[1].revents & POLLIN) {
+                if(auto socket = listener_.accept()) {
+                    auto conn = std::make_shared<connection>();
+                    conn->socket = std::move(*socket);
+                    connections_.push_back(std::move(conn));
+                }
+            }
+        }
+
+        for(const auto& conn: connections_) {
+            conn->closed.cancel();
+            if(conn->passed_fd != -1) {
+                ::close(conn->passed_fd);
+            }
+        }
+        connections_.clear();
+    }
+
+private:
+    unix_socket listener_;
+    std::vector<std::shared_ptr<connection>> connections_;
+    std::unique_ptr<uwmf::result_cache> cache_;
+    std::atomic<std::uint64_t> completed_;
+    std::atomic<std::uint64_t> failed_;
+    std::atomic<std::uint64_t> cancelled_;
+    std::atomic<std::uint64_t> rejected_;
+    std::atomic<std::uint32_t> in_flight_;
+    latency_tracker latencies_;
+    bool running_;
+    // declared last so that workers are joined before anything they use
+    // goes away
+    uwmf::thread_pool pool_;
+
+    // returns false if the connection should be dropped
+    bool handle(const std::shared_ptr<connection>& conn)
+    {
+        if(!conn->socket.receive_available(&conn->request,
+                sizeof(conn->request), conn->received, conn->passed_fd)) {
+            if(conn->passed_fd != -1) {
+                ::close(conn->passed_fd);
+                conn->passed_fd = -1;
+            }
+            return false;
+        }
+        if(conn->received < sizeof(conn->request)) {
+            return true;
+        }
+
+        const request_message request = conn->request;
+        const int fd = std::exchange(conn->passed_fd, -1);
+        conn->received = 0;
+
+        response_message response{};
+        response.id = request.id;
+        response.status = response_status::OK;
+
+        if(request.type == request_type::RESTORE && fd != -1) {
+            return enqueue(conn, request, fd);
+        }
+
+        if(fd != -1) {
+            ::close(fd);
+        }
+
+        switch(request.type) {
+        case request_type::STATS:
+            response.stats = stats();
+            break;
+        case request_type::SHUTDOWN:
+            LOGI() << "shutdown requested";
+            running_ = false;
+            break;
+        default:
+            response.status = response_status::FAILED;
+            break;
+        }
+
+        return conn->respond(response);
+    }
+
+    bool enqueue(const std::shared_ptr<connection>& conn,
+            const request_message& request, const int fd)
+    {
+        const auto received = clock_type::now();
+        auto buffer = shared_buffer::map(fd);
+        if(!buffer || !is_valid(request, *buffer)) {
+            LOGW() << "rejecting invalid restoration request";
+            failed_++;
+            response_message response{};
+            response.id = request.id;
+            response.status = response_status::FAILED;
+            return conn->respond(response);
+        }
+
+        // the poll loop must not wait for a free slot in the queue
+        in_flight_++;
+        auto j = std::make_shared<job>(
+                job{conn, request, std::move(*buffer), received});
+        if(!pool_.try_submit([this, j] { process(*j); })) {
+            in_flight_--;
+            rejected_++;
+            response_message response{};
+            response.id = request.id;
+            response.status = response_status::BUSY;
+            return conn->respond(response);
+        }
+        return true;
+    }
+
+    void process(job& j)
+    {
+        // a job that fails, e.g. to allocate its images, is answered as
+        // such, it must not take the server and the other jobs down
+        try {
+            restore(j);
+        }
+        catch(const std::exception& e) {
+            LOGE() << "job " << j.request.id << " failed: " << e.what();
+            failed_++;
+            in_flight_--;
+
+            response_message response{};
+            response.id = j.request.id;
+            response.status = response_status::FAILED;
+            j.conn->respond(response);
+        }
+    }
+
+    void restore(job& j)
+    {
+        thread_local filter_cache filters;
+        thread_local monochrome_image corrupted_image;
+        thread_local monochrome_image restored_image;
+        thread_local uwmf::noise_mask mask;
+        TRACE_SCOPE("server job");
+
+        const auto& request = j.request;
+        uwmf::restore_control control;
+        control.token = j.conn->closed;
+        if(control.token.cancelled()) {
+            cancel(j);
+            return;
+        }
+
+        const std::size_t size =
+                static_cast<std::size_t>(request.width) * request.height;
+
+        corrupted_image.resize(request.width, request.height);
+        std::memcpy(corrupted_image.data().data(), j.buffer.data(), size);
+
+        // resubmitted images are answered from the cache
+        const uwmf_parameters parameters{request.w, request.p, request.k, 1,
+                static_cast<algorithm_type>(request.algorithm)};
+        uwmf::result_cache::key_type key;
+        if(cache_) {
+            key = uwmf::result_cache::key(corrupted_image, parameters,
+                    uwmf::engine_type::AUTO,
+                    {uwmf::detector_type::NAIVE, 0});
+        }
+        if(!cache_ || !cache_->lookup(key, restored_image)) {
+            auto& filter = filters.get(parameters);
+            uwmf::detect_noise(corrupted_image, uwmf::naive_noise_detector{},
+                    mask);
+            if(!uwmf::restore_cancellable(filter, corrupted_image, mask,
+                    control, restored_image)) {
+                cancel(j);
+                return;
+            }
+            if(cache_) {
+                cache_->store(key, restored_image);
+            }
+        }
+        std::memcpy(j.buffer.data() + size, restored_image.data().data(),
+                size);
+
+        const double latency_ms = std::chrono::duration<double, std::milli>(
+                clock_type::now() - j.received).count();
+        latencies_.record(latency_ms);
+        LOGD() << "job " << request.id << " (" << request.width << "x"
+                << request.height << ") done in " << latency_ms << " ms";
+        completed_++;
+        in_flight_--;
+
+        response_message response{};
+        response.id = request.id;
+        response.status = response_status::OK;
+        j.conn->respond(response);
+    }
+
+    void cancel(const job& j)
+    {
+        cancelled_++;
+        in_flight_--;
+        LOGD() << "job " << j.request.id << " cancelled, its client is gone";
+    }
+
+    server_stats stats() const
+    {
+        server_stats s{};
+        s.completed_jobs = completed_;
+        s.failed_jobs = failed_;
+        s.cancelled_jobs = cancelled_;
+        s.rejected_jobs = rejected_;
+        s.cache_hits = cache_ ? cache_->hits() : 0;
+        s.workers = pool_.size();
+        s.queue_depth = pool_.pending();
+        s.in_flight = in_flight_;
+        latencies_.percentiles(s);
+        return s;
+    }
+};
+
+} // anonymous
+
+namespace uwmf
+{
+
+bool serve(const server_options& options)
+{
+    std::unique_ptr<result_cache> cache;
+    if(!options.cache.directory.empty()) {
+        cache = result_cache::open(options.cache);
+        if(!cache) {
+            return false;
+        }
+    }
+
+    auto listener = unix_socket::listen(options.socket_path, 64);
+    if(!listener) {
+        return false;
+    }
+
+    if(::pipe2(signal_pipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+        LOGE() << "failed to create signal pipe: " << std::strerror(errno);
+        return false;
+    }
+
+    auto prev_int = std::signal(SIGINT, on_signal);
+    auto prev_term = std::signal(SIGTERM, on_signal);
+
+    {
+        restoration_server server(std::move(*listener), std::move(cache),
+                options);
+        LOGI() << "listening on " << options.socket_path << " with "
+                << options.threads << " worker(s)";
+        server.run();
+    }
+
+    std::signal(SIGINT, prev_int);
+    std::signal(SIGTERM, prev_term);
+    ::close(signal_pipe[0]);
+    ::close(signal_pipe[1]);
+    signal_pipe[0] = signal_pipe[1] = -1;
+    ::unlink(options.socket_path.c_str());
+    return true;
+}
+
+} // uwmf
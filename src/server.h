@@ -0,0 +1,26 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "result_cache.h"
+
+namespace uwmf
+{
+
+struct server_options
+{
+    std::string socket_path;
+    std::size_t threads;
+    std::size_t queue_capacity;
+    result_cache_options cache; // no result cache without a directory
+};
+
+// serves restoration requests (see server_protocol.h) until a SHUTDOWN
+// request, SIGINT or SIGTERM is received. returns false if the server could
+// not be started
+bool serve(const server_options& options);
+
+} // uwmf
@@ -0,0 +1,78 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace uwmf
+{
+
+// requests and responses are fixed-size messages exchanged over a unix
+// domain stream socket. RESTORE requests carry a memfd holding the corrupted
+// image followed by room for the restored image (see shared_buffer_size()),
+// so pixel data never travels over the socket itself
+
+enum class request_type: std::uint32_t
+{
+    RESTORE = 0,
+    STATS,
+    SHUTDOWN
+};
+
+struct request_message
+{
+    request_type type;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::int32_t w;
+    std::int32_t p;
+    std::int32_t k;
+    std::uint32_t algorithm; // algorithm_type
+    std::uint64_t id;
+};
+
+enum class response_status: std::uint32_t
+{
+    OK = 0,
+    FAILED,
+    BUSY // the queue is full, the request can be sent again later
+};
+
+// largest filtering window size a server restores with, the weight table
+// of every worker grows with its square
+constexpr std::int32_t max_server_window_size = 64;
+
+// largest image a server restores, 16384 x 16384 pixels. every worker keeps
+// a few images of that size around
+constexpr std::uint64_t max_server_pixels = std::uint64_t{1} << 28;
+
+struct server_stats
+{
+    std::uint64_t completed_jobs;
+    std::uint64_t failed_jobs;
+    std::uint64_t cancelled_jobs; // dropped because the client went away
+    std::uint64_t rejected_jobs;  // answered with BUSY
+    std::uint64_t cache_hits;  // completed jobs answered from the cache
+    std::uint32_t workers;
+    std::uint32_t queue_depth; // jobs waiting for a worker
+    std::uint32_t in_flight;   // jobs received but not answered yet
+    double latency_p50_ms;
+    double latency_p90_ms;
+    double latency_p99_ms;
+};
+
+struct response_message
+{
+    response_status status;
+    std::uint64_t id;
+    server_stats stats; // only filled in for STATS requests
+};
+
+inline std::size_t shared_buffer_size(const std::size_t width,
+        const std::size_t height)
+{
+    return width * height * 2;
+}
+
+} // uwmf
@@ -0,0 +1,454 @@
+#include "stream.h"
+
+#include "bounded_queue.h"
+#include "image.h"
+#include "logger.h"
+#include "noise_detectors.h"
+#include "trace.h"
+#include "uwmf.h"
+
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+using uwmf::monochrome_image;
+
+enum class stream_format
+{
+    Y4M,
+    PGM
+};
+
+struct stream_header
+{
+    stream_format format;
+    std::string y4m_header; // verbatim header line of Y4M streams
+    std::size_t width;
+    std::size_t height;
+    std::size_t chroma_size;
+};
+
+struct frame
+{
+    monochrome_image luma;
+    std::vector<unsigned char> chroma;
+    monochrome_image restored;
+};
+
+std::optional<std::size_t> chroma_size(const std::string& colorspace,
+        const std::size_t width, const std::size_t height)
+{
+    const std::size_t half_width = (width + 1) / 2;
+    const std::size_t half_height = (height + 1) / 2;
+
+    // only 8 bit colorspaces, no 420p10 and alike
+    if(colorspace.empty() || colorspace == "420" || colorspace == "420jpeg"
+            || colorspace == "420paldv" || colorspace == "420mpeg2") {
+        return 2 * half_width * half_height;
+    }
+    else if(colorspace == "422") {
+        return 2 * half_width * height;
+    }
+    else if(colorspace == "444") {
+        return 2 * width * height;
+    }
+    else if(colorspace == "444alpha") {
+        return 3 * width * height;
+    }
+    else if(colorspace == "mono") {
+        return 0;
+    }
+
+    return std::nullopt;
+}
+
+class frame_reader
+{
+public:
+    explicit frame_reader(std::FILE* file)
+        : file_(file)
+        , failed_(false)
+    {
+    }
+
+    DELETE_COPY_AND_ASSIGN(frame_reader);
+
+    // detects the stream format and reads the stream header
+    bool open()
+    {
+        const int ch = std::getc(file_);
+        if(ch == EOF) {
+            return fail("empty stream");
+        }
+        std::ungetc(ch, file_);
+
+        if(ch == 'Y') {
+            return open_y4m();
+        }
+        else if(ch == 'P') {
+            header_.format = stream_format::PGM;
+            return true;
+        }
+
+        return fail("unrecognized stream format");
+    }
+
+    const stream_header& header() const
+    {
+        return header_;
+    }
+
+    // returns false at the end of the stream or on errors, see failed()
+    bool read(frame& f)
+    {
+        TRACE_SCOPE("decode frame");
+        if(header_.format == stream_format::Y4M) {
+            return read_y4m(f);
+        }
+
+        return read_pgm(f);
+    }
+
+    bool failed() const
+    {
+        return failed_;
+    }
+
+private:
+    std::FILE* file_;
+    stream_header header_{};
+    bool failed_;
+
+    bool fail(const char* message)
+    {
+        LOGE() << message;
+        failed_ = true;
+        return false;
+    }
+
+    bool read_line(std::string& line)
+    {
+        line.clear();
+        for(int ch = std::getc(file_); ch != '\n'; ch = std::getc(file_)) {
+            if(ch == EOF) {
+                return false;
+            }
+            line.push_back(ch);
+        }
+        return true;
+    }
+
+    bool read_bytes(unsigned char* data, const std::size_t size)
+    {
+        return std::fread(data, 1, size, file_) == size;
+    }
+
+    bool open_y4m()
+    {
+        header_.format = stream_format::Y4M;
+        if(!read_line(header_.y4m_header)) {
+            return fail("truncated y4m header");
+        }
+
+        std::istringstream tokens(header_.y4m_header);
+        std::string token;
+        tokens >> token;
+        if(token != "YUV4MPEG2") {
+            return fail("invalid y4m signature");
+        }
+
+        std::string colorspace;
+        while(tokens >> token) {
+            if(token[0] == 'W') {
+                header_.width = std::strtoul(token.c_str() + 1, nullptr, 10);
+            }
+            else if(token[0] == 'H') {
+                header_.height = std::strtoul(token.c_str() + 1, nullptr, 10);
+            }
+            else if(token[0] == 'C') {
+                colorspace = token.substr(1);
+            }
+        }
+
+        if(header_.width == 0 || header_.height == 0) {
+            return fail("missing y4m frame dimensions");
+        }
+
+        auto size = chroma_size(colorspace, header_.width, header_.height);
+        if(!size) {
+            return fail("unsupported y4m colorspace");
+        }
+        header_.chroma_size = *size;
+
+        return true;
+    }
+
+    bool read_y4m(frame& f)
+    {
+        std::string line;
+        if(!read_line(line)) {
+            if(!line.empty()) {
+                return fail("truncated y4m frame header");
+            }
+            return false;
+        }
+
+        if(line.rfind("FRAME", 0) != 0) {
+            return fail("invalid y4m frame header");
+        }
+
+        f.luma.resize(header_.width, header_.height);
+        f.chroma.resize(header_.chroma_size);
+        if(!read_bytes(f.luma.data().data(), f.luma.data().size())
+                || !read_bytes(f.chroma.data(), f.chroma.size())) {
+            return fail("truncated y4m frame");
+        }
+
+        return true;
+    }
+
+    // skips whitespace and comments, returns the first other character
+    int skip_whitespace()
+    {
+        int ch = std::getc(file_);
+        while(ch != EOF) {
+            if(ch == '#') {
+                while(ch != EOF && ch != '\n') {
+                    ch = std::getc(file_);
+                }
+            }
+            else if(!std::isspace(ch)) {
+                break;
+            }
+            ch = std::getc(file_);
+        }
+        return ch;
+    }
+
+    std::optional<std::size_t> read_number()
+    {
+        int ch = skip_whitespace();
+        if(!std::isdigit(ch)) {
+            return std::nullopt;
+        }
+
+        std::size_t value = 0;
+        while(std::isdigit(ch)) {
+            value = value * 10 + (ch - '0');
+            ch = std::getc(file_);
+        }
+
+        // a single whitespace character terminates every header field
+        if(ch != EOF && !std::isspace(ch)) {
+            std::ungetc(ch, file_);
+        }
+        return value;
+    }
+
+    bool read_pgm(frame& f)
+    {
+        const int ch = skip_whitespace();
+        if(ch == EOF) {
+            return false;
+        }
+
+        if(ch != 'P' || std::getc(file_) != '5') {
+            return fail("invalid pgm signature");
+        }
+
+        const auto width = read_number();
+        const auto height = read_number();
+        const auto max_value = read_number();
+        if(!width || !height || !max_value || *width == 0 || *height == 0) {
+            return fail("invalid pgm header");
+        }
+
+        // the detectors take 0 and 255 for impulses and the writer declares
+        // 255, other ranges would be restored and written as if they were
+        // full 8 bit ones
+        if(*max_value != 255) {
+            return fail("unsupported pgm bit depth");
+        }
+
+        f.luma.resize(*width, *height);
+        f.chroma.clear();
+        if(!read_bytes(f.luma.data().data(), f.luma.data().size())) {
+            return fail("truncated pgm frame");
+        }
+
+        return true;
+    }
+};
+
+class frame_writer
+{
+public:
+    frame_writer(std::FILE* file, const stream_header& header)
+        : file_(file)
+        , header_(header)
+        , header_written_(false)
+    {
+    }
+
+    DELETE_COPY_AND_ASSIGN(frame_writer);
+
+    bool write(const frame& f)
+    {
+        TRACE_SCOPE("encode frame");
+        const auto& image = f.restored;
+
+        if(header_.format == stream_format::Y4M) {
+            if(!header_written_) {
+                std::fprintf(file_, "%s\n", header_.y4m_header.c_str());
+                header_written_ = true;
+            }
+            std::fputs("FRAME\n", file_);
+        }
+        else {
+            // the maxval of every input frame (see read_pgm())
+            std::fprintf(file_, "P5\n%zu %zu\n255\n",
+                    image.width(), image.height());
+        }
+
+        const auto& luma = image.data();
+        if(std::fwrite(luma.data(), 1, luma.size(), file_) != luma.size()
+                || std::fwrite(f.chroma.data(), 1, f.chroma.size(), file_)
+                        != f.chroma.size()) {
+            LOGE() << "failed to write frame";
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    std::FILE* file_;
+    const stream_header& header_;
+    bool header_written_;
+};
+
+std::FILE* open_file(const std::string& name, const char* mode,
+        std::FILE* standard)
+{
+    if(name == "-") {
+        return standard;
+    }
+
+    std::FILE* file = std::fopen(name.c_str(), mode);
+    if(!file) {
+        LOGE() << "failed to open " << name;
+    }
+    return file;
+}
+
+void close_file(std::FILE* file, std::FILE* standard)
+{
+    if(file && file != standard) {
+        std::fclose(file);
+    }
+    else if(file) {
+        std::fflush(file);
+    }
+}
+
+} // anonymous
+
+namespace uwmf
+{
+
+bool restore_stream(const stream_options& options,
+        const uwmf_parameters& parameters, const detector_options& detector)
+{
+    std::FILE* input = open_file(options.input, "rb", stdin);
+    std::FILE* output = open_file(options.output, "wb", stdout);
+    if(!input || !output) {
+        close_file(input, stdin);
+        close_file(output, stdout);
+        return false;
+    }
+
+    frame_reader reader(input);
+    if(!reader.open()) {
+        close_file(input, stdin);
+        close_file(output, stdout);
+        return false;
+    }
+    frame_writer writer(output, reader.header());
+
+    const std::size_t capacity = options.queue_capacity;
+    bounded_queue<frame> decoded(capacity);
+    bounded_queue<frame> restored(capacity);
+    // every frame that is in flight can end up here at the same time
+    bounded_queue<frame> recycled(capacity * 2 + 3);
+    std::atomic<bool> failed = false;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::thread decoder(
+            [&]
+            {
+                while(true) {
+                    frame f = recycled.try_pop().value_or(frame{});
+                    if(!reader.read(f) || !decoded.push(std::move(f))) {
+                        break;
+                    }
+                }
+                failed = failed || reader.failed();
+                decoded.close();
+            });
+
+    std::thread restorer(
+            [&]
+            {
+                uwmf_filter filter(parameters);
+                while(auto f = decoded.pop()) {
+                    visit_detector(detector,
+                            [&] (const auto& d)
+                            {
+                                filter.restore(f->luma, d, f->restored);
+                            });
+                    if(!restored.push(std::move(*f))) {
+                        break;
+                    }
+                }
+                restored.close();
+            });
+
+    std::size_t frame_count = 0;
+    while(auto f = restored.pop()) {
+        if(!writer.write(*f)) {
+            failed = true;
+            decoded.close();
+            restored.close();
+            break;
+        }
+        frame_count++;
+        recycled.push(std::move(*f));
+    }
+
+    restorer.join();
+    decoder.join();
+
+    const double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    close_file(input, stdin);
+    close_file(output, stdout);
+
+    LOGI() << "frames                : " << frame_count;
+    LOGI() << "sustained fps         : "
+            << (seconds > 0 ? frame_count / seconds : 0);
+
+    return !failed;
+}
+
+} // uwmf
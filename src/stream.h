@@ -0,0 +1,29 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "noise_detectors.h"
+#include "uwmf.h"
+
+namespace uwmf
+{
+
+struct stream_options
+{
+    std::string input;  // "-" for stdin
+    std::string output; // "-" for stdout
+    std::size_t queue_capacity;
+};
+
+// restores a Y4M stream (luma plane only, chroma planes are passed through)
+// or a stream of concatenated binary PGM images (maxval 255) frame by frame.
+// decoding, restoration and encoding run in separate threads connected by
+// bounded queues, frame buffers and the filter's scratch buffers are
+// recycled between frames
+bool restore_stream(const stream_options& options,
+        const uwmf_parameters& parameters, const detector_options& detector);
+
+} // uwmf
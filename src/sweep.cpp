@@ -0,0 +1,531 @@
+#include "sweep.h"
+
+#include "image.h"
+#include "image_utils.h"
+#include "logger.h"
+#include "math_utils.h"
+#include "median_filters.h"
+#include "noise_detectors.h"
+#include "png_image.h"
+#include "results_store.h"
+#include "trace.h"
+#include "utils.h"
+#include "uwmf.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <optional>
+#include <random>
+#include <sstream>
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+using uwmf::monochrome_image;
+using uwmf::running_statistics;
+
+constexpr std::size_t id_digits = 8;
+
+struct job
+{
+    std::size_t id;
+    std::uint64_t seed; // of the first repetition of the configuration
+    std::size_t first;  // repetitions [first, first + count)
+    std::size_t count;
+    std::string image;
+    double density;
+    uwmf::uwmf_parameters parameters;
+    uwmf::engine_type engine;
+    uwmf::detector_options detector;
+    bool random_noise;
+};
+
+struct job_result
+{
+    double time_ms;
+    running_statistics psnr;
+    running_statistics ssim;
+    running_statistics ief;
+};
+
+std::string manifest_path(const std::string& directory)
+{
+    return (fs::path(directory) / "manifest").string();
+}
+
+std::string id_string(const std::size_t id)
+{
+    std::ostringstream str;
+    str << std::setw(id_digits) << std::setfill('0') << id;
+    return str.str();
+}
+
+// everything but the repetitions, jobs with the same one are merged
+std::string configuration(const job& j)
+{
+    std::ostringstream str;
+    str << j.image << " " << j.density << " " << j.parameters.w << " "
+            << j.parameters.p << " " << j.parameters.k << " "
+            << j.parameters.passes << " " << to_string(j.parameters.algorithm)
+            << " " << to_string(j.engine) << " " << to_string(j.detector.type)
+            << " " << j.detector.road_threshold << " " << j.random_noise;
+    return str.str();
+}
+
+// readers never see a partially written file
+bool write_file(const std::string& path, const std::string& content)
+{
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary);
+        file << content;
+        if(!file.flush()) {
+            LOGE() << "failed to write " << temporary;
+            return false;
+        }
+    }
+
+    if(std::rename(temporary.c_str(), path.c_str()) != 0) {
+        LOGE() << "failed to replace " << path;
+        return false;
+    }
+
+    return true;
+}
+
+// the image goes last, paths may contain spaces
+std::string to_line(const job& j)
+{
+    std::ostringstream line;
+    line << std::setprecision(17) << id_string(j.id) << " " << j.seed << " "
+            << j.first << " " << j.count << " " << j.density << " "
+            << j.parameters.w << " " << j.parameters.p << " "
+            << j.parameters.k << " " << j.parameters.passes << " "
+            << to_string(j.parameters.algorithm) << " " << to_string(j.engine)
+            << " " << (j.random_noise ? "random" : "fixed") << " "
+            << to_string(j.detector.type) << " " << j.detector.road_threshold
+            << " " << j.image << "\n";
+    return line.str();
+}
+
+std::optional<job> to_job(const std::string& line)
+{
+    std::istringstream fields(line);
+    job j{};
+    std::string algorithm;
+    std::string engine;
+    std::string noise;
+    std::string detector;
+    if(!(fields >> j.id >> j.seed >> j.first >> j.count >> j.density
+               >> j.parameters.w >> j.parameters.p >> j.parameters.k
+               >> j.parameters.passes >> algorithm >> engine >> noise
+               >> detector >> j.detector.road_threshold)
+            || !std::getline(fields >> std::ws, j.image) || j.image.empty()) {
+        return std::nullopt;
+    }
+
+    const auto algorithm_type = uwmf::to_algorithm_type(algorithm);
+    const auto engine_type = uwmf::to_engine_type(engine);
+    const auto detector_type = uwmf::to_detector_type(detector);
+    if(!algorithm_type || !engine_type || !detector_type
+            || (noise != "fixed" && noise != "random")) {
+        return std::nullopt;
+    }
+    j.parameters.algorithm = *algorithm_type;
+    j.engine = *engine_type;
+    j.detector.type = *detector_type;
+    j.random_noise = noise == "random";
+    return j;
+}
+
+// jobs are indexed by their id
+std::optional<std::vector<job>> read_manifest(const std::string& directory)
+{
+    const std::string path = manifest_path(directory);
+    std::ifstream file(path);
+    if(!file) {
+        LOGE() << "failed to open " << path;
+        return std::nullopt;
+    }
+
+    std::vector<job> jobs;
+    std::string line;
+    for(std::size_t number = 1; std::getline(file, line); number++) {
+        if(line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        const auto j = to_job(line);
+        if(!j || j->id != jobs.size()) {
+            LOGE() << path << ":" << number << ": malformed job";
+            return std::nullopt;
+        }
+        jobs.push_back(*j);
+    }
+
+    return jobs;
+}
+
+std::string to_line(const job_result& result)
+{
+    std::ostringstream str;
+    str << std::setprecision(17) << result.psnr.count() << " "
+            << result.time_ms;
+    for(const auto* s: {&result.psnr, &result.ssim, &result.ief}) {
+        str << " " << s->mean() << " " << s->m2();
+    }
+    str << "\n";
+    return str.str();
+}
+
+std::optional<job_result> read_result(const std::string& path)
+{
+    std::ifstream file(path);
+    std::size_t count = 0;
+    job_result result{};
+    if(!(file >> count >> result.time_ms)) {
+        return std::nullopt;
+    }
+    for(auto* s: {&result.psnr, &result.ssim, &result.ief}) {
+        double mean = 0;
+        double m2 = 0;
+        if(!(file >> mean >> m2)) {
+            return std::nullopt;
+        }
+        *s = {count, mean, m2};
+    }
+    return result;
+}
+
+// unique enough among the workers of a sweep
+std::string worker_name()
+{
+    std::random_device device;
+    std::ostringstream str;
+    str << std::hex << device() << device();
+    return str.str();
+}
+
+// repetitions found in the store are taken from there, the others are
+// added to it
+job_result run(const job& j, const monochrome_image& original,
+        const std::size_t threads, uwmf::results_store& store)
+{
+    job_result result{};
+    const auto add = [&result] (const uwmf::cell_result& cell)
+    {
+        result.time_ms += cell.time_ms;
+        result.psnr.add(cell.psnr);
+        result.ssim.add(cell.ssim);
+        result.ief.add(cell.ief);
+    };
+
+    std::optional<uwmf::uwmf_filter> filter;
+    if(!uwmf::is_baseline(j.parameters.algorithm)) {
+        filter.emplace(j.parameters, j.engine, threads);
+    }
+    uwmf::noise_mask mask;
+    monochrome_image restored_image;
+    for(std::size_t r = j.first; r < j.first + j.count; r++) {
+        const uwmf::result_cell cell{j.image, j.density, j.random_noise,
+                j.detector, j.parameters, j.engine, j.seed, r};
+        if(const auto* stored = store.find(cell)) {
+            add(*stored);
+            continue;
+        }
+
+        const auto corrupted_image = j.random_noise
+                ? uwmf::rvin(original, j.density, j.seed + r)
+                : uwmf::fvin(original, j.density, j.seed + r);
+
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        uwmf::visit_detector(j.detector,
+                [&] (const auto& detector)
+                {
+                    if(filter) {
+                        filter->restore(corrupted_image, detector,
+                                restored_image);
+                        return;
+                    }
+                    uwmf::detect_noise(corrupted_image, detector, mask);
+                    uwmf::restore_baseline(corrupted_image, mask,
+                            j.parameters, restored_image);
+                });
+        const auto t2 = std::chrono::high_resolution_clock::now();
+
+        const uwmf::cell_result computed{
+                uwmf::psnr(original, restored_image),
+                uwmf::ssim(original, restored_image),
+                uwmf::ief(original, restored_image, corrupted_image),
+                std::chrono::duration<double, std::milli>(t2 - t1).count()};
+        store.append(cell, computed);
+        add(computed);
+    }
+    return result;
+}
+
+// names of the pending jobs, in the order of their ids
+std::vector<std::string> pending_jobs(const std::string& directory)
+{
+    std::vector<std::string> names;
+    std::error_code error;
+    for(const auto& file: fs::directory_iterator(
+                fs::path(directory) / "pending", error)) {
+        names.push_back(file.path().filename().string());
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+} // anonymous
+
+namespace uwmf
+{
+
+bool plan_sweep(const std::string& directory, const sweep_grid& grid)
+{
+    ASSERT(grid.shard_size > 0, "jobs must have repetitions");
+
+    std::error_code error;
+    if(fs::exists(manifest_path(directory), error)) {
+        LOGE() << directory << " already holds a sweep";
+        return false;
+    }
+    for(const char* name: {"pending", "claimed", "results", "cells"}) {
+        fs::create_directories(fs::path(directory) / name, error);
+        if(error) {
+            LOGE() << "failed to create " << directory << ": "
+                    << error.message();
+            return false;
+        }
+    }
+
+    // workers may run in other directories or on other hosts
+    std::vector<std::string> images;
+    for(const auto& image: grid.images) {
+        images.push_back(fs::absolute(image, error).string());
+    }
+
+    std::mt19937_64 seeds(std::random_device{}());
+    std::vector<job> jobs;
+    for(const auto& image: images) {
+        for(const double density: grid.densities) {
+            // every configuration of an image and a density sees the same
+            // corrupted copies
+            const std::uint64_t seed = seeds();
+            for(const auto algorithm: grid.algorithms) {
+                const bool baseline = is_baseline(algorithm);
+                const auto ps = baseline
+                        ? std::vector<int>{grid.p.front()}
+                        : algorithm == algorithm_type::IBINR
+                        ? grid.ibinr_p
+                        : grid.p;
+                const auto ks = baseline
+                        ? std::vector<int>{grid.k.front()}
+                        : grid.k;
+                for(const int w: grid.w) {
+                    for(const int p: ps) {
+                        for(const int k: ks) {
+                            for(std::size_t first = 0;
+                                    first < grid.repetitions;
+                                    first += grid.shard_size) {
+                                job j{};
+                                j.id = jobs.size();
+                                j.seed = seed;
+                                j.first = first;
+                                j.count = std::min(grid.shard_size,
+                                        grid.repetitions - first);
+                                j.image = image;
+                                j.density = density;
+                                j.parameters = {w, p, k, grid.passes,
+                                        algorithm};
+                                j.engine = grid.engine;
+                                j.detector = grid.detector;
+                                j.random_noise = grid.random_noise;
+                                jobs.push_back(j);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    std::string manifest = "# id seed first count density w p k passes "
+            "algorithm engine noise detector road-threshold image\n";
+    for(const auto& j: jobs) {
+        manifest += to_line(j);
+    }
+    if(!write_file(manifest_path(directory), manifest)) {
+        return false;
+    }
+
+    // workers may start as soon as the first job is pending
+    for(const auto& j: jobs) {
+        const auto path = fs::path(directory) / "pending" / id_string(j.id);
+        if(!std::ofstream(path)) {
+            LOGE() << "failed to create " << path.string();
+            return false;
+        }
+    }
+
+    LOGI() << "planned " << jobs.size() << " jobs in " << directory;
+    return true;
+}
+
+std::optional<std::size_t> work_sweep(const std::string& directory,
+        const std::size_t threads)
+{
+    const auto jobs = read_manifest(directory);
+    if(!jobs) {
+        return std::nullopt;
+    }
+
+    const std::string worker = worker_name();
+    const fs::path root(directory);
+
+    // repetitions of jobs whose worker crashed aren't run again. every
+    // worker appends to a store of its own, filesystems shared between
+    // hosts don't make appends to a common file atomic
+    std::error_code error;
+    fs::create_directories(root / "cells", error);
+    std::vector<std::string> others;
+    for(const auto& file: fs::directory_iterator(root / "cells", error)) {
+        others.push_back(file.path().string());
+    }
+    const auto store = uwmf::results_store::open(
+            (root / "cells" / worker).string());
+    if(!store) {
+        return std::nullopt;
+    }
+    for(const auto& other: others) {
+        store->merge(other);
+    }
+
+    std::string image_name;
+    monochrome_image original;
+    std::size_t done = 0;
+    for(auto names = pending_jobs(directory); !names.empty();
+            names = pending_jobs(directory)) {
+        // workers start at different jobs, so that they rarely compete for
+        // the same one, but keep to consecutive jobs, which share images
+        const std::size_t start = std::random_device{}() % names.size();
+        for(std::size_t n = 0; n < names.size(); n++) {
+            const std::string& name = names[(start + n) % names.size()];
+            const fs::path claim = root / "claimed" / (name + "." + worker);
+            fs::rename(root / "pending" / name, claim, error);
+            if(error) {
+                continue; // claimed by another worker
+            }
+
+            char* end = nullptr;
+            const std::size_t id = std::strtoull(name.c_str(), &end, 10);
+            if(*end != '\0' || id >= jobs->size()) {
+                LOGE() << "unknown job " << name;
+                continue;
+            }
+            const job& j = (*jobs)[id];
+            TRACE_SCOPE("sweep job", id);
+
+            if(j.image != image_name) {
+                auto png = read_png_image(j.image);
+                if(!png) {
+                    continue; // the claim stays for inspection
+                }
+                original = monochrome_image(std::move(png->buffer),
+                        png->width, png->height);
+                image_name = j.image;
+            }
+
+            const job_result result = run(j, original, threads, *store);
+            if(!store->flush() || !write_file((root / "results" / name).string(),
+                       to_line(result))) {
+                continue;
+            }
+            fs::remove(claim, error);
+            done++;
+            LOGD() << "job " << name << " done";
+        }
+    }
+
+    LOGI() << "worker " << worker << " ran " << done << " jobs";
+    return done;
+}
+
+bool merge_sweep(const std::string& directory, std::ostream& report)
+{
+    const auto jobs = read_manifest(directory);
+    if(!jobs) {
+        return false;
+    }
+
+    struct summary
+    {
+        const job* representative;
+        double time_ms;
+        running_statistics psnr;
+        running_statistics ssim;
+        running_statistics ief;
+    };
+
+    // configurations in the order of the manifest
+    std::vector<summary> summaries;
+    std::map<std::string, std::size_t> index;
+    std::size_t missing = 0;
+    for(const auto& j: *jobs) {
+        const auto [it, inserted] =
+                index.try_emplace(configuration(j), summaries.size());
+        if(inserted) {
+            summaries.push_back({&j, 0, {}, {}, {}});
+        }
+
+        const auto result = read_result((fs::path(directory) / "results"
+                / id_string(j.id)).string());
+        if(!result) {
+            missing++;
+            continue;
+        }
+        auto& s = summaries[it->second];
+        s.time_ms += result->time_ms;
+        s.psnr.merge(result->psnr);
+        s.ssim.merge(result->ssim);
+        s.ief.merge(result->ief);
+    }
+
+    if(!jobs->empty()) {
+        const job& j = jobs->front();
+        report << "# passes " << j.parameters.passes << ", "
+                << (j.random_noise ? "random" : "fixed") << " noise, "
+                << to_string(j.detector.type) << " detector, "
+                << to_string(j.engine) << " engine\n";
+    }
+    report << "# image density w p k algorithm repetitions psnr psnr-ci "
+            "ssim ssim-ci ief cpu-time-ms\n";
+    for(const auto& s: summaries) {
+        const job& j = *s.representative;
+        const std::size_t count = s.psnr.count();
+        report << j.image << " " << j.density << " " << j.parameters.w << " "
+                << j.parameters.p << " " << j.parameters.k << " "
+                << to_string(j.parameters.algorithm) << " " << count << " "
+                << s.psnr.mean() << " " << s.psnr.half_width() << " "
+                << s.ssim.mean() << " " << s.ssim.half_width() << " "
+                << s.ief.mean() << " "
+                << (count > 0 ? s.time_ms / count : 0) << "\n";
+    }
+
+    if(missing > 0) {
+        LOGW() << missing << " of " << jobs->size()
+                << " jobs have no results yet";
+    }
+    return static_cast<bool>(report.flush());
+}
+
+} // uwmf
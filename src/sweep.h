@@ -0,0 +1,65 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "noise_detectors.h"
+#include "uwmf.h"
+
+namespace uwmf
+{
+
+// Benchmark sweeps split into jobs that independent worker processes claim
+// from a shared directory, also across hosts on a shared filesystem:
+//
+//   manifest            one line per job, written once by plan_sweep()
+//   pending/<id>        jobs nobody has claimed yet
+//   claimed/<id>.<who>  jobs being worked on
+//   results/<id>        partial statistics of finished jobs
+//   cells/<who>         every repetition run by a worker (results_store.h)
+//
+// jobs are claimed by renaming them from pending/ to claimed/, which only
+// one of several concurrent workers can do. a job is a number of
+// repetitions of one configuration; every repetition corrupts the image
+// with a seed of its own, the same for all filter parameters, so that the
+// jobs of a configuration can run anywhere and in any order. jobs of
+// crashed workers are requeued by moving them back to pending/, the
+// repetitions they finished are not run again
+
+struct sweep_grid
+{
+    std::vector<std::string> images;
+    std::vector<double> densities;
+    std::vector<int> w;
+    std::vector<int> p;
+    std::vector<int> ibinr_p; // p of ibinr, euclidean unless given
+    std::vector<int> k;
+    int passes;
+    // all of them see the same corrupted copies. the median baselines
+    // ignore p and k, they only run with the first of each
+    std::vector<algorithm_type> algorithms;
+    engine_type engine;
+    detector_options detector;
+    bool random_noise;
+    std::size_t repetitions; // per configuration
+    std::size_t shard_size;  // repetitions per job
+};
+
+// fails if directory already holds a sweep
+bool plan_sweep(const std::string& directory, const sweep_grid& grid);
+
+// runs jobs until none is pending, returns the number of jobs run
+std::optional<std::size_t> work_sweep(const std::string& directory,
+        const std::size_t threads);
+
+// combines the results of all finished jobs into one report line per
+// configuration, configurations with missing jobs are reported as far as
+// they got
+bool merge_sweep(const std::string& directory, std::ostream& report);
+
+} // uwmf
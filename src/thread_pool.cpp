@@ -0,0 +1,47 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace uwmf
+{
+
+thread_pool::thread_pool(std::size_t thread_count, std::size_t queue_capacity)
+    : tasks_(queue_capacity)
+{
+    thread_count = std::max<std::size_t>(thread_count, 1);
+    workers_.reserve(thread_count);
+    for(std::size_t i = 0; i < thread_count; i++) {
+        workers_.emplace_back(
+                [this]
+                {
+                    while(auto t = tasks_.pop()) {
+                        (*t)();
+                    }
+                });
+    }
+}
+
+thread_pool::~thread_pool()
+{
+    tasks_.close();
+    for(auto& worker: workers_) {
+        worker.join();
+    }
+}
+
+bool thread_pool::submit(task t)
+{
+    return tasks_.push(std::move(t));
+}
+
+bool thread_pool::try_submit(task t)
+{
+    return tasks_.try_push(std::move(t));
+}
+
+std::size_t thread_pool::default_thread_count()
+{
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+} // uwmf
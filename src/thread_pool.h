@@ -0,0 +1,52 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "utils.h"
+
+namespace uwmf
+{
+
+class thread_pool
+{
+public:
+    using task = std::function<void()>;
+
+    // submit() blocks while queue_capacity tasks are waiting to be picked up
+    thread_pool(std::size_t thread_count, std::size_t queue_capacity);
+
+    // runs all queued tasks before joining the workers
+    ~thread_pool();
+
+    DELETE_COPY_AND_ASSIGN(thread_pool);
+
+    bool submit(task t);
+
+    // returns false instead of blocking if the queue is full
+    bool try_submit(task t);
+
+    std::size_t size() const
+    {
+        return workers_.size();
+    }
+
+    // number of tasks waiting for a worker
+    std::size_t pending() const
+    {
+        return tasks_.size();
+    }
+
+    static std::size_t default_thread_count();
+
+private:
+    bounded_queue<task> tasks_;
+    std::vector<std::thread> workers_;
+};
+
+} // uwmf
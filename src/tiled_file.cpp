@@ -0,0 +1,515 @@
+#include "tiled_file.h"
+
+#include "image.h"
+#include "logger.h"
+#include "noise_detectors.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "utils.h"
+#include "uwmf.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+using uwmf::monochrome_image;
+using uwmf::rect;
+
+using chunk = std::vector<unsigned char>;
+
+constexpr std::array<char, 4> magic = {'U', 'W', 'T', '1'};
+constexpr std::size_t header_size = magic.size() + 3 * 8;
+constexpr std::size_t index_entry_size = 2 * 8;
+
+void put_u64(std::ostream& out, const std::uint64_t value)
+{
+    std::array<char, 8> bytes;
+    for(std::size_t i = 0; i < bytes.size(); i++) {
+        bytes[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+    out.write(bytes.data(), bytes.size());
+}
+
+bool get_u64(std::istream& in, std::uint64_t& value)
+{
+    std::array<unsigned char, 8> bytes;
+    if(!in.read(reinterpret_cast<char*>(bytes.data()), bytes.size())) {
+        return false;
+    }
+    value = 0;
+    for(std::size_t i = 0; i < bytes.size(); i++) {
+        value |= static_cast<std::uint64_t>(bytes[i]) << (8 * i);
+    }
+    return true;
+}
+
+std::size_t tiles_across(const std::size_t length, const std::size_t tile_size)
+{
+    // without overflow for any length read from a file
+    return length / tile_size + (length % tile_size != 0 ? 1 : 0);
+}
+
+// tile i of an image of the given dimensions, edge tiles are clipped
+rect tile_region(const std::size_t i, const std::size_t width,
+        const std::size_t height, const std::size_t tile_size)
+{
+    const std::size_t columns = tiles_across(width, tile_size);
+    const std::size_t x = (i % columns) * tile_size;
+    const std::size_t y = (i / columns) * tile_size;
+    return {x, y, std::min(tile_size, width - x),
+            std::min(tile_size, height - y)};
+}
+
+// runs func(i) for i in [0, count), on a pool if there is more than one
+// thread
+template<typename Func>
+void parallel_for(const std::size_t threads, const std::size_t count,
+        Func&& func)
+{
+    if(threads <= 1 || count <= 1) {
+        for(std::size_t i = 0; i < count; i++) {
+            func(i);
+        }
+        return;
+    }
+
+    // the destructor of the pool waits for all tasks
+    uwmf::thread_pool pool(std::min(threads, count), threads);
+    for(std::size_t i = 0; i < count; i++) {
+        pool.submit([&func, i] { func(i); });
+    }
+}
+
+// the fastest level, higher ones gain little on natural images
+bool compress_tile(const monochrome_image& tile, chunk& compressed)
+{
+    TRACE_SCOPE("encode tile");
+    uLongf size = compressBound(tile.data().size());
+    compressed.resize(size);
+    if(compress2(compressed.data(), &size, tile.data().data(),
+               tile.data().size(), Z_BEST_SPEED)
+            != Z_OK) {
+        return false;
+    }
+    compressed.resize(size);
+    return true;
+}
+
+bool decompress_tile(const chunk& compressed, monochrome_image& tile)
+{
+    TRACE_SCOPE("decode tile");
+    uLongf size = tile.data().size();
+    return uncompress(tile.data().data(), &size, compressed.data(),
+                   compressed.size())
+            == Z_OK
+            && size == tile.data().size();
+}
+
+// writes a container tile by tile, in index order, so that only the tiles
+// in flight have to be kept around. the index is patched in once all tiles
+// are written, the file goes to a temporary first, readers never see a
+// partially written one
+class container_writer
+{
+public:
+    container_writer(const std::string& file_name, const std::size_t width,
+            const std::size_t height, const std::size_t tile_size)
+        : file_name_(file_name)
+        , temporary_(uwmf::temporary_file_name(file_name))
+        , file_(temporary_, std::ios::binary)
+        , count_(tiles_across(width, tile_size)
+                * tiles_across(height, tile_size))
+    {
+        file_.write(magic.data(), magic.size());
+        put_u64(file_, width);
+        put_u64(file_, height);
+        put_u64(file_, tile_size);
+
+        // zeroes until finish()
+        const std::vector<char> index(count_ * index_entry_size);
+        file_.write(index.data(), index.size());
+        offset_ = header_size + index.size();
+    }
+
+    ~container_writer()
+    {
+        if(!finished_) {
+            file_.close();
+            std::remove(temporary_.c_str());
+        }
+    }
+
+    DELETE_COPY_AND_ASSIGN(container_writer);
+
+    void append(const chunk& tile)
+    {
+        file_.write(reinterpret_cast<const char*>(tile.data()), tile.size());
+        index_.push_back({offset_, tile.size()});
+        offset_ += tile.size();
+    }
+
+    // every tile must have been appended
+    bool finish(const std::string& trailer = "")
+    {
+        ASSERT(index_.size() == count_, "tiles missing from the container");
+        file_.write(trailer.data(), trailer.size());
+        file_.seekp(header_size);
+        for(const auto& [offset, size]: index_) {
+            put_u64(file_, offset);
+            put_u64(file_, size);
+        }
+
+        if(!file_.flush()) {
+            LOGE() << "failed to write " << temporary_;
+            return false;
+        }
+        file_.close();
+
+        if(std::rename(temporary_.c_str(), file_name_.c_str()) != 0) {
+            LOGE() << "failed to replace " << file_name_;
+            return false;
+        }
+
+        finished_ = true;
+        return true;
+    }
+
+private:
+    std::string file_name_;
+    std::string temporary_;
+    std::ofstream file_;
+    std::size_t count_;
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> index_;
+    std::uint64_t offset_ = 0;
+    bool finished_ = false;
+};
+
+} // anonymous
+
+namespace uwmf
+{
+
+bool write_tiled_file(const monochrome_image& image,
+        const std::size_t tile_size, const std::string& file_name,
+        const std::size_t threads, const std::string& trailer)
+{
+    ASSERT(tile_size > 0, "tile size must be positive");
+
+    const std::size_t count = tiles_across(image.width(), tile_size)
+            * tiles_across(image.height(), tile_size);
+    std::vector<chunk> tiles(count);
+    std::atomic<bool> failed = false;
+    parallel_for(threads, count,
+            [&] (const std::size_t i)
+            {
+                const monochrome_image tile = crop(image,
+                        tile_region(i, image.width(), image.height(),
+                                tile_size));
+                if(!compress_tile(tile, tiles[i])) {
+                    failed = true;
+                }
+            });
+
+    if(failed) {
+        LOGE() << "failed to compress the tiles of " << file_name;
+        return false;
+    }
+
+    container_writer writer(file_name, image.width(), image.height(),
+            tile_size);
+    for(const auto& tile: tiles) {
+        writer.append(tile);
+    }
+    return writer.finish(trailer);
+}
+
+std::optional<tiled_file_reader> tiled_file_reader::open(
+        const std::string& file_name)
+{
+    std::ifstream file(file_name, std::ios::binary | std::ios::ate);
+    if(!file) {
+        LOGE() << "failed to open " << file_name;
+        return std::nullopt;
+    }
+    const std::uint64_t file_size = file.tellg();
+    file.seekg(0);
+
+    std::array<char, magic.size()> signature;
+    tiled_file_reader reader;
+    std::uint64_t width = 0;
+    std::uint64_t height = 0;
+    std::uint64_t tile_size = 0;
+    if(!file.read(signature.data(), signature.size()) || signature != magic
+            || !get_u64(file, width) || !get_u64(file, height)
+            || !get_u64(file, tile_size) || tile_size == 0) {
+        LOGE() << file_name << " is not a tiled image";
+        return std::nullopt;
+    }
+
+    // the header must describe an image that fits into memory and an index
+    // that fits into the file, before anything is allocated for them
+    const std::uint64_t columns = tiles_across(width, tile_size);
+    const std::uint64_t rows = tiles_across(height, tile_size);
+    const std::uint64_t max_tiles = file_size > header_size
+            ? (file_size - header_size) / index_entry_size
+            : 0;
+    if((height != 0 && width > SIZE_MAX / height)
+            || (rows != 0 && columns > max_tiles / rows)) {
+        LOGE() << file_name << ": invalid dimensions " << width << "x"
+                << height << " for " << file_size << " bytes";
+        return std::nullopt;
+    }
+
+    reader.file_name_ = file_name;
+    reader.width_ = width;
+    reader.height_ = height;
+    reader.tile_size_ = tile_size;
+    reader.index_.resize(columns * rows);
+    const std::uint64_t tiles_begin =
+            header_size + reader.index_.size() * index_entry_size;
+    for(std::size_t i = 0; i < reader.index_.size(); i++) {
+        auto& entry = reader.index_[i];
+        if(!get_u64(file, entry.offset) || !get_u64(file, entry.size)) {
+            LOGE() << file_name << ": truncated tile index";
+            return std::nullopt;
+        }
+        // tiles are read at these offsets later on
+        if(entry.offset < tiles_begin || entry.offset > file_size
+                || entry.size > file_size - entry.offset) {
+            LOGE() << file_name << ": tile " << i << " out of the file";
+            return std::nullopt;
+        }
+    }
+
+    return reader;
+}
+
+bool tiled_file_reader::read_trailer(std::string& trailer) const
+{
+    std::uint64_t end = header_size + index_.size() * index_entry_size;
+    for(const auto& entry: index_) {
+        end = std::max(end, entry.offset + entry.size);
+    }
+
+    std::ifstream file(file_name_, std::ios::binary | std::ios::ate);
+    if(!file) {
+        LOGE() << "failed to open " << file_name_;
+        return false;
+    }
+    const std::uint64_t size = file.tellg();
+    trailer.resize(size > end ? size - end : 0);
+    file.seekg(end);
+    if(!file.read(trailer.data(), trailer.size())) {
+        LOGE() << file_name_ << ": truncated trailer";
+        return false;
+    }
+    return true;
+}
+
+bool tiled_file_reader::read_region(const rect& region,
+        monochrome_image& image, const std::size_t threads) const
+{
+    ASSERT(region.x + region.width <= width_
+            && region.y + region.height <= height_,
+            "region out of bounds");
+
+    image.resize(region.width, region.height);
+    if(region.width == 0 || region.height == 0) {
+        return true;
+    }
+
+    // every call has a stream of its own, reads are sequential, decoding
+    // runs in parallel
+    std::ifstream file(file_name_, std::ios::binary);
+    if(!file) {
+        LOGE() << "failed to open " << file_name_;
+        return false;
+    }
+
+    const std::size_t columns = tiles_across(width_, tile_size_);
+    std::vector<std::size_t> tiles;
+    for(std::size_t ty = region.y / tile_size_;
+            ty <= (region.y + region.height - 1) / tile_size_; ty++) {
+        for(std::size_t tx = region.x / tile_size_;
+                tx <= (region.x + region.width - 1) / tile_size_; tx++) {
+            tiles.push_back(ty * columns + tx);
+        }
+    }
+
+    std::vector<chunk> chunks(tiles.size());
+    for(std::size_t i = 0; i < tiles.size(); i++) {
+        const index_entry& entry = index_[tiles[i]];
+        chunks[i].resize(entry.size);
+        file.seekg(entry.offset);
+        if(!file.read(reinterpret_cast<char*>(chunks[i].data()),
+                   chunks[i].size())) {
+            LOGE() << file_name_ << ": truncated tile " << tiles[i];
+            return false;
+        }
+    }
+
+    // tiles cover disjoint parts of image
+    std::atomic<bool> failed = false;
+    parallel_for(threads, tiles.size(),
+            [&] (const std::size_t i)
+            {
+                const rect tile =
+                        tile_region(tiles[i], width_, height_, tile_size_);
+                monochrome_image pixels(tile.width, tile.height);
+                if(!decompress_tile(chunks[i], pixels)) {
+                    failed = true;
+                    return;
+                }
+
+                const std::size_t x = std::max(tile.x, region.x);
+                const std::size_t y = std::max(tile.y, region.y);
+                const std::size_t x_end =
+                        std::min(tile.x + tile.width, region.x + region.width);
+                const std::size_t y_end = std::min(tile.y + tile.height,
+                        region.y + region.height);
+                paste(pixels, {x - tile.x, y - tile.y, x_end - x, y_end - y},
+                        image, x - region.x, y - region.y);
+            });
+
+    if(failed) {
+        LOGE() << file_name_ << ": corrupted tile data";
+        return false;
+    }
+
+    return true;
+}
+
+bool restore_tiled_file(const std::string& input, const std::string& output,
+        const uwmf_parameters& parameters, const engine_type engine,
+        const detector_options& detector, const std::size_t threads)
+{
+    const auto reader = tiled_file_reader::open(input);
+    if(!reader) {
+        return false;
+    }
+
+    const std::size_t width = reader->width();
+    const std::size_t height = reader->height();
+    const std::size_t tile_size = reader->tile_size();
+    // the mask is only exact away from the border of the context
+    const std::size_t halo = visit_detector(detector,
+            [] (const auto& d)
+            {
+                return static_cast<std::size_t>(
+                        std::decay_t<decltype(d)>::halo);
+            });
+
+    // every worker keeps its filter and scratch for the whole file, and
+    // takes every workers-th tile of a row
+    struct worker
+    {
+        uwmf_filter filter;
+        monochrome_image corrupted;
+        noise_mask mask;
+        monochrome_image restored;
+    };
+    const std::size_t columns = tiles_across(width, tile_size);
+    const std::size_t rows = tiles_across(height, tile_size);
+    const std::size_t workers = std::max<std::size_t>(1,
+            std::min(threads, columns));
+    std::vector<worker> worker_states;
+    for(std::size_t i = 0; i < workers; i++) {
+        worker_states.push_back(
+                {uwmf_filter(parameters, engine), {}, {}, {}});
+    }
+
+    const std::size_t reach =
+            worker_states.front().filter.context_margin() + halo;
+    const std::size_t reach_rows = (reach + tile_size - 1) / tile_size;
+
+    // finished rows go straight to the output, only the tiles of the
+    // current row are held
+    container_writer writer(output, width, height, tile_size);
+    std::vector<chunk> tiles(columns);
+
+    // a band of whole tile rows around the current one slides down the
+    // image, so that every tile is decoded once although the contexts
+    // overlap
+    monochrome_image band;
+    rect band_region = {0, 0, width, 0};
+    monochrome_image fresh;
+    for(std::size_t row = 0; row < rows; row++) {
+        const std::size_t y = row >= reach_rows
+                ? (row - reach_rows) * tile_size
+                : 0;
+        const std::size_t y_end =
+                std::min((row + reach_rows + 1) * tile_size, height);
+        const std::size_t band_end = band_region.y + band_region.height;
+        if(!reader->read_region({0, band_end, width, y_end - band_end},
+                   fresh, threads)) {
+            return false;
+        }
+
+        monochrome_image next(width, y_end - y);
+        if(band_end > y) {
+            paste(band, {0, y - band_region.y, width, band_end - y}, next, 0,
+                    0);
+        }
+        paste(fresh, {0, 0, width, fresh.height()}, next, 0, band_end - y);
+        band = std::move(next);
+        band_region = {0, y, width, y_end - y};
+
+        std::atomic<bool> failed = false;
+        parallel_for(workers, workers,
+                [&] (const std::size_t k)
+                {
+                    auto& [filter, corrupted, mask, restored] =
+                            worker_states[k];
+                    for(std::size_t column = k; column < columns;
+                            column += workers) {
+                        const std::size_t i = row * columns + column;
+                        TRACE_SCOPE("restore tile", i);
+                        const rect tile =
+                                tile_region(i, width, height, tile_size);
+                        const rect context = grow(tile, reach, width, height);
+                        crop(band, {context.x, context.y - y, context.width,
+                                        context.height}, corrupted);
+
+                        const rect region = {tile.x - context.x,
+                                tile.y - context.y, tile.width, tile.height};
+                        restored.resize(corrupted.width(),
+                                corrupted.height());
+                        visit_detector(detector,
+                                [&] (const auto& d)
+                                {
+                                    detect_noise(corrupted, d, mask);
+                                    filter.restore_region(corrupted, mask,
+                                            region, restored);
+                                });
+
+                        if(!compress_tile(crop(restored, region),
+                                tiles[column])) {
+                            failed = true;
+                        }
+                    }
+                });
+
+        if(failed) {
+            LOGE() << "failed to compress the tiles of " << output;
+            return false;
+        }
+        for(const auto& tile: tiles) {
+            writer.append(tile);
+        }
+    }
+
+    return writer.finish();
+}
+
+} // uwmf
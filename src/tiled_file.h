@@ -0,0 +1,101 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "image.h"
+#include "noise_detectors.h"
+#include "utils.h"
+#include "uwmf.h"
+
+namespace uwmf
+{
+
+// Tiled container (.uwt) for images too large to be decoded at once. Tiles
+// are stored row by row, every tile deflated on its own, so that tiles can
+// be encoded and decoded in parallel and regions can be read without
+// touching the tiles outside of them:
+//
+//   "UWT1" | width | height | tile size | (offset, size) per tile | tiles
+//   | trailer
+//
+// all numbers are 64 bit little endian, offsets count from the start of the
+// file and every tile holds its 8 bit pixels row-major (edge tiles clipped).
+// the optional trailer holds data of the writer, e.g. the key of a cache
+// entry, readers of the pixels skip it
+
+inline bool is_tiled_file_name(const std::string& file_name)
+{
+    const std::string extension = ".uwt";
+    return file_name.size() >= extension.size()
+            && file_name.compare(file_name.size() - extension.size(),
+                    extension.size(), extension) == 0;
+}
+
+bool write_tiled_file(const monochrome_image& image,
+        const std::size_t tile_size, const std::string& file_name,
+        const std::size_t threads, const std::string& trailer = "");
+
+class tiled_file_reader
+{
+public:
+    // reads the header and the index, tiles are only read on demand
+    static std::optional<tiled_file_reader> open(const std::string& file_name);
+
+    std::size_t width() const
+    {
+        return width_;
+    }
+
+    std::size_t height() const
+    {
+        return height_;
+    }
+
+    std::size_t tile_size() const
+    {
+        return tile_size_;
+    }
+
+    // decodes the tiles overlapping region into image, which is resized to
+    // the region. safe to call from several threads at once
+    bool read_region(const rect& region, monochrome_image& image,
+            const std::size_t threads) const;
+
+    bool read(monochrome_image& image, const std::size_t threads) const
+    {
+        return read_region({0, 0, width_, height_}, image, threads);
+    }
+
+    // the bytes after the last tile, empty if there are none
+    bool read_trailer(std::string& trailer) const;
+
+private:
+    struct index_entry
+    {
+        std::uint64_t offset;
+        std::uint64_t size;
+    };
+
+    std::string file_name_;
+    std::size_t width_ = 0;
+    std::size_t height_ = 0;
+    std::size_t tile_size_ = 0;
+    std::vector<index_entry> index_;
+};
+
+// restores a tiled file into another one with the same tiling, tiles in
+// parallel. every tile is restored from a context that also covers the
+// neighbouring tiles within reach of the filter and the detector, so the
+// result is the same as that of restoring the whole image at once. tile
+// rows are written as they are finished, neither image is held as a whole
+bool restore_tiled_file(const std::string& input, const std::string& output,
+        const uwmf_parameters& parameters, const engine_type engine,
+        const detector_options& detector, const std::size_t threads);
+
+} // uwmf
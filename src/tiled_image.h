@@ -0,0 +1,135 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "image.h"
+#include "utils.h"
+
+namespace uwmf
+{
+
+// image stored as square tiles of tile_size pixels, every tile padded with a
+// copy of up to halo pixels of its neighbours (less at the image border).
+// windows of radius halo around the pixels of a tile stay within a single
+// small buffer, no matter how wide the image is
+template<typename PixelValueType>
+class basic_tiled_image
+{
+public:
+    using image_type = basic_image<PixelValueType>;
+
+    basic_tiled_image()
+        : width_(0)
+        , height_(0)
+        , tile_size_(0)
+        , halo_(0)
+    {
+    }
+
+    // converts from row-major layout, tile buffers are reused
+    void assign(const image_type& image, const std::size_t tile_size,
+            const std::size_t halo)
+    {
+        ASSERT(tile_size > 0, "tile size must be positive");
+
+        width_ = image.width();
+        height_ = image.height();
+        tile_size_ = tile_size;
+        halo_ = halo;
+
+        const std::size_t columns = (width_ + tile_size - 1) / tile_size;
+        const std::size_t rows = (height_ + tile_size - 1) / tile_size;
+        tiles_.resize(columns * rows);
+        regions_.resize(columns * rows);
+        interiors_.resize(columns * rows);
+
+        for(std::size_t ty = 0; ty < rows; ty++) {
+            for(std::size_t tx = 0; tx < columns; tx++) {
+                const std::size_t i = ty * columns + tx;
+                const std::size_t x = tx * tile_size;
+                const std::size_t y = ty * tile_size;
+                regions_[i] = {x, y, std::min(tile_size, width_ - x),
+                        std::min(tile_size, height_ - y)};
+
+                const rect context = grow(regions_[i], halo, width_, height_);
+                crop(image, context, tiles_[i]);
+                interiors_[i] = {x - context.x, y - context.y,
+                        regions_[i].width, regions_[i].height};
+            }
+        }
+    }
+
+    // converts the tiles without their halo back to row-major layout
+    void to_row_major(image_type& image) const
+    {
+        image.resize(width_, height_);
+        for(std::size_t i = 0; i < tiles_.size(); i++) {
+            paste(tiles_[i], interiors_[i], image,
+                    regions_[i].x, regions_[i].y);
+        }
+    }
+
+    std::size_t tile_count() const
+    {
+        return tiles_.size();
+    }
+
+    image_type& tile(const std::size_t i)
+    {
+        return tiles_[i];
+    }
+
+    const image_type& tile(const std::size_t i) const
+    {
+        return tiles_[i];
+    }
+
+    // pixels of tile i in image coordinates
+    const rect& region(const std::size_t i) const
+    {
+        return regions_[i];
+    }
+
+    // pixels of tile i in tile coordinates, i.e. without the halo
+    const rect& interior(const std::size_t i) const
+    {
+        return interiors_[i];
+    }
+
+    std::size_t width() const
+    {
+        return width_;
+    }
+
+    std::size_t height() const
+    {
+        return height_;
+    }
+
+    std::size_t tile_size() const
+    {
+        return tile_size_;
+    }
+
+    std::size_t halo() const
+    {
+        return halo_;
+    }
+
+private:
+    std::size_t width_;
+    std::size_t height_;
+    std::size_t tile_size_;
+    std::size_t halo_;
+    std::vector<image_type> tiles_;
+    std::vector<rect> regions_;
+    std::vector<rect> interiors_;
+};
+
+using tiled_image = basic_tiled_image<unsigned char>;
+
+} // uwmf
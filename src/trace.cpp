@@ -0,0 +1,136 @@
+#include "trace.h"
+
+#include "logger.h"
+
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+using clock_type = uwmf::tracer::clock_type;
+
+// long-running processes must not grow without bound
+constexpr std::size_t max_events_per_thread = 1 << 20;
+
+struct event
+{
+    const char* name;
+    std::int64_t index;
+    clock_type::time_point begin;
+    clock_type::time_point end;
+};
+
+struct thread_buffer
+{
+    std::size_t id;
+    std::vector<event> events;
+    std::size_t dropped = 0;
+};
+
+// buffers outlive their threads, pool workers are gone by the time the
+// trace is written
+std::mutex buffers_mutex;
+std::vector<std::unique_ptr<thread_buffer>> buffers;
+clock_type::time_point origin;
+
+thread_buffer& local_buffer()
+{
+    thread_local thread_buffer* buffer = nullptr;
+    if(!buffer) {
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        buffers.push_back(std::make_unique<thread_buffer>());
+        buffer = buffers.back().get();
+        buffer->id = buffers.size();
+    }
+    return *buffer;
+}
+
+double microseconds(const clock_type::time_point time)
+{
+    return std::chrono::duration<double, std::micro>(time - origin).count();
+}
+
+} // anonymous
+
+namespace uwmf
+{
+
+void tracer::enable()
+{
+    origin = clock_type::now();
+    enabled_ = true;
+}
+
+void tracer::record(const char* name, const std::int64_t index,
+        const clock_type::time_point begin, const clock_type::time_point end)
+{
+    auto& buffer = local_buffer();
+    if(buffer.events.size() == max_events_per_thread) {
+        buffer.dropped++;
+        return;
+    }
+    buffer.events.push_back({name, index, begin, end});
+}
+
+bool tracer::write(const std::string& file_name)
+{
+    std::ofstream file(file_name);
+    file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    const char* separator = "\n";
+    std::size_t dropped = 0;
+    for(const auto& buffer: buffers) {
+        file << separator << "{\"name\":\"thread_name\",\"ph\":\"M\","
+                "\"pid\":1,\"tid\":" << buffer->id << ",\"args\":{\"name\":"
+                "\"thread " << buffer->id << "\"}}";
+        separator = ",\n";
+
+        // complete events, a begin and an end event in one
+        for(const auto& e: buffer->events) {
+            file << separator << "{\"name\":\"" << e.name
+                    << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+                    << ",\"ts\":" << microseconds(e.begin) << ",\"dur\":"
+                    << std::chrono::duration<double, std::micro>(
+                            e.end - e.begin).count();
+            if(e.index >= 0) {
+                file << ",\"args\":{\"index\":" << e.index << "}";
+            }
+            file << "}";
+        }
+        dropped += buffer->dropped;
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    if(!file.flush()) {
+        LOGE() << "failed to write " << file_name;
+        return false;
+    }
+    if(dropped > 0) {
+        LOGW() << "trace buffers were full, dropped " << dropped
+                << " events";
+    }
+    return true;
+}
+
+trace_session::trace_session(std::string file_name)
+    : file_name_(std::move(file_name))
+{
+    if(!file_name_.empty()) {
+        tracer::enable();
+    }
+}
+
+trace_session::~trace_session()
+{
+    if(!file_name_.empty() && tracer::write(file_name_)) {
+        LOGI() << "trace written to " << file_name_;
+    }
+}
+
+} // uwmf
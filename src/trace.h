@@ -0,0 +1,93 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "utils.h"
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+// records the enclosing scope as an event of the calling thread, name must
+// be a string literal. an optional integer (tile, band, ...) is exported
+// as the index argument of the event
+#define TRACE_SCOPE(...) \
+    uwmf::trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(__VA_ARGS__)
+
+namespace uwmf
+{
+
+// Events go to buffers of their thread, so recording takes no locks, and
+// are exported in the Chrome trace event format, which chrome://tracing
+// and Perfetto read. while tracing is disabled a scope costs a relaxed
+// load and a branch
+class tracer
+{
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    static bool enabled()
+    {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    // timestamps count from here
+    static void enable();
+
+    static void record(const char* name, const std::int64_t index,
+            const clock_type::time_point begin,
+            const clock_type::time_point end);
+
+    // must not race with threads that are still recording
+    static bool write(const std::string& file_name);
+
+private:
+    static inline std::atomic<bool> enabled_{false};
+};
+
+class trace_scope
+{
+public:
+    explicit trace_scope(const char* name, const std::int64_t index = -1)
+        : name_(tracer::enabled() ? name : nullptr)
+        , index_(index)
+    {
+        if(name_) {
+            begin_ = tracer::clock_type::now();
+        }
+    }
+
+    ~trace_scope()
+    {
+        if(name_) {
+            tracer::record(name_, index_, begin_, tracer::clock_type::now());
+        }
+    }
+
+    DELETE_COPY_AND_ASSIGN(trace_scope);
+
+private:
+    const char* name_;
+    std::int64_t index_;
+    tracer::clock_type::time_point begin_;
+};
+
+// traces from construction and writes file_name on destruction, nothing
+// happens for an empty file name
+class trace_session
+{
+public:
+    explicit trace_session(std::string file_name);
+    ~trace_session();
+
+    DELETE_COPY_AND_ASSIGN(trace_session);
+
+private:
+    std::string file_name_;
+};
+
+} // uwmf
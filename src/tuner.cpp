@@ -0,0 +1,296 @@
+#include "tuner.h"
+
+#include "image.h"
+#include "image_utils.h"
+#include "logger.h"
+#include "math_utils.h"
+#include "noise_detectors.h"
+#include "thread_pool.h"
+#include "utils.h"
+#include "uwmf.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+using uwmf::monochrome_image;
+using uwmf::rect;
+
+constexpr std::size_t block_size = 32;
+constexpr std::size_t initial_blocks = 8;
+
+struct sample
+{
+    monochrome_image image;
+    uwmf::noise_mask mask;
+};
+
+struct candidate
+{
+    uwmf::uwmf_parameters parameters;
+    double mse;
+};
+
+// whether the weights are the same up to rounding and a common factor,
+// which the filter doesn't depend on
+bool proportional(const std::vector<double>& weights1,
+        const std::vector<double>& weights2)
+{
+    // the center (distance 0) has no weight, its neighbours have
+    const std::size_t neighbour = weights1.size() / 2 + 1;
+    const double scale = weights1[neighbour] / weights2[neighbour];
+    for(std::size_t i = 0; i < weights1.size(); i++) {
+        if(std::abs(weights1[i] - scale * weights2[i])
+                > 1e-9 * weights1[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// candidates whose weights are proportional restore alike, only the first
+// of them is kept. e.g. for w = 1 the weights only depend on k / p
+std::vector<candidate> candidate_grid(const int passes,
+        const uwmf::algorithm_type algorithm)
+{
+    std::vector<candidate> candidates;
+    for(int w = 1; w <= 6; w++) {
+        std::vector<std::vector<double>> weights;
+        for(int p = 1; p <= 3; p++) {
+            for(int k = 1; k <= 8; k++) {
+                auto candidate_weights = uwmf::gen_minkowski_weights(w, p, k);
+                if(std::none_of(weights.begin(), weights.end(),
+                        [&] (const std::vector<double>& other)
+                        {
+                            return proportional(candidate_weights, other);
+                        })) {
+                    weights.push_back(std::move(candidate_weights));
+                    candidates.push_back({{w, p, k, passes, algorithm}, 0});
+                }
+            }
+        }
+    }
+    return candidates;
+}
+
+std::vector<rect> sample_blocks(const monochrome_image& image,
+        const std::size_t count)
+{
+    uwmf::random<std::size_t> x(0, image.width() - block_size);
+    uwmf::random<std::size_t> y(0, image.height() - block_size);
+
+    std::vector<rect> blocks;
+    for(std::size_t i = 0; i < count; i++) {
+        blocks.push_back({x.generate(), y.generate(), block_size, block_size});
+    }
+    return blocks;
+}
+
+double psnr_from_mse(const double mse)
+{
+    constexpr auto max =
+            std::numeric_limits<monochrome_image::value_type>::max();
+    return 10 * std::log10((max * max) / mse);
+}
+
+// all candidates see the same samples and regions, one task per candidate
+void evaluate(std::vector<candidate>& candidates,
+        const monochrome_image& original, const std::vector<sample>& samples,
+        const std::vector<rect>& regions, const std::size_t threads)
+{
+    // the destructor of the pool waits for all tasks
+    uwmf::thread_pool pool(threads, threads);
+    for(std::size_t i = 0; i < candidates.size(); i++) {
+        pool.submit(
+                [&, i]
+                {
+                    auto& c = candidates[i];
+                    uwmf::uwmf_filter filter(c.parameters);
+                    monochrome_image restored(
+                            original.width(), original.height());
+
+                    double se = 0;
+                    std::size_t count = 0;
+                    for(const auto& s: samples) {
+                        for(const auto& region: regions) {
+                            filter.restore_region(s.image, s.mask, region,
+                                    restored);
+                            for(std::size_t y = region.y;
+                                    y < region.y + region.height; y++) {
+                                for(std::size_t x = region.x;
+                                        x < region.x + region.width; x++) {
+                                    const double diff =
+                                            restored(x, y) - original(x, y);
+                                    se += diff * diff;
+                                }
+                            }
+                            count += region.width * region.height;
+                        }
+                    }
+                    c.mse = se / count;
+                });
+    }
+}
+
+void rank(std::vector<candidate>& candidates)
+{
+    std::stable_sort(candidates.begin(), candidates.end(),
+            [] (const candidate& lhs, const candidate& rhs)
+            {
+                return lhs.mse < rhs.mse;
+            });
+}
+
+} // anonymous
+
+namespace uwmf
+{
+
+std::optional<parameter_table> parameter_table::load(const std::string& path)
+{
+    std::ifstream file(path);
+    if(!file) {
+        LOGE() << "failed to open " << path;
+        return std::nullopt;
+    }
+
+    parameter_table table;
+    std::string line;
+    for(std::size_t number = 1; std::getline(file, line); number++) {
+        line.erase(std::min(line.find('#'), line.size()));
+
+        std::istringstream fields(line);
+        entry e{};
+        if(!(fields >> e.density)) {
+            continue; // blank line
+        }
+
+        std::string rest;
+        if(!(fields >> e.w >> e.p >> e.k) || (fields >> rest)
+                || e.density < 0 || e.density > 1
+                || e.w < 1 || e.p < 1 || e.k < 0) {
+            LOGE() << path << ":" << number << ": malformed table entry";
+            return std::nullopt;
+        }
+        table.insert(e);
+    }
+
+    return table;
+}
+
+bool parameter_table::save(const std::string& path) const
+{
+    // readers never see a partially written table
+    const std::string temporary = temporary_file_name(path);
+    {
+        std::ofstream file(temporary);
+        file << "# density w p k\n";
+        for(const auto& e: entries_) {
+            file << e.density << " " << e.w << " " << e.p << " " << e.k
+                    << "\n";
+        }
+
+        if(!file.flush()) {
+            LOGE() << "failed to write " << temporary;
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+
+    if(std::rename(temporary.c_str(), path.c_str()) != 0) {
+        LOGE() << "failed to replace " << path;
+        std::remove(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void parameter_table::insert(const entry& e)
+{
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), e,
+            [] (const entry& lhs, const entry& rhs)
+            {
+                return lhs.density < rhs.density;
+            });
+
+    if(it != entries_.end() && it->density == e.density) {
+        *it = e;
+    }
+    else {
+        entries_.insert(it, e);
+    }
+}
+
+const parameter_table::entry& parameter_table::lookup(
+        const double density) const
+{
+    ASSERT(!entries_.empty(), "lookup in an empty parameter table");
+
+    return *std::min_element(entries_.begin(), entries_.end(),
+            [density] (const entry& lhs, const entry& rhs)
+            {
+                return std::abs(lhs.density - density)
+                        < std::abs(rhs.density - density);
+            });
+}
+
+tuning_result tune(const monochrome_image& original,
+        const tuning_options& options)
+{
+    std::vector<sample> samples(std::max<std::size_t>(options.copies, 1));
+    for(auto& s: samples) {
+        s.image = options.random_noise
+                ? rvin(original, options.density)
+                : fvin(original, options.density);
+        visit_detector(options.detector,
+                [&] (const auto& detector)
+                {
+                    detect_noise(s.image, detector, s.mask);
+                });
+    }
+
+    const rect whole = {0, 0, original.width(), original.height()};
+    const std::size_t threads = std::max<std::size_t>(options.threads, 1);
+    const std::size_t area = original.width() * original.height();
+
+    auto candidates = candidate_grid(options.passes, options.algorithm);
+    std::size_t rounds = 0;
+    for(std::size_t blocks = initial_blocks; candidates.size() > 1
+            && original.width() >= block_size
+            && original.height() >= block_size
+            && blocks * block_size * block_size < area; blocks *= 2) {
+        evaluate(candidates, original, samples,
+                sample_blocks(original, blocks), threads);
+        rank(candidates);
+        rounds++;
+
+        LOGI() << "round " << rounds << ": " << candidates.size()
+                << " candidates on " << blocks << " blocks, best w = "
+                << candidates.front().parameters.w << ", p = "
+                << candidates.front().parameters.p << ", k = "
+                << candidates.front().parameters.k;
+
+        candidates.resize((candidates.size() + 1) / 2);
+    }
+
+    evaluate(candidates, original, samples, {whole}, threads);
+    rank(candidates);
+    rounds++;
+
+    LOGI() << "round " << rounds << ": " << candidates.size()
+            << " candidates on whole images";
+
+    return {candidates.front().parameters,
+            psnr_from_mse(candidates.front().mse), rounds};
+}
+
+} // uwmf
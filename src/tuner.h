@@ -0,0 +1,77 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "image.h"
+#include "noise_detectors.h"
+#include "uwmf.h"
+
+namespace uwmf
+{
+
+// tuned filter parameters for a number of corruption densities. stored as
+// text, one "<density> <w> <p> <k>" line per entry, '#' starts a comment
+class parameter_table
+{
+public:
+    struct entry
+    {
+        double density;
+        int w;
+        int p;
+        int k;
+    };
+
+    // returns std::nullopt if the file can't be read or is malformed
+    static std::optional<parameter_table> load(const std::string& path);
+
+    bool save(const std::string& path) const;
+
+    // replaces the entry with the same density, if any
+    void insert(const entry& e);
+
+    // entry with the density closest to density, the table must not be empty
+    const entry& lookup(const double density) const;
+
+    bool empty() const
+    {
+        return entries_.empty();
+    }
+
+private:
+    std::vector<entry> entries_; // sorted by density
+};
+
+struct tuning_options
+{
+    double density;
+    std::size_t copies;  // corrupted copies of the image candidates share
+    std::size_t threads;
+    int passes;
+    algorithm_type algorithm;
+    bool random_noise;
+    detector_options detector;
+};
+
+struct tuning_result
+{
+    uwmf_parameters parameters;
+    double psnr; // on the whole corrupted set
+    std::size_t rounds;
+};
+
+// searches (w, p, k) by successive halving: every round scores all
+// remaining candidates on randomly sampled blocks of the corrupted set
+// (restored with restore_region(), so only their neighbourhood is
+// processed), drops the worse half and doubles the number of blocks,
+// until the blocks would cover the whole image. the survivors are then
+// ranked on whole images
+tuning_result tune(const monochrome_image& original,
+        const tuning_options& options);
+
+} // uwmf
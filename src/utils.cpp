@@ -1 +1,18 @@
 #include "utils.h"
+
+#include <random>
+#include <string>
+#include <unistd.h>
+
+namespace uwmf
+{
+
+std::string temporary_file_name(const std::string& path)
+{
+    // the pid tells processes apart, the random suffix threads
+    std::random_device device;
+    return path + ".tmp." + std::to_string(::getpid()) + "."
+            + std::to_string(device());
+}
+
+} // uwmf
@@ -2,9 +2,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
 #include <ostream>
 #include <random>
+#include <string>
 #include <type_traits>
 
 #define ASSERT(predicate, message) assert(predicate && message)
@@ -34,6 +37,37 @@ std::ostream& operator<<(std::ostream& out,
 using point2d = basic_point2d<double>;
 using discrete_point2d = basic_point2d<int>;
 
+template<typename ValueType>
+struct basic_rect
+{
+    ValueType x;
+    ValueType y;
+    ValueType width;
+    ValueType height;
+};
+
+template<typename ValueType>
+std::ostream& operator<<(std::ostream& out, const basic_rect<ValueType>& r)
+{
+    out << r.x << ", " << r.y << ", " << r.width << "x" << r.height;
+    return out;
+}
+
+using rect = basic_rect<std::size_t>;
+
+// extends region by margin on every side, clipped to an image of the given
+// dimensions
+inline rect grow(const rect& region, const std::size_t margin,
+        const std::size_t width, const std::size_t height)
+{
+    const std::size_t x = region.x > margin ? region.x - margin : 0;
+    const std::size_t y = region.y > margin ? region.y - margin : 0;
+    const std::size_t x_end = std::min(region.x + region.width + margin, width);
+    const std::size_t y_end =
+            std::min(region.y + region.height + margin, height);
+    return {x, y, x_end > x ? x_end - x : 0, y_end > y ? y_end - y : 0};
+}
+
 template<typename T>
 std::ostream& operator<<(std::ostream& out, const std::vector<T>& vec)
 {
@@ -45,6 +79,11 @@ std::ostream& operator<<(std::ostream& out, const std::vector<T>& vec)
     return out;
 }
 
+// name of a file next to path that no other writer picks, so that files
+// can be written under it and renamed to path atomically, even by several
+// processes at once
+std::string temporary_file_name(const std::string& path);
+
 class random_base
 {
 protected:
@@ -4,12 +4,22 @@
 #include "image_utils.h"
 #include "logger.h"
 #include "math_utils.h"
+#include "thread_pool.h"
+#include "trace.h"
 #include "utils.h"
 
 #include <algorithm>
 #include <array>
+#include <bitset>
+#include <cctype>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
 
 namespace
 {
@@ -83,117 +93,703 @@ void convolve(const size2d curr_coords,
     }
 }
 
+// below this many corrupted pixels per thread, starting the threads costs
+// more than it saves
+constexpr std::size_t min_pixels_per_thread = 4096;
+// corrupted pixels are collected and restored in batches of this size, so
+// that the list stays in cache
+constexpr std::size_t batch_size = 4096;
+
+constexpr std::size_t word_size = sizeof(std::uint64_t);
+constexpr std::uint64_t clean_word =
+        uwmf::corruption::NONE * std::uint64_t{0x0101010101010101};
+
+// corrupted pixels of a row segment, 8 mask bytes at a time. corruption
+// values other than NONE have bit 1 set once xor-ed with NONE
+std::size_t count_corrupted(const unsigned char* row, const std::size_t length)
+{
+    std::size_t count = 0;
+    std::size_t x = 0;
+    for(; x + word_size <= length; x += word_size) {
+        std::uint64_t word;
+        std::memcpy(&word, row + x, word_size);
+        count += std::bitset<64>(
+                (word ^ clean_word) & std::uint64_t{0x0202020202020202})
+                .count();
+    }
+    for(; x < length; x++) {
+        count += row[x] != uwmf::corruption::NONE;
+    }
+    return count;
+}
+
+// writes up to count corrupted pixels of region, starting at cursor, to
+// corrupted in row-major order and advances cursor past them. returns how
+// many were written, corrupted must have room for count + word_size. the
+// mask is compared 8 pixels at a time against an all clean word, dirty
+// words are unpacked without branches, which would be unpredictable at the
+// densities that matter
+std::size_t collect_corrupted(const uwmf::noise_mask& mask,
+        const uwmf::rect& region, size2d& cursor, std::size_t count,
+        size2d* corrupted)
+{
+    const std::size_t x_end = region.x + region.width;
+    const std::size_t y_end = region.y + region.height;
+    // the cursor might alias the list, a local copy keeps it in registers
+    std::size_t x = cursor.x;
+    std::size_t y = cursor.y;
+    std::size_t n = 0;
+    for(; y < y_end; y++, x = region.x) {
+        const unsigned char* row = mask.data().data() + y * mask.width();
+        while(x < x_end) {
+            if(x + word_size <= x_end && count - n >= word_size) {
+                std::uint64_t word;
+                std::memcpy(&word, row + x, word_size);
+                if(word != clean_word) {
+                    for(std::size_t i = x; i < x + word_size; i++) {
+                        corrupted[n] = {i, y};
+                        n += row[i] != uwmf::corruption::NONE;
+                    }
+                }
+                x += word_size;
+                continue;
+            }
+
+            if(row[x] != uwmf::corruption::NONE) {
+                if(n == count) {
+                    cursor = {x, y};
+                    return n;
+                }
+                corrupted[n++] = {x, y};
+            }
+            x++;
+        }
+    }
+    cursor = {x, y};
+    return n;
 }
 
+// noise mask of the 2w + 1 rows around the row being restored, addressed
+// with image coordinates
+class rolling_mask
+{
+public:
+    rolling_mask(uwmf::noise_mask& rows, const std::size_t height)
+        : rows_(rows)
+        , height_(height)
+    {
+    }
+
+    DELETE_COPY_AND_ASSIGN(rolling_mask);
+
+    std::size_t width() const
+    {
+        return rows_.width();
+    }
+
+    std::size_t height() const
+    {
+        return height_;
+    }
+
+    unsigned char operator()(const std::size_t x, const std::size_t y) const
+    {
+        return rows_(x, y % rows_.height());
+    }
+
+    // replaces the row that is farthest behind
+    void store(const std::size_t y, const unsigned char* row)
+    {
+        std::copy(row, row + rows_.width(), &rows_(0, y % rows_.height()));
+    }
+
+private:
+    uwmf::noise_mask& rows_;
+    std::size_t height_;
+};
+
+// mask of the passes after the first one, only pixels still waiting on the
+// worklist count as corrupted. their kind no longer matters, fallback values
+// are assigned in the first pass
+class worklist_mask
+{
+public:
+    worklist_mask(const std::vector<bool>& pending, const std::size_t width,
+            const std::size_t height)
+        : pending_(pending)
+        , width_(width)
+        , height_(height)
+    {
+    }
+
+    DELETE_COPY_AND_ASSIGN(worklist_mask);
+
+    std::size_t width() const
+    {
+        return width_;
+    }
+
+    std::size_t height() const
+    {
+        return height_;
+    }
+
+    unsigned char operator()(const std::size_t x, const std::size_t y) const
+    {
+        return pending_[y * width_ + x]
+                ? uwmf::corruption::SALT
+                : uwmf::corruption::NONE;
+    }
+
+private:
+    const std::vector<bool>& pending_;
+    std::size_t width_;
+    std::size_t height_;
+};
+
+} // anonymous
+
 namespace uwmf
 {
 
-monochrome_image uwmf(const monochrome_image& corrupted_image,
-        noise_detector detector, const uwmf_parameters parameters)
+std::optional<algorithm_type> to_algorithm_type(std::string str)
 {
-    const std::vector<double> org_weights =
-            gen_minkowski_weights(parameters.w, parameters.p, parameters.k);
-    std::vector<double> weights(org_weights.size());
+    std::transform(str.begin(), str.end(), str.begin(),
+            [] (unsigned char ch) { return std::tolower(ch); });
 
-    const discrete_point2d image_size =
-            {static_cast<int>(corrupted_image.width()),
-            static_cast<int>(corrupted_image.height())};
-    monochrome_image restored_image(image_size.x, image_size.y);
+    if(str == "uwmf") {
+        return algorithm_type::UWMF;
+    }
+    else if(str == "ibinr") {
+        return algorithm_type::IBINR;
+    }
+    else if(str == "median") {
+        return algorithm_type::MEDIAN;
+    }
+    else if(str == "amf") {
+        return algorithm_type::ADAPTIVE_MEDIAN;
+    }
 
-    for(const auto& [x, y, pixel_it]: corrupted_image) {
-        auto pixel = *pixel_it;
+    return std::nullopt;
+}
+
+std::string to_string(const algorithm_type type)
+{
+    switch(type) {
+    case algorithm_type::UWMF: return "uwmf"; break;
+    case algorithm_type::IBINR: return "ibinr"; break;
+    case algorithm_type::MEDIAN: return "median"; break;
+    case algorithm_type::ADAPTIVE_MEDIAN: return "amf"; break;
+    default: ASSERT(false, "invalid algorithm type"); break;
+    }
+
+    return "";
+}
+
+int suggested_window_size(const double density)
+{
+    if(density < 0.2) {
+        return 1;
+    }
+    else if(density < 0.5) {
+        return 2;
+    }
+    else if(density < 0.7) {
+        return 3;
+    }
+    else if(density < 0.85) {
+        return 4;
+    }
+    else if(density < 0.9) {
+        return 5;
+    }
+    return 6;
+}
+
+std::optional<engine_type> to_engine_type(std::string str)
+{
+    std::transform(str.begin(), str.end(), str.begin(),
+            [] (unsigned char ch) { return std::tolower(ch); });
+
+    if(str == "auto") {
+        return engine_type::AUTO;
+    }
+    else if(str == "direct") {
+        return engine_type::DIRECT;
+    }
+    else if(str == "lut") {
+        return engine_type::LUT;
+    }
+    else if(str == "fft") {
+        return engine_type::FFT;
+    }
+
+    return std::nullopt;
+}
 
-        if(!detector(pixel).first) {
-            restored_image(x, y) = corrupted_image(x, y);
-            continue;
+std::string to_string(const engine_type type)
+{
+    switch(type) {
+    case engine_type::AUTO: return "auto"; break;
+    case engine_type::DIRECT: return "direct"; break;
+    case engine_type::LUT: return "lut"; break;
+    case engine_type::FFT: return "fft"; break;
+    default: ASSERT(false, "invalid engine type"); break;
+    }
+
+    return "";
+}
+
+uwmf_filter::uwmf_filter(const uwmf_parameters parameters,
+        const engine_type engine, const std::size_t threads)
+    : parameters_(parameters)
+    , threads_(std::max(threads, std::size_t{1}))
+    , org_weights_(gen_minkowski_weights(
+            parameters.w, parameters.p, parameters.k))
+    , weights_(org_weights_.size())
+{
+    ASSERT(!is_baseline(parameters_.algorithm),
+            "baselines are restored by restore_baseline");
+    ASSERT((engine != engine_type::LUT || parameters_.w == 1),
+            "the lut engine requires w = 1");
+
+    const bool correct_bias = parameters_.algorithm == algorithm_type::UWMF;
+    if(engine == engine_type::LUT
+            || (engine == engine_type::AUTO && parameters_.w == 1)) {
+        lut_.emplace(org_weights_, correct_bias);
+    }
+    else if(engine == engine_type::FFT) {
+        fft_.emplace(org_weights_, parameters_.w, correct_bias);
+    }
+}
+
+void uwmf_filter::restore_with_mask(const monochrome_image& corrupted_image,
+        const noise_mask& mask, monochrome_image& restored_image)
+{
+    restore_rect(corrupted_image, mask,
+            {0, 0, corrupted_image.width(), corrupted_image.height()},
+            restored_image);
+}
+
+void uwmf_filter::restore_tiled_with_mask(
+        const monochrome_image& corrupted_image, const noise_mask& mask,
+        const std::size_t tile_size, monochrome_image& restored_image)
+{
+    tiled_corrupted_.assign(corrupted_image, tile_size, context_margin());
+    tiled_mask_.assign(mask, tile_size, context_margin());
+    restore_tiles(tiled_corrupted_, tiled_mask_, tiled_restored_);
+    tiled_restored_.to_row_major(restored_image);
+}
+
+void uwmf_filter::restore_tiles(const tiled_image& corrupted_tiles,
+        const tiled_image& mask_tiles, tiled_image& restored_tiles)
+{
+    ASSERT(corrupted_tiles.tile_count() == mask_tiles.tile_count()
+            && corrupted_tiles.tile_size() == mask_tiles.tile_size(),
+            "image and mask tiles differ");
+    ASSERT(corrupted_tiles.halo() >= context_margin(),
+            "tile halo is narrower than the context margin");
+
+    // copies the geometry, the tiles' buffers are reused
+    restored_tiles = corrupted_tiles;
+    for(std::size_t i = 0; i < corrupted_tiles.tile_count(); i++) {
+        TRACE_SCOPE("restore tile", i);
+        const auto& tile = corrupted_tiles.tile(i);
+        restore_rect(tile, mask_tiles.tile(i),
+                grow(corrupted_tiles.interior(i), active_margin(),
+                        tile.width(), tile.height()),
+                restored_tiles.tile(i));
+    }
+}
+
+void uwmf_filter::restore_rect(const monochrome_image& corrupted_image,
+        const noise_mask& mask, const rect& active,
+        monochrome_image& restored_image)
+{
+    TRACE_SCOPE("restore");
+    ASSERT(mask.width() == corrupted_image.width()
+            && mask.height() == corrupted_image.height(),
+            "mask and image dimensions differ");
+    restored_image.resize(corrupted_image.width(), corrupted_image.height());
+    restored_image.data() = corrupted_image.data();
+
+    unsupported_.clear();
+    if(fft_) {
+        undecided_.clear();
+        fft_->restore(corrupted_image, mask, active, restored_image,
+                unsupported_, undecided_);
+        for(const auto& [x, y]: undecided_) {
+            restored_image(x, y) =
+                    *restore_pixel(corrupted_image, mask, x, y, weights_);
         }
+    }
+    else {
+        // clean pixels were copied in bulk above, only the corrupted ones
+        // are visited from here on
+        restore_corrupted(corrupted_image, mask, active, restored_image);
+    }
 
-        weights = org_weights;
+    worklist_.clear();
+    for(const auto& [x, y]: unsupported_) {
+        restored_image(x, y) = fallback_pixel(mask, x, y);
+        if(parameters_.passes > 1) {
+            worklist_.push_back({x, y});
+        }
+    }
 
-        bool all_corrupted = true;
-        std::array<int, 2> corr_count{};
-        auto interm = intermediates{};
+    if(!worklist_.empty()) {
+        resolve_worklist(restored_image);
+    }
+}
 
-        convolve({x, y}, image_size, parameters,
-                [&, x = x, y = y]
-                (const int xx, const int yy, const int weight_index)
-                {
-                    auto corr_result =
-                            detector(corrupted_image(x + xx, y +  yy));
-                    if(corr_result.first) {
-                        corr_count[corr_result.second]++;
-                    }
-                    else {
-                        all_corrupted = false;
-                        const double weight = weights[weight_index];
-                        interm.S += weight * yy * yy;
-                        interm.P += weight * xx * xx;
-                        interm.Q += weight * xx * yy;
-                        interm.R += weight * xx;
-                        interm.T += weight * yy;
-                    }
-                });
-
-        if(all_corrupted) {
-            constexpr auto min =
-                    std::numeric_limits<monochrome_image::value_type>::min();
-            constexpr auto max =
-                    std::numeric_limits<monochrome_image::value_type>::max();
-            constexpr auto salt = corruption::SALT;
-            constexpr auto pepper = corruption::PEPPER;
-            restored_image(x, y) = corr_count[salt] > corr_count[pepper]
-                    ? min
-                    : max;
-            continue;
+void uwmf_filter::restore_corrupted(const monochrome_image& corrupted_image,
+        const noise_mask& mask, const rect& active,
+        monochrome_image& restored_image)
+{
+    // with threads, the corrupted pixels are counted per row first, so that
+    // every thread can start its run at the right pixel
+    std::size_t count = 0;
+    if(threads_ > 1) {
+        row_counts_.assign(active.height + 1, 0);
+        for(std::size_t y = 0; y < active.height; y++) {
+            row_counts_[y + 1] = row_counts_[y] + count_corrupted(
+                    &mask(active.x, active.y + y), active.width);
         }
+        count = row_counts_.back();
+    }
+    const std::size_t threads = std::max(std::size_t{1},
+            std::min(threads_, count / min_pixels_per_thread));
+    thread_weights_.resize(threads, weights_);
+    thread_batches_.resize(threads);
+    thread_unsupported_.resize(threads);
 
-        auto [S, P, Q, R, T] = interm;
-        R = -R;
-        T = -T;
-
-        point2d gp;
-        gp.y = ((P * T) - (Q * R)) / (-(Q * Q) + (P * S));
-        gp.x = (R - (Q * gp.y)) / P;
-
-        convolve({x, y}, image_size, parameters,
-                [&, x = x, y = y]
-                (const int xx, const int yy, const int weight_index)
-                {
-                    if(!detector(corrupted_image(x + xx, y + yy)).first) {
-                        const double weight = weights[weight_index];
-                        weights[weight_index] =
-                                weight + (weight * (xx * gp.x + yy * gp.y));
-                    }
-                });
-
-        double sumw = 0;
-        double sumi = 0;
-        double sumwo = 0;
-        double sumio = 0;
-        convolve({x, y}, image_size, parameters,
-                [&, x = x, y = y]
-                (const int xx, const int yy, const int weight_index)
-                {
-                    auto curr_pixel = corrupted_image(x + xx, y + yy);
-                    if(!detector(curr_pixel).first) {
-                        const double weight = weights[weight_index];
-                        const double org_weight = org_weights[weight_index];
-                        sumw += weight;
-                        sumi += weight * curr_pixel;
-                        sumwo += org_weight;
-                        sumio += org_weight * curr_pixel;
-                    }
-                });
+    // every thread writes a disjoint set of pixels and only reads clean
+    // ones, which are never written
+    const auto restore_run = [&] (const std::size_t t)
+    {
+        TRACE_SCOPE("restore run", t);
+        auto& batch = thread_batches_[t];
+        batch.resize(batch_size + word_size);
+        auto& unsupported = thread_unsupported_[t];
+        unsupported.clear();
+
+        size2d cursor = {active.x, active.y};
+        std::size_t remaining = std::numeric_limits<std::size_t>::max();
+        if(threads > 1) {
+            const std::size_t begin = count * t / threads;
+            const std::size_t end = count * (t + 1) / threads;
+            const std::size_t row = std::upper_bound(row_counts_.begin(),
+                    row_counts_.end(), begin) - row_counts_.begin() - 1;
+            cursor.y += row;
+            for(std::size_t skip = begin - row_counts_[row]; skip > 0;) {
+                skip -= collect_corrupted(mask, active, cursor,
+                        std::min(batch_size, skip), batch.data());
+            }
+            remaining = end - begin;
+        }
+
+        while(remaining > 0) {
+            const std::size_t collected = collect_corrupted(mask, active,
+                    cursor, std::min(batch_size, remaining), batch.data());
+            if(collected == 0) {
+                break;
+            }
+            remaining -= collected;
+
+            for(std::size_t i = 0; i < collected; i++) {
+                const auto [x, y] = batch[i];
+                if(auto value = restore_pixel(corrupted_image, mask, x, y,
+                        thread_weights_[t])) {
+                    restored_image(x, y) = *value;
+                }
+                else {
+                    unsupported.push_back({x, y});
+                }
+            }
+        }
+    };
+
+    if(threads == 1) {
+        restore_run(0);
+    }
+    else {
+        // the calling thread takes the first run, the destructor of the
+        // pool waits for the others
+        thread_pool pool(threads - 1, threads - 1);
+        for(std::size_t t = 1; t < threads; t++) {
+            pool.submit([&restore_run, t] { restore_run(t); });
+        }
+        restore_run(0);
+    }
+
+    // runs are in row-major order, and so is their concatenation
+    for(std::size_t t = 0; t < threads; t++) {
+        unsupported_.insert(unsupported_.end(),
+                thread_unsupported_[t].begin(), thread_unsupported_[t].end());
+    }
+}
+
+void uwmf_filter::restore_rows_in_place(monochrome_image& image,
+        const std::function<const unsigned char*(std::size_t)>& detect_row)
+{
+    const std::size_t width = image.width();
+    const std::size_t height = image.height();
+    const std::size_t w = parameters_.w;
+    TRACE_SCOPE("restore in place");
+
+    worklist_.clear();
+    if(width == 0 || height == 0) {
+        return;
+    }
 
-        if(sumw == 0) {
-            restored_image(x, y) = sumio / sumwo;
+    mask_.resize(width, std::min(2 * w + 1, height));
+    rolling_mask mask(mask_, height);
+    for(std::size_t y = 0; y < w && y < height; y++) {
+        mask.store(y, detect_row(y));
+    }
+
+    for(std::size_t y = 0; y < height; y++) {
+        if(y + w < height) {
+            mask.store(y + w, detect_row(y + w));
         }
-        else {
-            restored_image(x, y) = sumi / sumw;
+
+        for(std::size_t x = 0; x < width; x++) {
+            if(mask(x, y) == corruption::NONE) {
+                continue;
+            }
+
+            if(auto value = restore_pixel(image, mask, x, y, weights_)) {
+                image(x, y) = *value;
+            }
+            else {
+                image(x, y) = fallback_pixel(mask, x, y);
+                if(parameters_.passes > 1) {
+                    worklist_.push_back({x, y});
+                }
+            }
         }
     }
 
-    return restored_image;
+    if(!worklist_.empty()) {
+        resolve_worklist(image);
+    }
+}
+
+void uwmf_filter::restore_region(const monochrome_image& corrupted_image,
+        const noise_mask& mask, const rect& region,
+        monochrome_image& restored_image)
+{
+    ASSERT(restored_image.width() == corrupted_image.width()
+            && restored_image.height() == corrupted_image.height(),
+            "restored image and corrupted image dimensions differ");
+
+    // pixels close to the border of the context see clipped windows, the
+    // margin is wide enough that this can't reach into region, not even
+    // through later passes
+    const rect context = grow(region, context_margin(),
+            corrupted_image.width(), corrupted_image.height());
+    const rect active = grow(region, active_margin(),
+            corrupted_image.width(), corrupted_image.height());
+    crop(corrupted_image, context, region_image_);
+    crop(mask, context, region_mask_);
+    restore_rect(region_image_, region_mask_,
+            {active.x - context.x, active.y - context.y,
+            active.width, active.height},
+            region_restored_);
+
+    paste(region_restored_,
+            {region.x - context.x, region.y - context.y,
+            region.width, region.height},
+            restored_image, region.x, region.y);
+}
+
+void uwmf_filter::resolve_worklist(monochrome_image& restored_image)
+{
+    TRACE_SCOPE("extra passes");
+    // every pixel restored so far counts as clean from now on
+    const std::size_t width = restored_image.width();
+    pending_.assign(width * restored_image.height(), false);
+    for(const auto& [x, y]: worklist_) {
+        pending_[y * width + x] = true;
+    }
+    const worklist_mask support(pending_, width, restored_image.height());
+
+    std::vector<std::pair<worklist_entry, monochrome_image::value_type>>
+            resolved;
+    for(int pass = 1; pass < parameters_.passes && !worklist_.empty();
+            pass++) {
+        // pixels resolved within a pass only become support for the next
+        // one, so the outcome does not depend on the traversal order
+        resolved.clear();
+        std::size_t remaining = 0;
+        for(const auto& entry: worklist_) {
+            if(auto value = restore_pixel(restored_image, support, entry.x,
+                    entry.y, weights_)) {
+                resolved.emplace_back(entry, *value);
+            }
+            else {
+                worklist_[remaining++] = entry;
+            }
+        }
+        worklist_.resize(remaining);
+
+        LOGV() << "pass " << pass + 1 << ": resolved " << resolved.size()
+                << ", remaining " << remaining;
+
+        if(resolved.empty()) {
+            break;
+        }
+
+        for(const auto& [entry, value]: resolved) {
+            restored_image(entry.x, entry.y) = value;
+            pending_[entry.y * width + entry.x] = false;
+        }
+    }
+}
+
+template<typename Mask>
+std::optional<monochrome_image::value_type> uwmf_filter::restore_pixel(
+        const monochrome_image& corrupted_image, const Mask& mask,
+        const std::size_t x, const std::size_t y,
+        std::vector<double>& weights) const
+{
+    if(lut_) {
+        return lut_->restore(corrupted_image, mask, x, y);
+    }
+    else if(parameters_.algorithm == algorithm_type::IBINR) {
+        return weighted_mean(corrupted_image, mask, x, y);
+    }
+
+    return restore_window(corrupted_image, mask, x, y, weights);
+}
+
+template<typename Mask>
+monochrome_image::value_type uwmf_filter::fallback_pixel(const Mask& mask,
+        const std::size_t x, const std::size_t y) const
+{
+    const discrete_point2d image_size =
+            {static_cast<int>(mask.width()), static_cast<int>(mask.height())};
+
+    std::array<int, 2> corr_count{};
+    convolve({x, y}, image_size, parameters_,
+            [&] (const int xx, const int yy, const int)
+            {
+                const auto corr = mask(x + xx, y + yy);
+                if(corr != corruption::NONE) {
+                    corr_count[corr]++;
+                }
+            });
+
+    return fallback_value(corr_count);
+}
+
+template<typename Mask>
+std::optional<monochrome_image::value_type> uwmf_filter::weighted_mean(
+        const monochrome_image& corrupted_image, const Mask& mask,
+        const std::size_t x, const std::size_t y) const
+{
+    const discrete_point2d image_size =
+            {static_cast<int>(corrupted_image.width()),
+            static_cast<int>(corrupted_image.height())};
+
+    bool all_corrupted = true;
+    double sumwo = 0;
+    double sumio = 0;
+    convolve({x, y}, image_size, parameters_,
+            [&] (const int xx, const int yy, const int weight_index)
+            {
+                if(mask(x + xx, y + yy) == corruption::NONE) {
+                    all_corrupted = false;
+                    const double weight = org_weights_[weight_index];
+                    sumwo += weight;
+                    sumio += weight * corrupted_image(x + xx, y + yy);
+                }
+            });
+
+    if(all_corrupted) {
+        return std::nullopt;
+    }
+    return static_cast<monochrome_image::value_type>(sumio / sumwo);
+}
+
+template<typename Mask>
+std::optional<monochrome_image::value_type> uwmf_filter::restore_window(
+        const monochrome_image& corrupted_image, const Mask& mask,
+        const std::size_t x, const std::size_t y,
+        std::vector<double>& weights) const
+{
+    const auto& parameters = parameters_;
+    const auto& org_weights = org_weights_;
+
+    const discrete_point2d image_size =
+            {static_cast<int>(corrupted_image.width()),
+            static_cast<int>(corrupted_image.height())};
+
+    weights = org_weights;
+
+    bool all_corrupted = true;
+    auto interm = intermediates{};
+
+    convolve({x, y}, image_size, parameters,
+            [&] (const int xx, const int yy, const int weight_index)
+            {
+                if(mask(x + xx, y + yy) == corruption::NONE) {
+                    all_corrupted = false;
+                    const double weight = weights[weight_index];
+                    interm.S += weight * yy * yy;
+                    interm.P += weight * xx * xx;
+                    interm.Q += weight * xx * yy;
+                    interm.R += weight * xx;
+                    interm.T += weight * yy;
+                }
+            });
+
+    if(all_corrupted) {
+        return std::nullopt;
+    }
+
+    auto [S, P, Q, R, T] = interm;
+    R = -R;
+    T = -T;
+
+    point2d gp;
+    gp.y = ((P * T) - (Q * R)) / (-(Q * Q) + (P * S));
+    gp.x = (R - (Q * gp.y)) / P;
+
+    convolve({x, y}, image_size, parameters,
+            [&] (const int xx, const int yy, const int weight_index)
+            {
+                if(mask(x + xx, y + yy) == corruption::NONE) {
+                    const double weight = weights[weight_index];
+                    weights[weight_index] =
+                            weight + (weight * (xx * gp.x + yy * gp.y));
+                }
+            });
+
+    double sumw = 0;
+    double sumi = 0;
+    double sumwo = 0;
+    double sumio = 0;
+    convolve({x, y}, image_size, parameters,
+            [&] (const int xx, const int yy, const int weight_index)
+            {
+                if(mask(x + xx, y + yy) == corruption::NONE) {
+                    const auto curr_pixel = corrupted_image(x + xx, y + yy);
+                    const double weight = weights[weight_index];
+                    const double org_weight = org_weights[weight_index];
+                    sumw += weight;
+                    sumi += weight * curr_pixel;
+                    sumwo += org_weight;
+                    sumio += org_weight * curr_pixel;
+                }
+            });
+
+    if(sumw == 0) {
+        return static_cast<monochrome_image::value_type>(sumio / sumwo);
+    }
+    else {
+        return static_cast<monochrome_image::value_type>(sumi / sumw);
+    }
 }
 
 
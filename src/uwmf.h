@@ -4,20 +4,284 @@
 
 #include "image.h"
 #include "image_utils.h"
+#include "tiled_image.h"
+#include "uwmf_fft.h"
+#include "uwmf_lut.h"
 
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
 
 namespace uwmf
 {
 
+// UWMF is IBINR (the inverse distance weighted mean of the clean pixels of
+// a window) plus the spatial-bias correction, which solves for the gradient
+// of the clean pixels' weight distribution and rewrites the weights. IBINR
+// skips the correction, it is faster but biased towards the side of the
+// window with more clean pixels. MEDIAN and ADAPTIVE_MEDIAN are the
+// baselines of median_filters.h, uwmf_filter implements neither
+enum class algorithm_type
+{
+    UWMF,
+    IBINR,
+    MEDIAN,
+    ADAPTIVE_MEDIAN
+};
+
+inline bool is_baseline(const algorithm_type type)
+{
+    return type == algorithm_type::MEDIAN
+            || type == algorithm_type::ADAPTIVE_MEDIAN;
+}
+
+std::optional<algorithm_type> to_algorithm_type(std::string str);
+std::string to_string(const algorithm_type type);
+
 struct uwmf_parameters
 {
     int w;
     int p;
     int k;
+    // pixels without a single clean pixel in their window are revisited
+    // in up to passes - 1 additional passes, where pixels restored in
+    // earlier passes count as clean
+    int passes = 1;
+    algorithm_type algorithm = algorithm_type::UWMF;
 };
 
+inline bool operator==(const uwmf_parameters& lhs, const uwmf_parameters& rhs)
+{
+    return lhs.w == rhs.w && lhs.p == rhs.p && lhs.k == rhs.k
+            && lhs.passes == rhs.passes && lhs.algorithm == rhs.algorithm;
+}
+
+inline bool operator!=(const uwmf_parameters& lhs, const uwmf_parameters& rhs)
+{
+    return !(lhs == rhs);
+}
+
+// the filtering window size the README suggests for a corruption density
+// in [0, 1]
+int suggested_window_size(const double density);
+
+// how the filtering windows of corrupted pixels are evaluated. auto picks
+// the lookup table for w = 1 and direct evaluation otherwise. all of them
+// restore the same pixels, fft leaves the windows its rounding noise could
+// change to direct evaluation (see uwmf_fft)
+enum class engine_type
+{
+    AUTO,
+    DIRECT,
+    LUT,
+    FFT
+};
+
+std::optional<engine_type> to_engine_type(std::string str);
+std::string to_string(const engine_type type);
+
+// keeps everything that only depends on the parameters (weight table and
+// scratch buffers) around, so that long-running callers can restore many
+// images without paying the setup cost on every call
+class uwmf_filter
+{
+public:
+    // the lut engine requires w = 1. with more than one thread the
+    // corrupted pixels of large images are split into runs of equal length,
+    // one per thread, so dense and sparse parts of an image balance out
+    explicit uwmf_filter(const uwmf_parameters parameters,
+            const engine_type engine = engine_type::AUTO,
+            const std::size_t threads = 1);
+
+    const uwmf_parameters& parameters() const
+    {
+        return parameters_;
+    }
+
+    // restored_image is resized as necessary, its buffer is reused otherwise
+    template<typename Detector>
+    void restore(const monochrome_image& corrupted_image,
+            const Detector& detector, monochrome_image& restored_image)
+    {
+        detect_noise(corrupted_image, detector, mask_);
+        restore_with_mask(corrupted_image, mask_, restored_image);
+    }
+
+    template<typename Detector>
+    monochrome_image restore(const monochrome_image& corrupted_image,
+            const Detector& detector)
+    {
+        monochrome_image restored_image;
+        restore(corrupted_image, detector, restored_image);
+        return restored_image;
+    }
+
+    // restores image without a second image buffer. the kernel only reads
+    // clean neighbours, which are never written, so only the noise mask of
+    // the 2w + 1 rows within reach of the window is kept. the result is the
+    // same as that of restore(), the fft engine falls back to direct
+    // evaluation here
+    template<typename Detector>
+    void restore_in_place(monochrome_image& image, const Detector& detector)
+    {
+        // rows are detected w rows ahead of the one being restored, so the
+        // detector never sees restored pixels
+        ASSERT(Detector::halo <= parameters_.w,
+                "detector halo exceeds the filtering window");
+
+        restore_rows_in_place(image,
+                [&] (const std::size_t y)
+                {
+                    const rect strip = grow({0, y, image.width(), 1},
+                            Detector::halo, image.width(), image.height());
+                    crop(image, strip, region_image_);
+                    region_mask_.resize(strip.width, strip.height);
+                    detector.detect_rows(region_image_, y - strip.y,
+                            y - strip.y + 1, region_mask_);
+                    return &region_mask_(0, y - strip.y);
+                });
+    }
+
+    // mask must have been produced by a noise detector for corrupted_image
+    void restore_with_mask(const monochrome_image& corrupted_image,
+            const noise_mask& mask, monochrome_image& restored_image);
+
+    // same result as restore(), but the image is converted to a tiled
+    // layout and restored tile by tile, which keeps the 2w + 1 rows a
+    // window spans close together on wide images
+    template<typename Detector>
+    void restore_tiled(const monochrome_image& corrupted_image,
+            const Detector& detector, const std::size_t tile_size,
+            monochrome_image& restored_image)
+    {
+        detect_noise(corrupted_image, detector, mask_);
+        restore_tiled_with_mask(corrupted_image, mask_, tile_size,
+                restored_image);
+    }
+
+    void restore_tiled_with_mask(const monochrome_image& corrupted_image,
+            const noise_mask& mask, const std::size_t tile_size,
+            monochrome_image& restored_image);
+
+    // corrupted_tiles and mask_tiles must share their geometry, with a halo
+    // of at least context_margin(). restored_tiles takes on that geometry,
+    // only the pixels without the halo are meaningful
+    void restore_tiles(const tiled_image& corrupted_tiles,
+            const tiled_image& mask_tiles, tiled_image& restored_tiles);
+
+    // restores only the pixels of region into restored_image, which must
+    // have the dimensions of corrupted_image. the result is the same as
+    // that of a full restoration, but only the neighbourhood the region
+    // depends on is processed (see context_margin())
+    void restore_region(const monochrome_image& corrupted_image,
+            const noise_mask& mask, const rect& region,
+            monochrome_image& restored_image);
+
+    // distance up to which restored pixels depend on the input, every pass
+    // can pull in support from one more window
+    std::size_t context_margin() const
+    {
+        return static_cast<std::size_t>(parameters_.w) * parameters_.passes;
+    }
+
+private:
+    using worklist_entry = basic_point2d<std::size_t>;
+
+    uwmf_parameters parameters_;
+    std::size_t threads_;
+    std::vector<double> org_weights_;
+    std::vector<double> weights_;
+    noise_mask mask_;
+    // w = 1 windows are small enough to tabulate every clean/corrupted
+    // pattern up front
+    std::optional<uwmf_lut> lut_;
+    // whole blocks of windows at once through their correlations
+    std::optional<uwmf_fft> fft_;
+    // corrupted pixels before every row of the active rect, and the scratch
+    // of every thread restoring them
+    std::vector<std::size_t> row_counts_;
+    std::vector<std::vector<double>> thread_weights_;
+    std::vector<std::vector<worklist_entry>> thread_batches_;
+    std::vector<std::vector<worklist_entry>> thread_unsupported_;
+    // pixels without clean support, and which of them are still pending
+    std::vector<worklist_entry> worklist_;
+    std::vector<bool> pending_;
+    std::vector<worklist_entry> unsupported_;
+    // windows the fft engine leaves to direct evaluation
+    std::vector<worklist_entry> undecided_;
+    // context of restore_region()
+    monochrome_image region_image_;
+    noise_mask region_mask_;
+    monochrome_image region_restored_;
+    // tiled layout of restore_tiled()
+    tiled_image tiled_corrupted_;
+    tiled_image tiled_mask_;
+    tiled_image tiled_restored_;
+
+    // restores the corrupted pixels within active, the others are copied.
+    // a region comes out exact if active covers it grown by active_margin()
+    // and the image covers it grown by context_margin()
+    void restore_rect(const monochrome_image& corrupted_image,
+            const noise_mask& mask, const rect& active,
+            monochrome_image& restored_image);
+
+    // pixels up to this distance from a region are restored by earlier
+    // passes on behalf of the region
+    std::size_t active_margin() const
+    {
+        return context_margin() - parameters_.w;
+    }
+
+    // restores the corrupted pixels within active into restored_image,
+    // split into runs of equal length across the threads, and collects
+    // those without clean support in unsupported_
+    void restore_corrupted(const monochrome_image& corrupted_image,
+            const noise_mask& mask, const rect& active,
+            monochrome_image& restored_image);
+
+    // detect_row(y) returns the noise mask of row y
+    void restore_rows_in_place(monochrome_image& image,
+            const std::function<const unsigned char*(std::size_t)>& detect_row);
+
+    // Mask maps image coordinates to corruption values, see the masks in
+    // uwmf.cpp. returns std::nullopt if there is no clean pixel in the
+    // window. weights is scratch of the size of the window, one per thread
+    template<typename Mask>
+    std::optional<monochrome_image::value_type> restore_pixel(
+            const monochrome_image& corrupted_image, const Mask& mask,
+            const std::size_t x, const std::size_t y,
+            std::vector<double>& weights) const;
+
+    // weighted mean of the clean pixels of the window, without the
+    // spatial-bias correction (IBINR)
+    template<typename Mask>
+    std::optional<monochrome_image::value_type> weighted_mean(
+            const monochrome_image& corrupted_image, const Mask& mask,
+            const std::size_t x, const std::size_t y) const;
+
+    // direct evaluation of the filtering window around a corrupted pixel
+    template<typename Mask>
+    std::optional<monochrome_image::value_type> restore_window(
+            const monochrome_image& corrupted_image, const Mask& mask,
+            const std::size_t x, const std::size_t y,
+            std::vector<double>& weights) const;
+
+    template<typename Mask>
+    monochrome_image::value_type fallback_pixel(const Mask& mask,
+            const std::size_t x, const std::size_t y) const;
+
+    // revisits the worklist in restored_image, which is updated in place
+    void resolve_worklist(monochrome_image& restored_image);
+};
+
+template<typename Detector>
 monochrome_image uwmf(const monochrome_image& corrupted_image,
-        noise_detector detector, const uwmf_parameters parameters);
+        const Detector& detector, const uwmf_parameters parameters)
+{
+    return uwmf_filter(parameters).restore(corrupted_image, detector);
+}
 
 monochrome_image UWMF(//graphics::basic_Canvas<float> &original,
 		  const monochrome_image &image,
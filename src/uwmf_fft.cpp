@@ -0,0 +1,199 @@
+#include "uwmf_fft.h"
+
+#include "fft.h"
+#include "image.h"
+#include "image_utils.h"
+#include "utils.h"
+#include "window_moments.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// transforms are a few times as wide as the window, so that most of every
+// block yields valid outputs
+std::size_t transform_size(const int w)
+{
+    const std::size_t edge_length = 2 * w + 1;
+    std::size_t size = 32;
+    while(size < 4 * edge_length) {
+        size *= 2;
+    }
+    return size;
+}
+
+} // anonymous
+
+namespace uwmf
+{
+
+uwmf_fft::uwmf_fft(const std::vector<double>& org_weights, const int w,
+        const bool correct_bias)
+    : w_(w)
+    , moment_count_(correct_bias ? MOMENT_COUNT : WEIGHT + 1)
+    , fft_(transform_size(w))
+    , block_size_(fft_.size() - 2 * w)
+{
+    const std::size_t edge_length = 2 * w + 1;
+    ASSERT(org_weights.size() == edge_length * edge_length,
+            "weights don't match the filtering window");
+
+    // correlation with the window is convolution with the mirrored window,
+    // i.e. offset (dx, dy) goes to index (-dx, -dy) modulo the size
+    const std::size_t size = fft_.size();
+    for(auto& kernel: kernels_) {
+        kernel.assign(size * size, 0);
+    }
+    for(int dy = -w; dy <= w; dy++) {
+        for(int dx = -w; dx <= w; dx++) {
+            const double weight = org_weights[(dy + w) * edge_length + dx + w];
+            const std::size_t index = ((size - dy) % size) * size
+                    + (size - dx) % size;
+            kernels_[WEIGHT][index] = weight;
+            kernels_[X][index] = weight * dx;
+            kernels_[Y][index] = weight * dy;
+            kernels_[XX][index] = weight * dx * dx;
+            kernels_[YY][index] = weight * dy * dy;
+            kernels_[XY][index] = weight * dx * dy;
+        }
+    }
+    // all moments are bounded by the weights times w^2
+    magnitude_ = 0;
+    for(const double weight: org_weights) {
+        magnitude_ += weight * w * w;
+    }
+
+    for(auto& kernel: kernels_) {
+        fft_.forward(kernel);
+    }
+
+    input_.resize(size * size);
+    for(auto& m: moments_) {
+        m.resize(size * size);
+    }
+    clean_sums_.resize((size + 1) * (size + 1));
+    values_.resize(block_size_);
+}
+
+void uwmf_fft::restore(const monochrome_image& corrupted_image,
+        const noise_mask& mask, const rect& active,
+        monochrome_image& restored_image,
+        std::vector<basic_point2d<std::size_t>>& unsupported,
+        std::vector<basic_point2d<std::size_t>>& undecided)
+{
+    const std::size_t size = fft_.size();
+    const std::size_t w = w_;
+    const double scale = 1.0 / (size * size);
+
+    for(std::size_t by = active.y; by < active.y + active.height;
+            by += block_size_) {
+        for(std::size_t bx = active.x; bx < active.x + active.width;
+                bx += block_size_) {
+            const std::size_t width =
+                    std::min(block_size_, active.x + active.width - bx);
+            const std::size_t height =
+                    std::min(block_size_, active.y + active.height - by);
+
+            correlate_block(corrupted_image, mask, bx, by);
+
+            for(std::size_t y = 0; y < height; y++) {
+                // the window of (x, y) is centered at (x + w, y + w) within
+                // the block
+                const std::size_t row = (y + w) * size + w;
+
+                // closed-form solution for every pixel of the row, whether
+                // corrupted or not, so that the loops have no branches
+                if(moment_count_ == MOMENT_COUNT) {
+                    for(std::size_t x = 0; x < width; x++) {
+                        values_[x] = corrected_mean(row + x, scale);
+                    }
+                }
+                else {
+                    for(std::size_t x = 0; x < width; x++) {
+                        const complex& sums = moments_[WEIGHT][row + x];
+                        values_[x] = weighted_mean(sums.real() * scale,
+                                sums.imag() * scale, magnitude_);
+                    }
+                }
+
+                for(std::size_t x = 0; x < width; x++) {
+                    if(mask(bx + x, by + y) == corruption::NONE) {
+                        continue;
+                    }
+
+                    const std::size_t stride = size + 1;
+                    const int clean = clean_sums_[(y + 2 * w + 1) * stride
+                                    + x + 2 * w + 1]
+                            - clean_sums_[y * stride + x + 2 * w + 1]
+                            - clean_sums_[(y + 2 * w + 1) * stride + x]
+                            + clean_sums_[y * stride + x];
+                    if(clean == 0) {
+                        unsupported.push_back({bx + x, by + y});
+                    }
+                    else if(std::isnan(values_[x])) {
+                        undecided.push_back({bx + x, by + y});
+                    }
+                    else {
+                        restored_image(bx + x, by + y) =
+                                static_cast<monochrome_image::value_type>(
+                                        values_[x]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+double uwmf_fft::corrected_mean(const std::size_t i, const double scale) const
+{
+    return uwmf::corrected_mean({moments_[WEIGHT][i].real() * scale,
+            moments_[WEIGHT][i].imag() * scale,
+            moments_[X][i].real() * scale, moments_[X][i].imag() * scale,
+            moments_[Y][i].real() * scale, moments_[Y][i].imag() * scale,
+            moments_[XX][i].real() * scale, moments_[YY][i].real() * scale,
+            moments_[XY][i].real() * scale}, magnitude_);
+}
+
+void uwmf_fft::correlate_block(const monochrome_image& corrupted_image,
+        const noise_mask& mask, const std::size_t x, const std::size_t y)
+{
+    const std::size_t size = fft_.size();
+    const std::size_t stride = size + 1;
+
+    // the block starts w pixels before (x, y), everything outside of the
+    // image is treated as corrupted, which amounts to clipping the windows
+    for(std::size_t yy = 0; yy < size; yy++) {
+        for(std::size_t xx = 0; xx < size; xx++) {
+            const std::size_t image_x = x + xx - w_;
+            const std::size_t image_y = y + yy - w_;
+            const bool clean = x + xx >= static_cast<std::size_t>(w_)
+                    && y + yy >= static_cast<std::size_t>(w_)
+                    && image_x < corrupted_image.width()
+                    && image_y < corrupted_image.height()
+                    && mask(image_x, image_y) == corruption::NONE;
+
+            input_[yy * size + xx] = clean
+                    ? complex(1, corrupted_image(image_x, image_y))
+                    : complex(0, 0);
+            clean_sums_[(yy + 1) * stride + xx + 1] = clean
+                    + clean_sums_[yy * stride + xx + 1]
+                    + clean_sums_[(yy + 1) * stride + xx]
+                    - clean_sums_[yy * stride + xx];
+        }
+    }
+
+    fft_.forward(input_);
+    for(std::size_t m = 0; m < moment_count_; m++) {
+        for(std::size_t i = 0; i < input_.size(); i++) {
+            const complex& a = input_[i];
+            const complex& b = kernels_[m][i];
+            moments_[m][i] = {a.real() * b.real() - a.imag() * b.imag(),
+                    a.real() * b.imag() + a.imag() * b.real()};
+        }
+        fft_.inverse(moments_[m]);
+    }
+}
+
+} // uwmf
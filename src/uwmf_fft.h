@@ -0,0 +1,85 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include "fft.h"
+#include "image.h"
+#include "image_utils.h"
+
+namespace uwmf
+{
+
+// Every quantity the kernel accumulates over the clean pixels of a window is
+// a correlation of the clean mask M (or of M times the image) with a fixed
+// kernel: sumwo and sumio with the weights K, R and T with K dx and K dy, P,
+// S and Q with K dx^2, K dy^2 and K dx dy. The sums of the corrected weights
+// follow in closed form, sumw = sumwo + gx R + gy T and likewise for sumi
+// with the first order correlations of M times the image.
+//
+// The correlations are evaluated blockwise (overlap-save) with FFTs, M and
+// M times the image packed into the real and imaginary part of a single
+// transform, so one forward and six inverse transforms cover all nine of
+// them. The cost per pixel grows with log(w) instead of w^2. The
+// correlations carry rounding noise, so windows whose truncated value it
+// could change (see window_moments.h) are left to direct evaluation, and
+// results are those of the direct kernel. On lena that is under 4 % of the
+// corrupted pixels for w >= 2 up to density 0.7, but more than half of
+// them at density 0.9 and above, where many windows keep one or two clean
+// pixels and a singular system for the gradient.
+class uwmf_fft
+{
+public:
+    // org_weights must be the (2w + 1)^2 Minkowski weights of the filter.
+    // without the spatial-bias correction (IBINR) only sumwo and sumio are
+    // needed, which takes a single inverse transform
+    uwmf_fft(const std::vector<double>& org_weights, const int w,
+            const bool correct_bias = true);
+
+    // restores the corrupted pixels within active into restored_image.
+    // pixels without a single clean pixel in their window are left alone
+    // and appended to unsupported instead, those the correlations can't
+    // decide to undecided
+    void restore(const monochrome_image& corrupted_image,
+            const noise_mask& mask, const rect& active,
+            monochrome_image& restored_image,
+            std::vector<basic_point2d<std::size_t>>& unsupported,
+            std::vector<basic_point2d<std::size_t>>& undecided);
+
+private:
+    using complex = fft2d::complex;
+
+    enum moment
+    {
+        WEIGHT,
+        X,
+        Y,
+        XX,
+        YY,
+        XY,
+        MOMENT_COUNT
+    };
+
+    int w_;
+    std::size_t moment_count_; // moments that are actually needed
+    fft2d fft_;
+    std::size_t block_size_; // valid outputs per block edge
+    double magnitude_; // bound of the moments, the scale of rounding noise
+    std::array<std::vector<complex>, MOMENT_COUNT> kernels_;
+    std::vector<complex> input_;
+    std::array<std::vector<complex>, MOMENT_COUNT> moments_;
+    std::vector<int> clean_sums_; // integral image of the clean mask
+    std::vector<double> values_;
+
+    // restored value of the window at index i of the moments, with the
+    // spatial-bias correction, NaN if the window is undecided
+    double corrected_mean(const std::size_t i, const double scale) const;
+
+    void correlate_block(const monochrome_image& corrupted_image,
+            const noise_mask& mask, const std::size_t x, const std::size_t y);
+};
+
+} // uwmf
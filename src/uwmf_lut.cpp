@@ -0,0 +1,77 @@
+#include "uwmf_lut.h"
+
+#include "image.h"
+#include "image_utils.h"
+#include "utils.h"
+
+namespace
+{
+
+using uwmf::discrete_point2d;
+
+constexpr std::size_t weight_index(const discrete_point2d& offset)
+{
+    return (offset.y + 1) * 3 + offset.x + 1;
+}
+
+} // anonymous
+
+namespace uwmf
+{
+
+uwmf_lut::uwmf_lut(const std::vector<double>& org_weights,
+        const bool correct_bias)
+{
+    ASSERT(org_weights.size() == 9, "lut requires a 3x3 filtering window");
+
+    for(std::size_t pattern = 0; pattern < pattern_count; pattern++) {
+        const auto is_clean = [pattern] (const std::size_t i)
+        {
+            return (pattern >> i) & 1;
+        };
+
+        double S = 0;
+        double P = 0;
+        double Q = 0;
+        double R = 0;
+        double T = 0;
+        for(std::size_t i = 0; i < neighbour_count; i++) {
+            if(is_clean(i)) {
+                const auto [xx, yy] = neighbours[i];
+                const double weight = org_weights[weight_index(neighbours[i])];
+                S += weight * yy * yy;
+                P += weight * xx * xx;
+                Q += weight * xx * yy;
+                R += weight * xx;
+                T += weight * yy;
+            }
+        }
+        R = -R;
+        T = -T;
+
+        point2d gp;
+        gp.y = ((P * T) - (Q * R)) / (-(Q * Q) + (P * S));
+        gp.x = (R - (Q * gp.y)) / P;
+
+        entry corrected{};
+        entry original{};
+        for(std::size_t i = 0; i < neighbour_count; i++) {
+            if(is_clean(i)) {
+                const auto [xx, yy] = neighbours[i];
+                const double weight = org_weights[weight_index(neighbours[i])];
+                corrected.weights[i] =
+                        weight + (weight * (xx * gp.x + yy * gp.y));
+                corrected.sum += corrected.weights[i];
+                original.weights[i] = weight;
+                original.sum += weight;
+            }
+        }
+
+        // pattern 0 is never looked up, pixels without any clean neighbour
+        // take the fallback path
+        entries_[pattern] =
+                !correct_bias || corrected.sum == 0 ? original : corrected;
+    }
+}
+
+} // uwmf
@@ -0,0 +1,105 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+#include "image.h"
+#include "image_utils.h"
+
+namespace uwmf
+{
+
+// For w = 1 the spatial-bias correction only depends on which of the eight
+// neighbours are clean, so the corrected weights of all 256 patterns are
+// computed once and restoring a pixel boils down to gathering the pattern
+// from the noise mask plus an 8-element dot product. Out-of-image neighbours
+// are treated like corrupted ones that are not counted, which is exactly
+// what the window clipping of the direct kernel amounts to.
+//
+// Weights are kept unnormalized and the dot product runs in the same order
+// as the direct kernel, so results are bit-identical to it (restored values
+// are truncated, a prenormalized table would flip some of them).
+//
+// A full table for w = 2 would need 2^24 patterns of 24 weights (3 GiB).
+// Factoring it per window row (5 tables of 32 partial S, P, Q, R, T moments)
+// is cheap, but the moments would then be summed in a different order than
+// by the direct kernel, so it is not pursued.
+class uwmf_lut
+{
+public:
+    static constexpr std::size_t neighbour_count = 8;
+    static constexpr std::size_t pattern_count = 1 << neighbour_count;
+
+    // org_weights must be the 3x3 Minkowski weights of the filter. without
+    // the spatial-bias correction the table holds the original weights
+    // (IBINR)
+    explicit uwmf_lut(const std::vector<double>& org_weights,
+            const bool correct_bias = true);
+
+    // (x, y) must be a corrupted pixel. returns std::nullopt if none of its
+    // neighbours is clean. Mask is anything that maps image coordinates to
+    // corruption values like a noise_mask does
+    template<typename Mask>
+    std::optional<monochrome_image::value_type> restore(
+            const monochrome_image& corrupted_image, const Mask& mask,
+            const std::size_t x, const std::size_t y) const;
+
+private:
+    struct entry
+    {
+        std::array<double, neighbour_count> weights;
+        double sum;
+    };
+
+    // raster order, matching the traversal of the direct kernel
+    static constexpr std::array<discrete_point2d, neighbour_count>
+            neighbours = {{
+                    {-1, -1}, {0, -1}, {1, -1},
+                    {-1, 0}, {1, 0},
+                    {-1, 1}, {0, 1}, {1, 1}}};
+
+    std::array<entry, pattern_count> entries_;
+};
+
+template<typename Mask>
+std::optional<monochrome_image::value_type> uwmf_lut::restore(
+        const monochrome_image& corrupted_image, const Mask& mask,
+        const std::size_t x, const std::size_t y) const
+{
+    const std::size_t width = corrupted_image.width();
+    const std::size_t height = corrupted_image.height();
+    const bool inner = x > 0 && y > 0 && x + 1 < width && y + 1 < height;
+
+    std::array<monochrome_image::value_type, neighbour_count> pixels{};
+    std::size_t pattern = 0;
+
+    for(std::size_t i = 0; i < neighbour_count; i++) {
+        const auto [xx, yy] = neighbours[i];
+        if(!inner && (x + xx >= width || y + yy >= height)) {
+            continue;
+        }
+
+        if(mask(x + xx, y + yy) == corruption::NONE) {
+            pattern |= std::size_t{1} << i;
+            pixels[i] = corrupted_image(x + xx, y + yy);
+        }
+    }
+
+    if(pattern == 0) {
+        return std::nullopt;
+    }
+
+    const entry& e = entries_[pattern];
+    double sumi = 0;
+    for(std::size_t i = 0; i < neighbour_count; i++) {
+        sumi += e.weights[i] * pixels[i];
+    }
+
+    return static_cast<monochrome_image::value_type>(sumi / e.sum);
+}
+
+} // uwmf
@@ -0,0 +1,75 @@
+#include "window_moments.h"
+
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+constexpr double max_intensity = 255;
+// relative size of the determinant below which a window counts as singular,
+// far above the noise and far below that of any window that is not
+constexpr double singular_tolerance = 1e-9;
+
+// NaN unless the error bound of value keeps its truncation unambiguous
+double decided(const double value, const double error)
+{
+    return std::abs(value - std::round(value)) > error
+            ? value
+            : std::numeric_limits<double>::quiet_NaN();
+}
+
+} // anonymous
+
+namespace uwmf
+{
+
+double corrected_mean(const window_moments& moments, const double magnitude)
+{
+    const double P = moments.P;
+    const double S = moments.S;
+    const double Q = moments.Q;
+    const double R = -moments.rw;
+    const double T = -moments.tw;
+
+    // the closed form of restore_window()
+    const double determinant = -(Q * Q) + (P * S);
+    // the clean pixels lie on a line through the center, the direct kernel
+    // divides rounding noise by rounding noise here
+    if(std::abs(determinant) <= singular_tolerance * magnitude * magnitude) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    const double gy = ((P * T) - (Q * R)) / determinant;
+    const double gx = (R - (Q * gy)) / P;
+    const double sumw = moments.sumwo + gx * moments.rw + gy * moments.tw;
+    const double sumi = moments.sumio + gx * moments.ri + gy * moments.ti;
+
+    // first-order propagation of the noise of the moments, every non-finite
+    // intermediate (singular windows) ends up in a NaN bound
+    const double noise = moment_noise * magnitude;
+    const double gradient = 1 + std::abs(gx) + std::abs(gy);
+    const double gy_error =
+            4 * noise * magnitude * gradient / std::abs(determinant);
+    const double gx_error =
+            (noise * gradient + std::abs(Q) * gy_error) / std::abs(P);
+    const double sumw_error = noise * gradient
+            + gx_error * std::abs(moments.rw)
+            + gy_error * std::abs(moments.tw);
+    const double sumi_error = max_intensity * noise * gradient
+            + gx_error * std::abs(moments.ri)
+            + gy_error * std::abs(moments.ti);
+    const double value = sumi / sumw;
+    return decided(value,
+            (sumi_error + std::abs(value) * sumw_error) / std::abs(sumw));
+}
+
+double weighted_mean(const double sumwo, const double sumio,
+        const double magnitude)
+{
+    const double noise = moment_noise * magnitude;
+    const double value = sumio / sumwo;
+    return decided(value,
+            (max_intensity * noise + std::abs(value) * noise) / sumwo);
+}
+
+} // uwmf
@@ -0,0 +1,42 @@
+// -*- mode: c++ -*-
+
+#pragma once
+
+namespace uwmf
+{
+
+// sums over the clean pixels of a window that the restored value follows
+// from in closed form (see uwmf_fft): sumwo and sumio of the weights and of
+// the weights times the image, rw and ri, tw and ti of both times dx and
+// dy, P, S and Q of the weights times dx^2, dy^2 and dx dy
+struct window_moments
+{
+    double sumwo;
+    double sumio;
+    double rw;
+    double ri;
+    double tw;
+    double ti;
+    double P;
+    double S;
+    double Q;
+};
+
+// the moments carry rounding noise, e.g. from the fft, of up to
+// moment_noise times magnitude, a bound of the moments (times 255 for
+// those of the image). where the truncated result of the direct kernel
+// hinges on it, the moments can't decide the window: for a singular or
+// ill-conditioned system for the gradient, for corrected weights that
+// (nearly) cancel out, and for values within rounding of an integer. the
+// functions below return NaN for these windows, which must be evaluated
+// directly, so that every engine restores the same pixels
+constexpr double moment_noise = 1e-12;
+
+// restored value with the spatial-bias correction, or NaN
+double corrected_mean(const window_moments& moments, const double magnitude);
+
+// plain weighted mean of the clean pixels (IBINR), or NaN
+double weighted_mean(const double sumwo, const double sumio,
+        const double magnitude);
+
+} // uwmf
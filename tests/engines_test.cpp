@@ -0,0 +1,104 @@
+// every engine and the multi-window pass must restore the same pixels as
+// direct evaluation, also at the high densities where most windows keep one
+// or two clean pixels and have to be left to direct evaluation
+
+#include "image.h"
+#include "image_utils.h"
+#include "logger.h"
+#include "multi_window.h"
+#include "noise_detectors.h"
+#include "png_image.h"
+#include "uwmf.h"
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+using namespace uwmf;
+
+// number of pixels that differ
+std::size_t differences(const monochrome_image& lhs,
+        const monochrome_image& rhs)
+{
+    std::size_t count = 0;
+    for(std::size_t i = 0; i < lhs.data().size(); i++) {
+        count += lhs.data()[i] != rhs.data()[i];
+    }
+    return count;
+}
+
+bool test_fft(const monochrome_image& corrupted_image,
+        const uwmf_parameters& parameters)
+{
+    const naive_noise_detector detector{};
+    const auto direct = uwmf_filter(parameters, engine_type::DIRECT)
+            .restore(corrupted_image, detector);
+    const auto fft = uwmf_filter(parameters, engine_type::FFT)
+            .restore(corrupted_image, detector);
+    if(const std::size_t count = differences(direct, fft)) {
+        LOGE() << "fft: " << count << " pixels differ with "
+                << to_string(parameters.algorithm) << ", w "
+                << parameters.w << ", p " << parameters.p;
+        return false;
+    }
+    return true;
+}
+
+bool test_multi_window(const monochrome_image& corrupted_image,
+        const uwmf_parameters& parameters)
+{
+    const naive_noise_detector detector{};
+    multi_window_filter filter({1, 2, 3, 4, 6}, parameters);
+    std::vector<monochrome_image> restored_images;
+    filter.restore(corrupted_image, detector, restored_images);
+
+    bool passed = true;
+    for(std::size_t i = 0; i < filter.windows().size(); i++) {
+        auto window_parameters = parameters;
+        window_parameters.w = filter.windows()[i];
+        const auto direct = uwmf_filter(window_parameters, engine_type::DIRECT)
+                .restore(corrupted_image, detector);
+        if(const std::size_t count =
+                differences(direct, restored_images[i])) {
+            LOGE() << "multi-window: " << count << " pixels differ with "
+                    << to_string(parameters.algorithm) << ", w "
+                    << window_parameters.w << ", p " << parameters.p;
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+} // anonymous
+
+int main()
+{
+    auto png_image = read_png_image("images/lena.png");
+    if(!png_image) {
+        LOGE() << "can't read images/lena.png";
+        return 1;
+    }
+    const monochrome_image image(std::move(png_image->buffer),
+            png_image->width, png_image->height);
+
+    bool passed = true;
+    for(const double density: {0.7, 0.9, 0.95}) {
+        LOGI() << "density " << density;
+        const monochrome_image corrupted_image = fvin(image, density, 1);
+        for(const auto algorithm:
+                {algorithm_type::UWMF, algorithm_type::IBINR}) {
+            passed &= test_multi_window(corrupted_image,
+                    {1, 1, 4, 1, algorithm});
+            for(const int p: {1, 2}) {
+                for(const int w: {2, 3, 6}) {
+                    passed &= test_fft(corrupted_image,
+                            {w, p, 4, 1, algorithm});
+                }
+            }
+        }
+    }
+    return passed ? 0 : 1;
+}